@@ -24,6 +24,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 #define RUNNING_ON_VALGRIND 0  /* FIXME */
 
@@ -43,6 +44,24 @@ WINE_DEFAULT_DEBUG_CHANNEL(heap);
 #define HEAP_STD 0
 #define HEAP_LAL 1
 #define HEAP_LFH 2
+#define HEAP_SEGMENT 3  /* wine extension, LFH with the segment backend for medium blocks */
+
+/* HEAP_INFORMATION_CLASS values, wine extensions */
+
+#define HeapMagazineInformation 0x1000
+#define HeapProfileDump         0x1001  /* write the sampling heap profile, see heap_profile_dump */
+
+struct heap_magazine_information
+{
+    ULONG     thread_count;  /* number of threads with magazines for the heap */
+    ULONG     cached_count;  /* number of blocks currently cached in magazines */
+    SIZE_T    cached_size;   /* total size of the blocks currently cached in magazines */
+    ULONGLONG alloc_hits;    /* allocations served from a magazine */
+    ULONGLONG alloc_misses;  /* allocations served from the bins */
+    ULONGLONG free_hits;     /* frees cached in a magazine */
+    ULONGLONG free_misses;   /* frees returned to the bins */
+    ULONGLONG flushed;       /* blocks flushed from magazines back to the bins */
+};
 
 
 /* undocumented RtlWalkHeap structure */
@@ -249,6 +268,65 @@ C_ASSERT( BLOCK_BIN_SIZE( 0x80 ) == ~(SIZE_T)0 );
 /* difference between block classes and all possible validation overhead must fit into block tail_size */
 C_ASSERT( BIN_SIZE_STEP_7 + 3 * BLOCK_ALIGN <= FIELD_MAX( struct block, tail_size ) );
 
+/* segment backend size classes, for medium blocks between BIN_SIZE_MAX and HEAP_MIN_LARGE_BLOCK_SIZE,
+ * with 8 page multiple classes per power of two up to SEGMENT_SIZE_LINEAR, and linear steps after it.
+ */
+
+#define SEGMENT_SIZE_MIN        BIN_SIZE_MAX
+#define SEGMENT_SIZE_LINEAR     0x80000
+#define SEGMENT_SIZE_STEP_MAX   0x8000
+#define SEGMENT_CLASS_BITS      3
+#define SEGMENT_BIN_COUNT       48
+#define SEGMENT_GROUP_SIZE      0x100000  /* target size of a segment group page run */
+#define SEGMENT_GROUP_CACHE     8         /* max number of free groups kept in a segment bin */
+
+/* difference between segment classes and all possible validation overhead must fit into block tail_size */
+C_ASSERT( SEGMENT_SIZE_STEP_MAX + 3 * BLOCK_ALIGN <= FIELD_MAX( struct block, tail_size ) );
+C_ASSERT( SEGMENT_SIZE_MIN == 1 << 15 );
+
+#define SEGMENT_LINEAR_BIN      (4 << SEGMENT_CLASS_BITS)  /* log2( SEGMENT_SIZE_LINEAR / SEGMENT_SIZE_MIN ) classes */
+
+static inline UINT segment_size_bin( SIZE_T block_size )
+{
+    DWORD bit;
+
+    if (block_size > SEGMENT_SIZE_LINEAR)
+        return SEGMENT_LINEAR_BIN + (block_size - 1 - SEGMENT_SIZE_LINEAR) / SEGMENT_SIZE_STEP_MAX;
+
+    BitScanReverse( &bit, block_size - 1 );
+    return ((bit - 15) << SEGMENT_CLASS_BITS) + ((block_size - 1) & ((1 << bit) - 1)) / (1 << (bit - SEGMENT_CLASS_BITS));
+}
+
+static inline SIZE_T segment_bin_size( UINT bin )
+{
+    SIZE_T size, step;
+
+    if (bin >= SEGMENT_LINEAR_BIN) size = SEGMENT_SIZE_LINEAR + (bin - SEGMENT_LINEAR_BIN + 1) * SEGMENT_SIZE_STEP_MAX;
+    else
+    {
+        step = ((SIZE_T)SEGMENT_SIZE_MIN << (bin >> SEGMENT_CLASS_BITS)) >> SEGMENT_CLASS_BITS;
+        size = step * ((1 << SEGMENT_CLASS_BITS) + (bin & ((1 << SEGMENT_CLASS_BITS) - 1)) + 1);
+    }
+
+    /* the last class is clamped to the largest block size that isn't allocated as a large block */
+    return min( size, HEAP_MIN_LARGE_BLOCK_SIZE - BLOCK_ALIGN );
+}
+
+#define HEAP_BIN_COUNT          (BLOCK_SIZE_BIN_COUNT + SEGMENT_BIN_COUNT)
+
+/* segment bins are stored after the LFH bins, the last LFH bin is never used */
+static inline UINT heap_size_bin( SIZE_T block_size )
+{
+    if (block_size <= BIN_SIZE_MAX) return BLOCK_SIZE_BIN( block_size );
+    return BLOCK_SIZE_BIN_COUNT + segment_size_bin( block_size );
+}
+
+static inline SIZE_T heap_bin_size( UINT bin )
+{
+    if (bin < BLOCK_SIZE_BIN_COUNT) return BLOCK_BIN_SIZE( bin );
+    return segment_bin_size( bin - BLOCK_SIZE_BIN_COUNT );
+}
+
 static BYTE affinity_mapping[] = {20,6,31,15,14,29,27,4,18,24,26,13,0,9,2,30,17,7,23,25,10,19,12,3,22,21,5,16,1,28,11,8};
 static LONG next_thread_affinity;
 
@@ -273,7 +351,7 @@ struct bin
 
 static inline struct group **bin_get_affinity_group( struct bin *bin, BYTE affinity )
 {
-    return bin->affinity_group_base + affinity * BLOCK_SIZE_BIN_COUNT;
+    return bin->affinity_group_base + affinity * HEAP_BIN_COUNT;
 }
 
 struct heap
@@ -300,6 +378,7 @@ struct heap
     RTL_CRITICAL_SECTION cs;
     struct entry     free_lists[FREE_LIST_COUNT];
     struct bin      *bins;
+    struct heap_magazine_information magazine_stats; /* stats of the flushed thread magazines */
     SUBHEAP          subheap;
 };
 
@@ -331,10 +410,13 @@ C_ASSERT( HEAP_MIN_LARGE_BLOCK_SIZE <= HEAP_INITIAL_GROW_SIZE );
 BOOL delay_heap_free = FALSE;
 BOOL heap_zero_hack = FALSE;
 BOOL heap_top_down_hack = FALSE;
+BOOL heap_segment_backend = FALSE;
 
 static struct heap *process_heap;  /* main process heap */
 
 static NTSTATUS heap_free_block_lfh( struct heap *heap, ULONG flags, struct block *block );
+static void heap_drop_magazines( struct heap *heap );
+static void heap_profile_drop( struct heap *heap );
 
 /* check if memory range a contains memory range b */
 static inline BOOL contains( const void *a, SIZE_T a_size, const void *b, SIZE_T b_size )
@@ -669,12 +751,12 @@ static void heap_dump( const struct heap *heap )
     TRACE( "  next %p\n", LIST_ENTRY( heap->entry.next, struct heap, entry ) );
 
     TRACE( "  bins:\n" );
-    for (i = 0; heap->bins && i < BLOCK_SIZE_BIN_COUNT; i++)
+    for (i = 0; heap->bins && i < HEAP_BIN_COUNT; i++)
     {
         const struct bin *bin = heap->bins + i;
         ULONG alloc = ReadNoFence( &bin->count_alloc ), freed = ReadNoFence( &bin->count_freed );
         if (!alloc && !freed) continue;
-        TRACE( "    %3u: size %#4Ix, alloc %ld, freed %ld, enabled %lu\n", i, BLOCK_BIN_SIZE( i ),
+        TRACE( "    %3u: size %#4Ix, alloc %ld, freed %ld, enabled %lu\n", i, heap_bin_size( i ),
                alloc, freed, ReadNoFence( &bin->enabled ) );
     }
 
@@ -1589,16 +1671,18 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, void *addr, SIZE_T total_size, SIZE_T
 
     if (heap->flags & HEAP_GROWABLE)
     {
-        SIZE_T size = (sizeof(struct bin) + sizeof(struct group *) * ARRAY_SIZE(affinity_mapping)) * BLOCK_SIZE_BIN_COUNT;
+        SIZE_T size = (sizeof(struct bin) + sizeof(struct group *) * ARRAY_SIZE(affinity_mapping)) * HEAP_BIN_COUNT;
         NtAllocateVirtualMemory( NtCurrentProcess(), (void *)&heap->bins,
                                  0, &size, MEM_COMMIT, PAGE_READWRITE );
 
-        for (i = 0; heap->bins && i < BLOCK_SIZE_BIN_COUNT; ++i)
+        for (i = 0; heap->bins && i < HEAP_BIN_COUNT; ++i)
         {
             RtlInitializeSListHead( &heap->bins[i].groups );
             /* offset affinity_group_base to interleave the bin affinity group pointers */
-            heap->bins[i].affinity_group_base = (struct group **)(heap->bins + BLOCK_SIZE_BIN_COUNT) + i;
+            heap->bins[i].affinity_group_base = (struct group **)(heap->bins + HEAP_BIN_COUNT) + i;
         }
+
+        if (heap->bins && heap_segment_backend) heap->compat_info = HEAP_SEGMENT;
     }
 
     /* link it into the per-process heap list */
@@ -1667,7 +1751,9 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE handle )
     /* remove it from the per-process list */
     RtlEnterCriticalSection( &process_heap->cs );
     list_remove( &heap->entry );
+    if (heap->bins) heap_drop_magazines( heap );
     RtlLeaveCriticalSection( &process_heap->cs );
+    if (heap_profile_rate) heap_profile_drop( heap );
 
     heap->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &heap->cs );
@@ -1768,6 +1854,19 @@ struct DECLSPEC_ALIGN(BLOCK_ALIGN) group
 #define GROUP_BLOCK_COUNT     (sizeof(((struct group *)0)->free_bits) * 8 - 1)
 #define GROUP_FLAG_FREE       (1u << GROUP_BLOCK_COUNT)
 
+/* segment groups are page runs of SEGMENT_GROUP_SIZE, holding fewer blocks than LFH groups */
+static inline UINT group_block_count( SIZE_T block_size )
+{
+    if (block_size <= BIN_SIZE_MAX) return GROUP_BLOCK_COUNT;
+    return max( 1, min( GROUP_BLOCK_COUNT, SEGMENT_GROUP_SIZE / block_size ) );
+}
+
+/* free_bits of a fully freed group, without GROUP_FLAG_FREE */
+static inline LONG group_free_bits( SIZE_T block_size )
+{
+    return ~GROUP_FLAG_FREE >> (GROUP_BLOCK_COUNT - group_block_count( block_size ));
+}
+
 static inline UINT block_get_group_index( const struct block *block )
 {
     return block->base_offset;
@@ -1805,16 +1904,17 @@ static inline struct block *group_find_free_block( struct group *group, SIZE_T b
 /* allocate a new group block using non-LFH allocation, returns a group owned by current thread */
 static struct group *group_allocate( struct heap *heap, ULONG flags, SIZE_T block_size )
 {
-    SIZE_T i, group_size, group_block_size;
+    SIZE_T i, count = group_block_count( block_size ), group_size, group_block_size;
     struct group *group;
     NTSTATUS status;
 
-    group_size = offsetof( struct group, first_block ) + GROUP_BLOCK_COUNT * block_size;
+    group_size = offsetof( struct group, first_block ) + count * block_size;
     group_block_size = heap_get_block_size( heap, flags, group_size );
 
     heap_lock( heap, flags );
 
-    if (group_block_size >= HEAP_MIN_LARGE_BLOCK_SIZE)
+    /* segment groups are always allocated as separate page runs, outside of the subheaps */
+    if (group_block_size >= HEAP_MIN_LARGE_BLOCK_SIZE || block_size > BIN_SIZE_MAX)
         status = heap_allocate_large( heap, flags & ~HEAP_ZERO_MEMORY, group_block_size, group_size, (void **)&group );
     else
         status = heap_allocate_block( heap, flags & ~HEAP_ZERO_MEMORY, group_block_size, group_size, (void **)&group );
@@ -1824,9 +1924,9 @@ static struct group *group_allocate( struct heap *heap, ULONG flags, SIZE_T bloc
     if (status) return NULL;
 
     block_set_flags( (struct block *)group - 1, 0, BLOCK_FLAG_LFH );
-    group->free_bits = ~GROUP_FLAG_FREE;
+    group->free_bits = group_free_bits( block_size );
 
-    for (i = 0; i < GROUP_BLOCK_COUNT; ++i)
+    for (i = 0; i < count; ++i)
     {
         struct block *block = group_get_block( group, block_size, i );
         valgrind_make_writable( block, sizeof(*block) );
@@ -1893,7 +1993,7 @@ static struct group *heap_acquire_bin_group( struct heap *heap, ULONG flags, SIZ
 /* release a thread owned and fully freed group to the bin shared group, or free its memory */
 static NTSTATUS heap_release_bin_group( struct heap *heap, ULONG flags, struct bin *bin, struct group *group )
 {
-    ULONG affinity = group->affinity;
+    ULONG affinity = group->affinity, max_depth = ARRAY_SIZE(affinity_mapping);
 
     /* using InterlockedExchangePointer here would possibly return a group that has used blocks,
      * we prefer keeping our fully freed group instead for reduced memory consumption.
@@ -1901,8 +2001,9 @@ static NTSTATUS heap_release_bin_group( struct heap *heap, ULONG flags, struct b
     if (!InterlockedCompareExchangePointer( (void *)bin_get_affinity_group( bin, affinity ), group, NULL ))
         return STATUS_SUCCESS;
 
-    /* try re-using the block group instead of releasing it */
-    if (RtlQueryDepthSList( &bin->groups ) <= ARRAY_SIZE(affinity_mapping))
+    /* try re-using the block group instead of releasing it, segment groups are larger so keep fewer */
+    if (bin - heap->bins >= BLOCK_SIZE_BIN_COUNT) max_depth = SEGMENT_GROUP_CACHE;
+    if (RtlQueryDepthSList( &bin->groups ) <= max_depth)
     {
         RtlInterlockedPushEntrySList( &bin->groups, &group->entry );
         return STATUS_SUCCESS;
@@ -1936,21 +2037,235 @@ static struct block *find_free_bin_block( struct heap *heap, ULONG flags, SIZE_T
     return block;
 }
 
+/* return a free block to its group, returns the group if it is fully freed and now owned by current thread */
+static struct group *group_free_block( struct block *block, SIZE_T block_size )
+{
+    struct group *group = block_get_group( block );
+    LONG free_bits = group_free_bits( block_size );
+    UINT i = block_get_group_index( block );
+
+    /* if this was the last used block in a group and GROUP_FLAG_FREE was set */
+    if (InterlockedOr( &group->free_bits, 1 << i ) != (LONG)((free_bits | GROUP_FLAG_FREE) & ~(1 << i)))
+        return NULL;
+
+    group->free_bits = free_bits;
+    return group;
+}
+
+/* per-thread magazines, caching freed LFH blocks in front of the bins */
+
+#define MAGAZINE_HEAP_COUNT   4       /* max number of heaps with magazines in a thread */
+#define MAGAZINE_BLOCK_COUNT  16      /* max number of blocks cached in a magazine */
+#define MAGAZINE_BLOCK_SIZE   0x10000 /* max total size of the blocks cached in a magazine */
+
+#define THREAD_MAGAZINES_DETACHED ((struct thread_magazines *)1)
+
+struct magazine
+{
+    struct block *blocks;  /* cached blocks, linked through their first data bytes */
+    UINT count;
+};
+
+struct heap_magazines
+{
+    struct heap *heap;
+    struct heap_magazine_information stats;
+    struct magazine magazines[BLOCK_SIZE_BIN_COUNT];
+};
+
+struct thread_magazines
+{
+    struct list entry;  /* entry in thread_magazines_list */
+    struct heap_magazines heaps[MAGAZINE_HEAP_COUNT];
+};
+
+/* the thread magazines are kept in TEB->ReservedForPerf, which isn't used otherwise,
+ * so that they don't take a TLS slot away from the application */
+
+/* list of all thread magazines, protected by the process heap lock */
+static struct list thread_magazines_list = LIST_INIT( thread_magazines_list );
+
+static struct thread_magazines *thread_magazines_create(void)
+{
+    struct thread_magazines *thread = NULL;
+    SIZE_T size = sizeof(*thread);
+
+    if (NtAllocateVirtualMemory( NtCurrentProcess(), (void **)&thread, 0, &size, MEM_COMMIT, PAGE_READWRITE ))
+        return NULL;
+
+    RtlEnterCriticalSection( &process_heap->cs );
+    list_add_tail( &thread_magazines_list, &thread->entry );
+    RtlLeaveCriticalSection( &process_heap->cs );
+
+    NtCurrentTeb()->ReservedForPerf = thread;
+    return thread;
+}
+
+/* get the current thread magazines for a heap, or reserve new ones */
+static struct heap_magazines *heap_get_magazines( struct heap *heap )
+{
+    struct thread_magazines *thread = NtCurrentTeb()->ReservedForPerf;
+    struct heap_magazines *magazines, *unused = NULL;
+
+    if (thread == THREAD_MAGAZINES_DETACHED) return NULL;
+    if (!thread && !(thread = thread_magazines_create())) return NULL;
+
+    for (magazines = thread->heaps; magazines < thread->heaps + MAGAZINE_HEAP_COUNT; magazines++)
+    {
+        if (magazines->heap == heap) return magazines;
+        if (!magazines->heap && !unused) unused = magazines;
+    }
+
+    if (unused) unused->heap = heap;
+    return unused;
+}
+
+static struct block *magazine_pop( struct heap *heap, UINT index )
+{
+    struct heap_magazines *magazines;
+    struct magazine *magazine;
+    struct block *block;
+
+    if (!(magazines = heap_get_magazines( heap ))) return NULL;
+    magazine = magazines->magazines + index;
+
+    if (!(block = magazine->blocks))
+    {
+        magazines->stats.alloc_misses++;
+        return NULL;
+    }
+
+    magazine->blocks = *(struct block **)(block + 1);
+    magazine->count--;
+    magazines->stats.alloc_hits++;
+    return block;
+}
+
+static BOOL magazine_push( struct heap *heap, UINT index, struct block *block )
+{
+    struct heap_magazines *magazines;
+    struct magazine *magazine;
+
+    if (index >= BLOCK_SIZE_BIN_COUNT) return FALSE;  /* segment blocks are too large to be cached */
+    if (!(magazines = heap_get_magazines( heap ))) return FALSE;
+    magazine = magazines->magazines + index;
+
+    if (magazine->count >= min( MAGAZINE_BLOCK_COUNT, MAGAZINE_BLOCK_SIZE / BLOCK_BIN_SIZE( index ) ))
+    {
+        magazines->stats.free_misses++;
+        return FALSE;
+    }
+
+    valgrind_make_writable( block + 1, sizeof(struct block *) );
+    *(struct block **)(block + 1) = magazine->blocks;
+    magazine->blocks = block;
+    magazine->count++;
+    magazines->stats.free_hits++;
+    return TRUE;
+}
+
+/* flush cached blocks back to their groups, process heap lock must be held */
+static void heap_flush_magazines( struct heap *heap, struct heap_magazines *magazines )
+{
+    struct heap_magazine_information *stats = &heap->magazine_stats;
+    struct block *block;
+    struct group *group;
+    UINT i;
+
+    for (i = 0; i < BLOCK_SIZE_BIN_COUNT; ++i)
+    {
+        struct magazine *magazine = magazines->magazines + i;
+
+        magazines->stats.flushed += magazine->count;
+        while ((block = magazine->blocks))
+        {
+            magazine->blocks = *(struct block **)(block + 1);
+            /* releasing the group would need the heap lock, keep it in the bin instead */
+            if ((group = group_free_block( block, BLOCK_BIN_SIZE( i ) )))
+                RtlInterlockedPushEntrySList( &heap->bins[i].groups, &group->entry );
+        }
+        magazine->count = 0;
+    }
+
+    stats->alloc_hits += magazines->stats.alloc_hits;
+    stats->alloc_misses += magazines->stats.alloc_misses;
+    stats->free_hits += magazines->stats.free_hits;
+    stats->free_misses += magazines->stats.free_misses;
+    stats->flushed += magazines->stats.flushed;
+    memset( &magazines->stats, 0, sizeof(magazines->stats) );
+    magazines->heap = NULL;
+}
+
+/* drop all thread magazines of a destroyed heap, process heap lock must be held */
+static void heap_drop_magazines( struct heap *heap )
+{
+    struct thread_magazines *thread;
+    UINT i;
+
+    LIST_FOR_EACH_ENTRY( thread, &thread_magazines_list, struct thread_magazines, entry )
+    {
+        for (i = 0; i < MAGAZINE_HEAP_COUNT; ++i)
+        {
+            struct heap_magazines *magazines = thread->heaps + i;
+            if (magazines->heap != heap) continue;
+            memset( &magazines->stats, 0, sizeof(*magazines) - offsetof( struct heap_magazines, stats ) );
+            InterlockedExchangePointer( (void **)&magazines->heap, NULL );
+        }
+    }
+}
+
+static void heap_get_magazine_information( struct heap *heap, struct heap_magazine_information *info )
+{
+    struct thread_magazines *thread;
+    UINT i, j;
+
+    RtlEnterCriticalSection( &process_heap->cs );
+
+    *info = heap->magazine_stats;
+    LIST_FOR_EACH_ENTRY( thread, &thread_magazines_list, struct thread_magazines, entry )
+    {
+        for (i = 0; i < MAGAZINE_HEAP_COUNT; ++i)
+        {
+            const struct heap_magazines *magazines = thread->heaps + i;
+            if (magazines->heap != heap) continue;
+
+            info->thread_count++;
+            info->alloc_hits += magazines->stats.alloc_hits;
+            info->alloc_misses += magazines->stats.alloc_misses;
+            info->free_hits += magazines->stats.free_hits;
+            info->free_misses += magazines->stats.free_misses;
+            info->flushed += magazines->stats.flushed;
+            for (j = 0; j < BLOCK_SIZE_BIN_COUNT; ++j)
+            {
+                UINT count = ReadNoFence( (LONG *)&magazines->magazines[j].count );
+                info->cached_count += count;
+                info->cached_size += count * BLOCK_BIN_SIZE( j );
+            }
+        }
+    }
+
+    RtlLeaveCriticalSection( &process_heap->cs );
+}
+
 static NTSTATUS heap_allocate_block_lfh( struct heap *heap, ULONG flags, SIZE_T block_size,
                                          SIZE_T size, void **ret )
 {
-    struct bin *bin, *last = heap->bins + BLOCK_SIZE_BIN_COUNT - 1;
+    UINT index = heap_size_bin( block_size );
+    struct bin *bin = heap->bins + index;
     struct block *block;
 
-    bin = heap->bins + BLOCK_SIZE_BIN( block_size );
-    if (bin == last) return STATUS_UNSUCCESSFUL;
-
+    if (index >= BLOCK_SIZE_BIN_COUNT)
+    {
+        /* segment bins are all enabled at once, with the heap compatibility mode */
+        if (ReadNoFence( &heap->compat_info ) != HEAP_SEGMENT) return STATUS_UNSUCCESSFUL;
+    }
     /* paired with WriteRelease in bin_try_enable. */
-    if (!ReadAcquire( &bin->enabled )) return STATUS_UNSUCCESSFUL;
+    else if (!ReadAcquire( &bin->enabled )) return STATUS_UNSUCCESSFUL;
 
-    block_size = BLOCK_BIN_SIZE( BLOCK_SIZE_BIN( block_size ) );
+    block_size = heap_bin_size( index );
 
-    if ((block = find_free_bin_block( heap, flags, block_size, bin )))
+    if ((index < BLOCK_SIZE_BIN_COUNT && (block = magazine_pop( heap, index ))) ||
+        (block = find_free_bin_block( heap, flags, block_size, bin )))
     {
         block_set_type( block, BLOCK_TYPE_USED );
         block_set_flags( block, (BYTE)~BLOCK_FLAG_LFH, BLOCK_USER_FLAGS( flags ) );
@@ -1965,31 +2280,20 @@ static NTSTATUS heap_allocate_block_lfh( struct heap *heap, ULONG flags, SIZE_T
 
 static NTSTATUS heap_free_block_lfh( struct heap *heap, ULONG flags, struct block *block )
 {
-    struct bin *bin, *last = heap->bins + BLOCK_SIZE_BIN_COUNT - 1;
-    SIZE_T i, block_size = block_get_size( block );
-    struct group *group = block_get_group( block );
-    NTSTATUS status = STATUS_SUCCESS;
+    SIZE_T block_size = block_get_size( block );
+    UINT index = heap_size_bin( block_size );
+    struct group *group;
 
     if (!(block_get_flags( block ) & BLOCK_FLAG_LFH)) return STATUS_UNSUCCESSFUL;
 
-    bin = heap->bins + BLOCK_SIZE_BIN( block_size );
-    if (bin == last) return STATUS_UNSUCCESSFUL;
-
-    i = block_get_group_index( block );
     valgrind_make_writable( block, sizeof(*block) );
     block_set_type( block, BLOCK_TYPE_FREE );
     block_set_flags( block, (BYTE)~BLOCK_FLAG_LFH, BLOCK_FLAG_FREE );
     mark_block_free( block + 1, (char *)block + block_size - (char *)(block + 1), flags );
 
-    /* if this was the last used block in a group and GROUP_FLAG_FREE was set */
-    if (InterlockedOr( &group->free_bits, 1 << i ) == ~(1 << i))
-    {
-        /* thread now owns the group, and can release it to its bin */
-        group->free_bits = ~GROUP_FLAG_FREE;
-        status = heap_release_bin_group( heap, flags, bin, group );
-    }
-
-    return status;
+    if (magazine_push( heap, index, block )) return STATUS_SUCCESS;
+    if (!(group = group_free_block( block, block_size ))) return STATUS_SUCCESS;
+    return heap_release_bin_group( heap, flags, heap->bins + index, group );
 }
 
 static void bin_try_enable( struct heap *heap, struct bin *bin )
@@ -2004,7 +2308,7 @@ static void bin_try_enable( struct heap *heap, struct bin *bin )
     else if (alloc - freed > 0x400000 / block_size) enable = TRUE;
     if (!enable) return;
 
-    if (ReadNoFence( &heap->compat_info ) != HEAP_LFH)
+    if (ReadNoFence( &heap->compat_info ) == HEAP_STD)
     {
         ULONG info = HEAP_LFH;
         RtlSetHeapInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
@@ -2027,7 +2331,7 @@ static void heap_thread_detach_bin_groups( struct heap *heap )
 
     if (!heap->bins) return;
 
-    for (i = 0; i < BLOCK_SIZE_BIN_COUNT; ++i)
+    for (i = 0; i < HEAP_BIN_COUNT; ++i)
     {
         struct bin *bin = heap->bins + i;
         struct group *group;
@@ -2038,16 +2342,375 @@ static void heap_thread_detach_bin_groups( struct heap *heap )
 
 void heap_thread_detach(void)
 {
+    struct thread_magazines *thread = NtCurrentTeb()->ReservedForPerf;
     struct heap *heap;
+    SIZE_T size = 0;
+    UINT i;
+
+    /* don't create new magazines if the thread keeps using the heap */
+    NtCurrentTeb()->ReservedForPerf = THREAD_MAGAZINES_DETACHED;
 
     RtlEnterCriticalSection( &process_heap->cs );
 
+    if (thread && thread != THREAD_MAGAZINES_DETACHED)
+    {
+        for (i = 0; i < MAGAZINE_HEAP_COUNT; ++i)
+            if (thread->heaps[i].heap) heap_flush_magazines( thread->heaps[i].heap, thread->heaps + i );
+        list_remove( &thread->entry );
+    }
+
     LIST_FOR_EACH_ENTRY( heap, &process_heap->entry, struct heap, entry )
         heap_thread_detach_bin_groups( heap );
 
     heap_thread_detach_bin_groups( process_heap );
 
     RtlLeaveCriticalSection( &process_heap->cs );
+
+    if (thread && thread != THREAD_MAGAZINES_DETACHED)
+        NtFreeVirtualMemory( NtCurrentProcess(), (void **)&thread, &size, MEM_RELEASE );
+}
+
+/* sampling heap profiler, enabled with WINE_HEAP_PROFILE=<mean sampling interval in bytes> */
+
+#define PROFILE_MAX_FRAMES   32
+#define PROFILE_MAX_PROBES   64
+#define PROFILE_BUCKET_COUNT 0x4000   /* aggregated call sites, power of 2 */
+#define PROFILE_SAMPLE_COUNT 0x10000  /* tracked live sampled blocks */
+#define PROFILE_HASH_SIZE    0x10000  /* sampled pointers hash table size, power of 2 */
+
+struct profile_bucket
+{
+    ULONG     hash;                       /* hash of the stack frames */
+    USHORT    size_bin;                   /* log2 size class of the sampled blocks */
+    USHORT    frame_count;                /* number of frames, 0 if the bucket is unused */
+    ULONGLONG alloc_count;                /* number of sampled allocations */
+    ULONGLONG alloc_size;                 /* total size of the sampled allocations */
+    ULONGLONG free_count;                 /* number of sampled allocations freed */
+    ULONGLONG free_size;                  /* total size of the sampled allocations freed */
+    void     *frames[PROFILE_MAX_FRAMES]; /* return addresses, innermost first */
+};
+
+struct profile_sample
+{
+    struct profile_sample *next;   /* next sample in the hash chain or in the free list */
+    struct profile_bucket *bucket; /* bucket the sample is accounted in */
+    struct heap           *heap;   /* heap the block was allocated from */
+    void                  *ptr;    /* pointer to the sampled block data */
+    SIZE_T                 size;   /* requested size of the sampled block */
+};
+
+struct profile_output
+{
+    HANDLE file;
+    ULONG  len;
+    char   buffer[0x1000];
+};
+
+SIZE_T heap_profile_rate;
+static WCHAR profile_prefix[MAX_PATH];
+static struct profile_bucket *profile_buckets;
+static struct profile_sample *profile_samples;
+static struct profile_sample *profile_free_samples;
+static struct profile_sample **profile_hash;
+static UINT profile_sample_used;
+static ULONG profile_seed;
+static ULONG profile_dropped;
+static LONG profile_dump_seq;
+
+DECLARE_CRITICAL_SECTION( profile_cs );
+
+void heap_profile_init( SIZE_T rate, const WCHAR *prefix )
+{
+    SIZE_T size = PROFILE_BUCKET_COUNT * sizeof(*profile_buckets) + PROFILE_SAMPLE_COUNT * sizeof(*profile_samples) +
+                  PROFILE_HASH_SIZE * sizeof(*profile_hash);
+    char *ptr = NULL;
+
+    if (!rate) return;
+    if (NtAllocateVirtualMemory( NtCurrentProcess(), (void **)&ptr, 0, &size, MEM_COMMIT, PAGE_READWRITE ))
+    {
+        ERR( "Failed to allocate heap profiler tables.\n" );
+        return;
+    }
+    profile_buckets = (struct profile_bucket *)ptr;
+    ptr += PROFILE_BUCKET_COUNT * sizeof(*profile_buckets);
+    profile_samples = (struct profile_sample *)ptr;
+    ptr += PROFILE_SAMPLE_COUNT * sizeof(*profile_samples);
+    profile_hash = (struct profile_sample **)ptr;
+
+    memcpy( profile_prefix, prefix, min( wcslen( prefix ), ARRAY_SIZE(profile_prefix) - 1 ) * sizeof(WCHAR) );
+    profile_seed = NtGetTickCount();
+    heap_profile_rate = rate;
+}
+
+static inline UINT profile_hash_index( const void *ptr )
+{
+    return ((UINT_PTR)ptr >> 4) * 0x9e3779b1 >> 16 & (PROFILE_HASH_SIZE - 1);
+}
+
+/* exponentially distributed intervals, matching the unsampling done by pprof */
+static LONG_PTR profile_next_interval(void)
+{
+    double u = (RtlRandom( &profile_seed ) + 1.0) / 2147483648.0;
+    return -log( u ) * heap_profile_rate + 1;
+}
+
+static struct profile_bucket *profile_get_bucket( void **frames, USHORT count, ULONG hash, USHORT size_bin )
+{
+    struct profile_bucket *bucket;
+    UINT i, index = hash + size_bin * 0x9e3779b1;
+
+    for (i = 0; i < PROFILE_MAX_PROBES; i++)
+    {
+        bucket = profile_buckets + ((index + i) & (PROFILE_BUCKET_COUNT - 1));
+        if (!bucket->frame_count)
+        {
+            bucket->hash = hash;
+            bucket->size_bin = size_bin;
+            bucket->frame_count = count;
+            memcpy( bucket->frames, frames, count * sizeof(*frames) );
+            return bucket;
+        }
+        if (bucket->hash == hash && bucket->size_bin == size_bin && bucket->frame_count == count &&
+            !memcmp( bucket->frames, frames, count * sizeof(*frames) ))
+            return bucket;
+    }
+
+    return NULL;
+}
+
+static struct profile_sample *profile_alloc_sample(void)
+{
+    struct profile_sample *sample;
+
+    if ((sample = profile_free_samples)) profile_free_samples = sample->next;
+    else if (profile_sample_used < PROFILE_SAMPLE_COUNT) sample = profile_samples + profile_sample_used++;
+    return sample;
+}
+
+static void DECLSPEC_NOINLINE heap_profile_alloc( struct heap *heap, void *ptr, SIZE_T size )
+{
+    LONG_PTR *remaining = (LONG_PTR *)&NtCurrentTeb()->ReservedForCodeCoverage;  /* sampling countdown */
+    USHORT count, size_bin = RtlFindMostSignificantBit( size ) + 1;
+    void *frames[PROFILE_MAX_FRAMES];
+    struct profile_bucket *bucket;
+    struct profile_sample *sample;
+    ULONG hash;
+    UINT index;
+
+    if ((*remaining -= size) > 0) return;
+    *remaining = profile_next_interval();
+
+    /* skip our own frame and RtlAllocateHeap */
+    if (!(count = RtlCaptureStackBackTrace( 2, PROFILE_MAX_FRAMES, frames, &hash ))) return;
+
+    RtlEnterCriticalSection( &profile_cs );
+    if (!(sample = profile_alloc_sample())) profile_dropped++;
+    else if (!(bucket = profile_get_bucket( frames, count, hash, size_bin )))
+    {
+        sample->next = profile_free_samples;
+        profile_free_samples = sample;
+        profile_dropped++;
+    }
+    else
+    {
+        bucket->alloc_count++;
+        bucket->alloc_size += size;
+
+        sample->bucket = bucket;
+        sample->heap = heap;
+        sample->ptr = ptr;
+        sample->size = size;
+
+        index = profile_hash_index( ptr );
+        sample->next = profile_hash[index];
+        profile_hash[index] = sample;
+    }
+    RtlLeaveCriticalSection( &profile_cs );
+}
+
+static void profile_release_sample( struct profile_sample **entry )
+{
+    struct profile_sample *sample = *entry;
+
+    sample->bucket->free_count++;
+    sample->bucket->free_size += sample->size;
+
+    *entry = sample->next;
+    sample->next = profile_free_samples;
+    profile_free_samples = sample;
+}
+
+static void heap_profile_free( void *ptr )
+{
+    UINT index = profile_hash_index( ptr );
+    struct profile_sample **entry;
+
+    /* sampled blocks are inserted before they are returned, so an empty chain can be trusted */
+    if (!*(struct profile_sample *volatile *)&profile_hash[index]) return;
+
+    RtlEnterCriticalSection( &profile_cs );
+    for (entry = &profile_hash[index]; *entry; entry = &(*entry)->next)
+    {
+        if ((*entry)->ptr != ptr) continue;
+        profile_release_sample( entry );
+        break;
+    }
+    RtlLeaveCriticalSection( &profile_cs );
+}
+
+/* account the remaining samples of a destroyed heap as freed */
+static void heap_profile_drop( struct heap *heap )
+{
+    struct profile_sample **entry;
+    UINT i;
+
+    RtlEnterCriticalSection( &profile_cs );
+    for (i = 0; i < PROFILE_HASH_SIZE; i++)
+    {
+        entry = &profile_hash[i];
+        while (*entry)
+        {
+            if ((*entry)->heap == heap) profile_release_sample( entry );
+            else entry = &(*entry)->next;
+        }
+    }
+    RtlLeaveCriticalSection( &profile_cs );
+}
+
+static void profile_flush( struct profile_output *out )
+{
+    IO_STATUS_BLOCK io;
+
+    if (out->len) NtWriteFile( out->file, NULL, NULL, NULL, &io, out->buffer, out->len, NULL, NULL );
+    out->len = 0;
+}
+
+static void profile_write( struct profile_output *out, const char *data, ULONG len )
+{
+    ULONG count;
+
+    while (len)
+    {
+        if (out->len == sizeof(out->buffer)) profile_flush( out );
+        count = min( len, sizeof(out->buffer) - out->len );
+        memcpy( out->buffer + out->len, data, count );
+        out->len += count;
+        data += count;
+        len -= count;
+    }
+}
+
+static void WINAPIV profile_printf( struct profile_output *out, const char *format, ... )
+{
+    char buffer[256];
+    va_list args;
+    int len;
+
+    va_start( args, format );
+    len = _vsnprintf( buffer, sizeof(buffer), format, args );
+    va_end( args );
+
+    if (len < 0 || len > sizeof(buffer)) len = sizeof(buffer);
+    profile_write( out, buffer, len );
+}
+
+/* write the samples in the legacy gperftools heap profile format, readable by pprof */
+void heap_profile_dump(void)
+{
+    ULONGLONG inuse_count = 0, inuse_size = 0, alloc_count = 0, alloc_size = 0;
+    WCHAR name[MAX_PATH + 32];
+    char path[MAX_PATH * 3];
+    LDR_DATA_TABLE_ENTRY *mod;
+    struct profile_bucket *bucket;
+    struct profile_output *out;
+    UNICODE_STRING nt_name;
+    OBJECT_ATTRIBUTES attr;
+    IO_STATUS_BLOCK io;
+    LIST_ENTRY *mark, *entry;
+    SIZE_T size = sizeof(*out);
+    ULONG_PTR magic;
+    NTSTATUS status;
+    DWORD len;
+    UINT i;
+
+    if (!heap_profile_rate) return;
+
+    swprintf( name, ARRAY_SIZE(name), L"%s.%04lx.%lu.heap", profile_prefix,
+              HandleToULong( NtCurrentTeb()->ClientId.UniqueProcess ), InterlockedIncrement( &profile_dump_seq ) );
+    if ((status = RtlDosPathNameToNtPathName_U_WithStatus( name, &nt_name, NULL, NULL )))
+    {
+        ERR( "Invalid heap profile path %s, status %#lx.\n", debugstr_w(name), status );
+        return;
+    }
+    InitializeObjectAttributes( &attr, &nt_name, OBJ_CASE_INSENSITIVE, 0, NULL );
+
+    out = NULL;
+    if ((status = NtAllocateVirtualMemory( NtCurrentProcess(), (void **)&out, 0, &size, MEM_COMMIT, PAGE_READWRITE )))
+    {
+        RtlFreeUnicodeString( &nt_name );
+        return;
+    }
+    status = NtCreateFile( &out->file, GENERIC_WRITE | SYNCHRONIZE, &attr, &io, NULL, FILE_ATTRIBUTE_NORMAL, 0,
+                           FILE_OVERWRITE_IF, FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE, NULL, 0 );
+    RtlFreeUnicodeString( &nt_name );
+    if (status)
+    {
+        ERR( "Failed to create heap profile %s, status %#lx.\n", debugstr_w(name), status );
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), (void **)&out, &size, MEM_RELEASE );
+        return;
+    }
+
+    /* nothing below may allocate from the heap while holding the profiler lock */
+    RtlEnterCriticalSection( &profile_cs );
+
+    for (i = 0, bucket = profile_buckets; i < PROFILE_BUCKET_COUNT; i++, bucket++)
+    {
+        if (!bucket->frame_count) continue;
+        inuse_count += bucket->alloc_count - bucket->free_count;
+        inuse_size += bucket->alloc_size - bucket->free_size;
+        alloc_count += bucket->alloc_count;
+        alloc_size += bucket->alloc_size;
+    }
+
+    profile_printf( out, "heap profile: %I64u: %I64u [%I64u: %I64u] @ heap_v2/%Iu\n",
+                    inuse_count, inuse_size, alloc_count, alloc_size, heap_profile_rate );
+
+    for (i = 0, bucket = profile_buckets; i < PROFILE_BUCKET_COUNT; i++, bucket++)
+    {
+        UINT j;
+
+        if (!bucket->frame_count) continue;
+        profile_printf( out, "%I64u: %I64u [%I64u: %I64u] @", bucket->alloc_count - bucket->free_count,
+                        bucket->alloc_size - bucket->free_size, bucket->alloc_count, bucket->alloc_size );
+        for (j = 0; j < bucket->frame_count; j++) profile_printf( out, " 0x%Ix", (ULONG_PTR)bucket->frames[j] );
+        profile_write( out, "\n", 1 );
+    }
+
+    if (profile_dropped) WARN( "%lu samples dropped, profiler tables are full.\n", profile_dropped );
+    RtlLeaveCriticalSection( &profile_cs );
+
+    profile_printf( out, "\nMAPPED_LIBRARIES:\n" );
+
+    LdrLockLoaderLock( 0, NULL, &magic );
+    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
+    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    {
+        mod = CONTAINING_RECORD( entry, LDR_DATA_TABLE_ENTRY, InLoadOrderLinks );
+        profile_printf( out, "%08Ix-%08Ix r-xp 00000000 00:00 0 ", (ULONG_PTR)mod->DllBase,
+                        (ULONG_PTR)mod->DllBase + mod->SizeOfImage );
+        if (RtlUnicodeToUTF8N( path, sizeof(path), &len, mod->FullDllName.Buffer, mod->FullDllName.Length )) len = 0;
+        profile_write( out, path, len );
+        profile_write( out, "\n", 1 );
+    }
+    LdrUnlockLoaderLock( 0, magic );
+
+    profile_flush( out );
+    NtClose( out->file );
+
+    TRACE( "wrote heap profile %s\n", debugstr_w(name) );
+    size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), (void **)&out, &size, MEM_RELEASE );
 }
 
 /***********************************************************************
@@ -2083,6 +2746,7 @@ void *WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE handle, ULONG flags, SIZE
     }
 
     if (!status) valgrind_notify_alloc( ptr, size, flags & HEAP_ZERO_MEMORY );
+    if (!status && heap_profile_rate) heap_profile_alloc( heap, ptr, size );
 
     TRACE( "handle %p, flags %#lx, size %#Ix, return %p, status %#lx.\n", handle, flags, size, ptr, status );
     heap_set_status( heap, flags, status );
@@ -2103,6 +2767,7 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE handle, ULONG flags, void *
     if (!ptr) return TRUE;
 
     valgrind_notify_free( ptr );
+    if (heap_profile_rate) heap_profile_free( ptr );
 
     if (!(heap = unsafe_heap_from_handle( handle, flags, &heap_flags )))
         status = STATUS_INVALID_PARAMETER;
@@ -2581,7 +3246,7 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS i
 
     TRACE( "handle %p, info_class %u, info %p, size_in %Iu, size_out %p.\n", handle, info_class, info, size_in, size_out );
 
-    switch (info_class)
+    switch ((ULONG)info_class)
     {
     case HeapCompatibilityInformation:
         if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_ACCESS_VIOLATION;
@@ -2590,6 +3255,13 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS i
         *(ULONG *)info = ReadNoFence( &heap->compat_info );
         return STATUS_SUCCESS;
 
+    case HeapMagazineInformation:
+        if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_ACCESS_VIOLATION;
+        if (size_out) *size_out = sizeof(struct heap_magazine_information);
+        if (size_in < sizeof(struct heap_magazine_information)) return STATUS_BUFFER_TOO_SMALL;
+        heap_get_magazine_information( heap, info );
+        return STATUS_SUCCESS;
+
     default:
         FIXME( "HEAP_INFORMATION_CLASS %u not implemented!\n", info_class );
         return STATUS_INVALID_INFO_CLASS;
@@ -2606,7 +3278,7 @@ NTSTATUS WINAPI RtlSetHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS inf
 
     TRACE( "handle %p, info_class %u, info %p, size %Iu.\n", handle, info_class, info, size );
 
-    switch (info_class)
+    switch ((ULONG)info_class)
     {
     case HeapCompatibilityInformation:
     {
@@ -2617,6 +3289,15 @@ NTSTATUS WINAPI RtlSetHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS inf
         if (heap->flags & HEAP_NO_SERIALIZE) return STATUS_INVALID_PARAMETER;
 
         compat_info = *(ULONG *)info;
+        if (compat_info == HEAP_SEGMENT)
+        {
+            LONG old_info = ReadNoFence( &heap->compat_info );
+            /* segment bins need the LFH, upgrading from it is allowed */
+            if (!heap->bins || old_info == HEAP_SEGMENT) return STATUS_UNSUCCESSFUL;
+            if (!delay_heap_free && InterlockedCompareExchange( &heap->compat_info, compat_info, old_info ) != old_info)
+                return STATUS_UNSUCCESSFUL;
+            return STATUS_SUCCESS;
+        }
         if (compat_info != HEAP_STD && compat_info != HEAP_LFH)
         {
             FIXME( "HeapCompatibilityInformation %lu not implemented!\n", compat_info );
@@ -2627,6 +3308,11 @@ NTSTATUS WINAPI RtlSetHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS inf
         return STATUS_SUCCESS;
     }
 
+    case HeapProfileDump:
+        if (!heap_profile_rate) return STATUS_NOT_SUPPORTED;
+        heap_profile_dump();
+        return STATUS_SUCCESS;
+
     default:
         FIXME( "HEAP_INFORMATION_CLASS %u not implemented!\n", info_class );
         return STATUS_SUCCESS;
@@ -35,6 +35,7 @@
 #include "wine/debug.h"
 #include "wine/list.h"
 #include "wine/rbtree.h"
+#include "wine/server.h"
 #include "ntdll_misc.h"
 #include "ddk/wdm.h"
 
@@ -136,6 +137,19 @@ struct file_id
 #define HASH_MAP_SIZE 32
 static LIST_ENTRY hash_table[HASH_MAP_SIZE];
 
+/* hash index of the export names of a module, built on the first lookup */
+struct export_hash
+{
+    UINT mask;
+    struct
+    {
+        UINT hash;   /* hash of the name */
+        UINT index;  /* index in the export name table + 1, 0 for a free entry */
+    } entries[1];
+};
+
+#define EXPORT_HASH_MIN_NAMES 32  /* smaller export tables are binary searched */
+
 /* internal representation of loaded modules */
 typedef struct _wine_modref
 {
@@ -143,6 +157,7 @@ typedef struct _wine_modref
     struct file_id        id;
     ULONG                 CheckSum;
     BOOL                  system;
+    struct export_hash   *export_hash;
 } WINE_MODREF;
 
 static UINT tls_module_count = 32;     /* number of modules with TLS directory */
@@ -204,6 +219,9 @@ static struct rb_tree known_dlls;
 
 static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, DWORD flags, WINE_MODREF** pwm, BOOL system );
 static NTSTATUS process_attach( LDR_DDAG_NODE *node, LPVOID lpReserved );
+static NTSTATUS prepend_system_dir( const WCHAR *name, ULONG name_length, WCHAR **fullname );
+static BOOL prefetch_imports_begin( WINE_MODREF *wm, LPCWSTR load_path );
+static void prefetch_imports_end(void);
 static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
                                     DWORD exp_size, DWORD ordinal, LPCWSTR load_path );
 static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
@@ -829,13 +847,14 @@ static NTSTATUS get_apiset_target( const API_SET_NAMESPACE *map, const API_SET_N
 
 
 /**********************************************************************
- *	    build_import_name
+ *	    build_host_import_name
+ *
+ * Build the name of an imported dll, resolving api sets for the given host module.
  */
-static NTSTATUS build_import_name( WCHAR buffer[256], const char *import, int len )
+static NTSTATUS build_host_import_name( const WCHAR *host, WCHAR buffer[256], const char *import, int len )
 {
     const API_SET_NAMESPACE *map = NtCurrentTeb()->Peb->ApiSetMap;
     const API_SET_NAMESPACE_ENTRY *entry;
-    const WCHAR *host = current_modref ? current_modref->ldr.BaseDllName.Buffer : NULL;
     UNICODE_STRING str;
 
     while (len && import[len-1] == ' ') len--;  /* remove trailing spaces */
@@ -855,6 +874,16 @@ static NTSTATUS build_import_name( WCHAR buffer[256], const char *import, int le
     return STATUS_SUCCESS;
 }
 
+/**********************************************************************
+ *	    build_import_name
+ */
+static NTSTATUS build_import_name( WCHAR buffer[256], const char *import, int len )
+{
+    const WCHAR *host = current_modref ? current_modref->ldr.BaseDllName.Buffer : NULL;
+
+    return build_host_import_name( host, buffer, import, len );
+}
+
 
 /**********************************************************************
  *	    append_dll_ext
@@ -1124,6 +1153,65 @@ static int find_name_in_exports( HMODULE module, const IMAGE_EXPORT_DIRECTORY *e
 }
 
 
+static inline UINT hash_export_name( const char *name )
+{
+    UINT hash = 2166136261u;
+
+    while (*name) hash = (hash ^ (BYTE)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		build_export_hash
+ *
+ * Build the hash index of the export names of a module.
+ * The loader_section must be locked while calling this function.
+ */
+static struct export_hash *build_export_hash( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    struct export_hash *table;
+    UINT i, pos, hash, size = 64;
+
+    while (size < exports->NumberOfNames * 2) size *= 2;
+    if (!(table = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, offsetof( struct export_hash, entries[size] ))))
+        return NULL;
+
+    table->mask = size - 1;
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        hash = hash_export_name( get_rva( module, names[i] ));
+        for (pos = hash & table->mask; table->entries[pos].index; pos = (pos + 1) & table->mask) ;
+        table->entries[pos].hash = hash;
+        table->entries[pos].index = i + 1;
+    }
+    return table;
+}
+
+
+/*************************************************************************
+ *		find_name_in_export_hash
+ *
+ * Helper for find_named_export.
+ */
+static int find_name_in_export_hash( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+                                     const struct export_hash *table, const char *name )
+{
+    const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    UINT pos, index, hash = hash_export_name( name );
+
+    for (pos = hash & table->mask; table->entries[pos].index; pos = (pos + 1) & table->mask)
+    {
+        if (table->entries[pos].hash != hash) continue;
+        index = table->entries[pos].index - 1;
+        if (!strcmp( get_rva( module, names[index] ), name )) return ordinals[index];
+    }
+    return -1;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -1135,17 +1223,27 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    WINE_MODREF *wm;
     int ordinal;
 
     /* first check the hint */
     if (hint >= 0 && hint < exports->NumberOfNames)
     {
         char *ename = get_rva( module, names[hint] );
-        if (!strcmp( ename, name ))
+        if (ename[0] == name[0] && !strcmp( ename, name ))
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
-    /* then do a binary search */
+    /* then use the hash index of the module, or do a binary search */
+    if (exports->NumberOfNames >= EXPORT_HASH_MIN_NAMES && (wm = get_modref( module )))
+    {
+        if (!wm->export_hash) wm->export_hash = build_export_hash( module, exports );
+        if (wm->export_hash)
+        {
+            if ((ordinal = find_name_in_export_hash( module, exports, wm->export_hash, name )) == -1) return NULL;
+            return find_ordinal_export( module, exports, exp_size, ordinal, load_path );
+        }
+    }
     if ((ordinal = find_name_in_exports( module, exports, name )) == -1) return NULL;
     return find_ordinal_export( module, exports, exp_size, ordinal, load_path );
 
@@ -1578,6 +1676,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     DWORD size;
     NTSTATUS status;
     ULONG_PTR cookie;
+    BOOL prefetch;
 
     if (!(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS)) return STATUS_SUCCESS;  /* already done */
     wm->ldr.Flags &= ~LDR_DONT_RESOLVE_REFS;
@@ -1601,6 +1700,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
      */
     prev = current_modref;
     current_modref = wm;
+    prefetch = prefetch_imports_begin( wm, load_path );
     status = STATUS_SUCCESS;
     for (i = 0; i < nb_imports; i++)
     {
@@ -1610,6 +1710,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
         else if (imp && imp->ldr.DdagNode != node_ntdll && imp->ldr.DdagNode != node_kernel32)
             add_module_dependency_after( wm->ldr.DdagNode, imp->ldr.DdagNode, dep_after );
     }
+    if (prefetch) prefetch_imports_end();
     current_modref = prev;
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
     return status;
@@ -2813,6 +2914,512 @@ static NTSTATUS get_dll_load_path_search_flags( LPCWSTR module, DWORD flags, WCH
 }
 
 
+/* Parallel import loading, enabled with WINEPARALLELIMPORTS. While the imports of a
+ * module are being resolved, loader worker threads walk its import graph ahead of the
+ * loading thread and open, create the section and map the view of each dll they find.
+ * The loading thread picks up the mapped views when it gets to the corresponding dlls,
+ * so the file accesses and relocations overlap, while modules are still built and
+ * initialized in the usual order under the loader lock.
+ *
+ * The loading thread never waits for a worker, since a worker may be blocked on the
+ * heap or PEB lock held by a thread that is itself waiting for the loader lock; a dll
+ * that is still being mapped is simply loaded again. The server defers the load dll
+ * debug event of the views mapped by a worker until the loading thread claims them,
+ * so debuggers see the events in loading order and not at all for unused views. */
+
+#define TEB_SKIP_THREAD_ATTACH  0x0008
+#define TEB_LOADER_WORKER       0x2000
+#define TEB_SKIP_LOADER_INIT    0x4000
+
+#define MAX_PREFETCH_THREADS    16
+#define PREFETCH_IDLE_TIMEOUT   1000  /* ms before an idle worker exits */
+
+enum prefetch_state
+{
+    PREFETCH_PENDING,   /* waiting for a worker */
+    PREFETCH_RUNNING,   /* being mapped by a worker */
+    PREFETCH_DONE,      /* mapped, waiting for the loading thread */
+    PREFETCH_TAKEN,     /* section handed over to the loading thread */
+    PREFETCH_SKIPPED    /* already loaded, not found, or left to the loading thread */
+};
+
+struct prefetch_dll
+{
+    struct list               entry;
+    enum prefetch_state       state;
+    BOOL                      abandoned;   /* import resolution ended while running, the worker frees it */
+    WCHAR                     name[256];   /* base name of the dll */
+    UNICODE_STRING            nt_name;     /* NT path of the file that was found */
+    HANDLE                    mapping;     /* image section */
+    SECTION_IMAGE_INFORMATION image_info;
+    struct file_id            id;
+    BOOL                      has_id;
+    void                     *module;      /* view of the section, until claimed */
+    NTSTATUS                  map_status;  /* status of the view mapping */
+};
+
+static unsigned int prefetch_threads_max;  /* number of worker threads, 0 if disabled */
+static unsigned int prefetch_depth;        /* nesting of prefetching fixup_imports calls */
+static WCHAR *prefetch_load_path;          /* load path of the outermost fixup_imports call */
+static struct list prefetch_dlls = LIST_INIT( prefetch_dlls );
+static unsigned int prefetch_thread_count; /* running workers, including the ones being started */
+static unsigned int prefetch_pending;      /* number of dlls in the PREFETCH_PENDING state */
+static LONG prefetch_seq;                  /* bumped when dlls are queued */
+
+DECLARE_CRITICAL_SECTION( prefetch_section );
+
+/* prefetch_section must be held */
+static struct prefetch_dll *find_prefetch_dll( const WCHAR *name )
+{
+    struct prefetch_dll *dll;
+
+    LIST_FOR_EACH_ENTRY( dll, &prefetch_dlls, struct prefetch_dll, entry )
+        if (!wcsicmp( dll->name, name )) return dll;
+    return NULL;
+}
+
+/* prefetch_section must be held */
+static void add_prefetch_dll( const WCHAR *name, enum prefetch_state state )
+{
+    struct prefetch_dll *dll;
+
+    if (wcslen( name ) >= ARRAY_SIZE(dll->name) || find_prefetch_dll( name )) return;
+    if (!(dll = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*dll) ))) return;
+    wcscpy( dll->name, name );
+    dll->state = state;
+    list_add_tail( &prefetch_dlls, &dll->entry );
+    if (state == PREFETCH_PENDING)
+    {
+        prefetch_pending++;
+        InterlockedIncrement( &prefetch_seq );
+        RtlWakeAddressAll( &prefetch_seq );
+    }
+}
+
+/* prefetch_section must be held */
+static void free_prefetch_dll( struct prefetch_dll *dll )
+{
+    if (dll->module) NtUnmapViewOfSection( NtCurrentProcess(), dll->module );
+    if (dll->mapping && dll->state != PREFETCH_TAKEN) NtClose( dll->mapping );
+    RtlFreeUnicodeString( &dll->nt_name );
+    RtlFreeHeap( GetProcessHeap(), 0, dll );
+}
+
+/* prefetch_section must be held */
+static void queue_prefetch_imports( HMODULE module, const WCHAR *host )
+{
+    const IMAGE_IMPORT_DESCRIPTOR *imports;
+    WCHAR buffer[256];
+    const char *name;
+    DWORD size;
+
+    if (!(imports = RtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &size )))
+        return;
+
+    for (; imports->Name && imports->FirstThunk; imports++)
+    {
+        name = get_rva( module, imports->Name );
+        if (build_host_import_name( host, buffer, name, strlen( name ) )) continue;
+        if (!contains_path( buffer )) add_prefetch_dll( buffer, PREFETCH_PENDING );
+    }
+}
+
+
+/***********************************************************************
+ *	has_missing_imports
+ *
+ * Check if some of the dlls imported by a module are not loaded yet.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL has_missing_imports( WINE_MODREF *wm )
+{
+    const IMAGE_IMPORT_DESCRIPTOR *imports;
+    HMODULE module = wm->ldr.DllBase;
+    WCHAR buffer[256];
+    const char *name;
+    DWORD size;
+
+    if (!(imports = RtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &size )))
+        return FALSE;
+
+    for (; imports->Name && imports->FirstThunk; imports++)
+    {
+        name = get_rva( module, imports->Name );
+        if (build_host_import_name( wm->ldr.BaseDllName.Buffer, buffer, name, strlen( name ) )) continue;
+        if (!contains_path( buffer ) && !find_basename_module( buffer )) return TRUE;
+    }
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *	prefetch_open_file
+ *
+ * Open a dll file on a loader worker thread.
+ */
+static NTSTATUS prefetch_open_file( struct prefetch_dll *dll, const WCHAR *path, HANDLE *handle )
+{
+    OBJECT_ATTRIBUTES attr;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+
+    if ((status = RtlDosPathNameToNtPathName_U_WithStatus( path, &dll->nt_name, NULL, NULL ))) return status;
+
+    InitializeObjectAttributes( &attr, &dll->nt_name, OBJ_CASE_INSENSITIVE, 0, NULL );
+    if ((status = NtOpenFile( handle, GENERIC_READ | SYNCHRONIZE, &attr, &io,
+                              FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE )))
+        RtlFreeUnicodeString( &dll->nt_name );
+    return status;
+}
+
+
+/***********************************************************************
+ *	prefetch_map_dll
+ *
+ * Find, open and map a dll on a loader worker thread, the same way
+ * find_dll_file and load_native_dll would. Api set and activation context
+ * redirections are not taken into account; if the loading thread ends up
+ * with a different file the mapping is simply not used. Since the thread
+ * is a loader worker, the server doesn't send the load dll debug event
+ * for the view until it is claimed.
+ */
+static BOOL prefetch_map_dll( struct prefetch_dll *dll, const WCHAR *paths )
+{
+    WCHAR *fullname = NULL, *name;
+    FILE_OBJECTID_BUFFER fid;
+    IO_STATUS_BLOCK io;
+    LARGE_INTEGER size;
+    NTSTATUS status = STATUS_DLL_NOT_FOUND;
+    HANDLE handle;
+    SIZE_T len;
+
+    if (rb_get( &known_dlls, dll->name ) &&
+        !prepend_system_dir( dll->name, wcslen( dll->name ), &fullname ) &&
+        RtlDetermineDosPathNameType_U( fullname ) != RELATIVE_PATH)
+    {
+        status = prefetch_open_file( dll, fullname, &handle );
+    }
+    else if ((name = RtlAllocateHeap( GetProcessHeap(), 0,
+                                      (wcslen( paths ) + wcslen( dll->name ) + 2) * sizeof(WCHAR) )))
+    {
+        while (*paths)
+        {
+            const WCHAR *ptr = paths;
+
+            while (*ptr && *ptr != ';') ptr++;
+            len = ptr - paths;
+            if (*ptr == ';') ptr++;
+            memcpy( name, paths, len * sizeof(WCHAR) );
+            if (len && name[len - 1] != '\\') name[len++] = '\\';
+            wcscpy( name + len, dll->name );
+            status = prefetch_open_file( dll, name, &handle );
+            if (status != STATUS_OBJECT_NAME_NOT_FOUND && status != STATUS_OBJECT_PATH_NOT_FOUND) break;
+            paths = ptr;
+        }
+        RtlFreeHeap( GetProcessHeap(), 0, name );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, fullname );
+    if (status) return FALSE;
+
+    if (!NtFsControlFile( handle, 0, NULL, NULL, &io, FSCTL_GET_OBJECT_ID, NULL, 0, &fid, sizeof(fid) ))
+    {
+        memcpy( &dll->id, fid.ObjectId, sizeof(dll->id) );
+        dll->has_id = TRUE;
+    }
+
+    size.QuadPart = 0;
+    status = NtCreateSection( &dll->mapping, STANDARD_RIGHTS_REQUIRED | SECTION_QUERY |
+                              SECTION_MAP_READ | SECTION_MAP_EXECUTE,
+                              NULL, &size, PAGE_EXECUTE_READ, SEC_IMAGE, handle );
+    if (!status)
+    {
+        NtQuerySection( dll->mapping, SectionImageInformation, &dll->image_info, sizeof(dll->image_info), NULL );
+        if (!is_valid_binary( handle, &dll->image_info )) status = STATUS_NOT_SUPPORTED;
+    }
+    NtClose( handle );
+
+    /* without a file id the view could not be matched to the section later on */
+    if (!status && dll->has_id)
+    {
+        len = 0;
+        status = dll->map_status = NtMapViewOfSection( dll->mapping, NtCurrentProcess(), &dll->module, 0, 0,
+                                                       NULL, &len, ViewShare, 0, PAGE_EXECUTE_READ );
+    }
+    if (!NT_SUCCESS(status))
+    {
+        if (dll->mapping) NtClose( dll->mapping );
+        dll->mapping = NULL;
+        dll->module = NULL;
+        RtlFreeUnicodeString( &dll->nt_name );
+        return FALSE;
+    }
+
+    TRACE_(loaddll)( "prefetched %s at %p\n", debugstr_us(&dll->nt_name), dll->module );
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *	prefetch_thread
+ *
+ * Loader worker thread. It skips the loader initialization and exits
+ * without detaching from the dlls, so it never takes the loader lock.
+ * It exits when it has been idle for PREFETCH_IDLE_TIMEOUT.
+ */
+static void CALLBACK prefetch_thread( void *arg )
+{
+    struct prefetch_dll *dll;
+    LARGE_INTEGER timeout;
+    WCHAR *paths;
+    LONG seq;
+    BOOL ret;
+
+    timeout.QuadPart = (ULONGLONG)PREFETCH_IDLE_TIMEOUT * -10000;
+    for (;;)
+    {
+        RtlEnterCriticalSection( &prefetch_section );
+        seq = prefetch_seq;
+        dll = NULL;
+        paths = NULL;
+        if (prefetch_pending)
+        {
+            const WCHAR *load_path = prefetch_load_path ? prefetch_load_path : default_load_path;
+
+            LIST_FOR_EACH_ENTRY( dll, &prefetch_dlls, struct prefetch_dll, entry )
+                if (dll->state == PREFETCH_PENDING) break;
+            if ((paths = RtlAllocateHeap( GetProcessHeap(), 0, (wcslen( load_path ) + 1) * sizeof(WCHAR) )))
+            {
+                wcscpy( paths, load_path );
+                dll->state = PREFETCH_RUNNING;
+                prefetch_pending--;
+            }
+            else dll = NULL;
+        }
+        RtlLeaveCriticalSection( &prefetch_section );
+
+        if (!dll)
+        {
+            if (RtlWaitOnAddress( &prefetch_seq, &seq, sizeof(seq), &timeout ) != STATUS_TIMEOUT) continue;
+
+            RtlEnterCriticalSection( &prefetch_section );
+            if (prefetch_pending || prefetch_seq != seq)
+            {
+                RtlLeaveCriticalSection( &prefetch_section );
+                continue;
+            }
+            prefetch_thread_count--;
+            RtlLeaveCriticalSection( &prefetch_section );
+            break;
+        }
+
+        ret = prefetch_map_dll( dll, paths );
+        RtlFreeHeap( GetProcessHeap(), 0, paths );
+
+        RtlEnterCriticalSection( &prefetch_section );
+        if (dll->abandoned) free_prefetch_dll( dll );
+        else if (ret)
+        {
+            dll->state = PREFETCH_DONE;
+            queue_prefetch_imports( dll->module, dll->name );
+        }
+        else dll->state = PREFETCH_SKIPPED;
+        RtlLeaveCriticalSection( &prefetch_section );
+    }
+
+    heap_thread_detach();
+    for (;;) NtTerminateThread( GetCurrentThread(), 0 );
+}
+
+
+/***********************************************************************
+ *	start_prefetch_threads
+ *
+ * Start loader worker threads for the pending dlls, up to prefetch_threads_max.
+ */
+static void start_prefetch_threads(void)
+{
+    THREAD_BASIC_INFORMATION info;
+    unsigned int count;
+    HANDLE thread;
+    TEB *teb;
+
+    RtlEnterCriticalSection( &prefetch_section );
+    count = min( prefetch_pending, prefetch_threads_max - prefetch_thread_count );
+    prefetch_thread_count += count;
+    RtlLeaveCriticalSection( &prefetch_section );
+
+    while (count)
+    {
+        if (RtlCreateUserThread( GetCurrentProcess(), NULL, TRUE, 0, 0, 0,
+                                 prefetch_thread, NULL, &thread, NULL )) break;
+        if (!NtQueryInformationThread( thread, ThreadBasicInformation, &info, sizeof(info), NULL ))
+        {
+            teb = info.TebBaseAddress;
+            teb->SameTebFlags |= TEB_SKIP_THREAD_ATTACH | TEB_LOADER_WORKER | TEB_SKIP_LOADER_INIT;
+            NtResumeThread( thread, NULL );
+            count--;
+        }
+        else NtTerminateThread( thread, 0 );
+        NtClose( thread );
+        TRACE_(loaddll)( "started loader worker thread\n" );
+    }
+
+    if (!count) return;
+    RtlEnterCriticalSection( &prefetch_section );
+    prefetch_thread_count -= count;
+    RtlLeaveCriticalSection( &prefetch_section );
+}
+
+
+/***********************************************************************
+ *	prefetch_imports_begin
+ *
+ * Queue the imports of a module for the loader worker threads, starting
+ * them if needed. Nothing is done if the imports of the outermost module
+ * are already loaded. The loader_section must be locked while calling
+ * this function.
+ */
+static BOOL prefetch_imports_begin( WINE_MODREF *wm, LPCWSTR load_path )
+{
+    LDR_DATA_TABLE_ENTRY *mod;
+    LIST_ENTRY *mark, *entry;
+
+    if (!prefetch_threads_max) return FALSE;
+
+    if (!prefetch_depth)
+    {
+        /* new threads can't be started before kernel32 is loaded */
+        if (!pBaseThreadInitThunk) return FALSE;
+        if (!has_missing_imports( wm )) return FALSE;
+
+        if (load_path && (prefetch_load_path = RtlAllocateHeap( GetProcessHeap(), 0,
+                                                                (wcslen( load_path ) + 1) * sizeof(WCHAR) )))
+            wcscpy( prefetch_load_path, load_path );
+        else if (load_path) return FALSE;
+
+        RtlEnterCriticalSection( &prefetch_section );
+        mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
+        for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+        {
+            mod = CONTAINING_RECORD( entry, LDR_DATA_TABLE_ENTRY, InLoadOrderLinks );
+            add_prefetch_dll( mod->BaseDllName.Buffer, PREFETCH_SKIPPED );
+        }
+        RtlLeaveCriticalSection( &prefetch_section );
+    }
+    prefetch_depth++;
+
+    RtlEnterCriticalSection( &prefetch_section );
+    queue_prefetch_imports( wm->ldr.DllBase, wm->ldr.BaseDllName.Buffer );
+    RtlLeaveCriticalSection( &prefetch_section );
+    start_prefetch_threads();
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *	prefetch_imports_end
+ *
+ * Release the mappings that were not used when the outermost import
+ * resolution is done. The dlls still being mapped are left for the workers
+ * to release, the workers themselves stay around until they are idle.
+ * The loader_section must be locked while calling this function.
+ */
+static void prefetch_imports_end(void)
+{
+    struct prefetch_dll *dll, *next;
+
+    if (--prefetch_depth) return;
+
+    RtlEnterCriticalSection( &prefetch_section );
+    LIST_FOR_EACH_ENTRY_SAFE( dll, next, &prefetch_dlls, struct prefetch_dll, entry )
+    {
+        list_remove( &dll->entry );
+        if (dll->state == PREFETCH_RUNNING) dll->abandoned = TRUE;
+        else free_prefetch_dll( dll );
+    }
+    prefetch_pending = 0;
+    RtlFreeHeap( GetProcessHeap(), 0, prefetch_load_path );
+    prefetch_load_path = NULL;
+    RtlLeaveCriticalSection( &prefetch_section );
+}
+
+
+/***********************************************************************
+ *	get_prefetched_dll
+ *
+ * Take over the section prefetched for a dll file, if a worker thread
+ * has finished mapping it. The loader_section must be locked while
+ * calling this function.
+ */
+static struct prefetch_dll *get_prefetched_dll( const UNICODE_STRING *nt_name )
+{
+    const WCHAR *name = nt_name->Buffer + nt_name->Length / sizeof(WCHAR);
+    struct prefetch_dll *dll;
+    WCHAR buffer[256];
+
+    while (name > nt_name->Buffer && name[-1] != '\\') name--;
+    if (nt_name->Buffer + nt_name->Length / sizeof(WCHAR) - name >= ARRAY_SIZE(buffer)) return NULL;
+    memcpy( buffer, name, (char *)(nt_name->Buffer + nt_name->Length / sizeof(WCHAR)) - (char *)name );
+    buffer[nt_name->Buffer + nt_name->Length / sizeof(WCHAR) - name] = 0;
+
+    RtlEnterCriticalSection( &prefetch_section );
+    if ((dll = find_prefetch_dll( buffer )))
+    {
+        /* don't wait for the workers to get to it, or to finish it */
+        if (dll->state == PREFETCH_PENDING)
+        {
+            dll->state = PREFETCH_SKIPPED;
+            prefetch_pending--;
+        }
+        if (dll->state != PREFETCH_DONE || !RtlEqualUnicodeString( &dll->nt_name, nt_name, TRUE )) dll = NULL;
+        else dll->state = PREFETCH_TAKEN;
+    }
+    RtlLeaveCriticalSection( &prefetch_section );
+    return dll;
+}
+
+
+/***********************************************************************
+ *	get_prefetched_view
+ *
+ * Claim the view mapped for a section returned by get_prefetched_dll,
+ * and have the server send its load dll debug event. The section handle
+ * may have been closed and its value reused since, so the file identity
+ * has to match as well.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL get_prefetched_view( HANDLE mapping, const struct file_id *id, void **module, NTSTATUS *status )
+{
+    struct prefetch_dll *dll;
+    BOOL ret = FALSE;
+
+    RtlEnterCriticalSection( &prefetch_section );
+    LIST_FOR_EACH_ENTRY( dll, &prefetch_dlls, struct prefetch_dll, entry )
+    {
+        if (dll->state != PREFETCH_TAKEN || !dll->module || dll->mapping != mapping) continue;
+        if (!dll->has_id || memcmp( &dll->id, id, sizeof(*id) )) continue;
+        *module = dll->module;
+        *status = dll->map_status;
+        dll->module = NULL;
+        ret = TRUE;
+        break;
+    }
+    RtlLeaveCriticalSection( &prefetch_section );
+
+    if (ret)
+    {
+        SERVER_START_REQ( claim_image_view )
+        {
+            req->base = wine_server_client_ptr( *module );
+            wine_server_call( req );
+        }
+        SERVER_END_REQ;
+    }
+    return ret;
+}
+
+
 /***********************************************************************
  *	open_dll_file
  *
@@ -2826,11 +3433,29 @@ static NTSTATUS open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm, HANDL
     IO_STATUS_BLOCK io;
     LARGE_INTEGER size;
     FILE_OBJECTID_BUFFER fid;
+    struct prefetch_dll *dll;
     NTSTATUS status;
     HANDLE handle;
 
     if ((*pwm = find_fullname_module( nt_name ))) return STATUS_SUCCESS;
 
+    if (prefetch_depth && (dll = get_prefetched_dll( nt_name )))
+    {
+        *mapping = dll->mapping;
+        *image_info = dll->image_info;
+        *id = dll->id;
+        if (dll->has_id && (*pwm = find_fileid_module( id )))
+        {
+            TRACE( "%s is the same file as existing module %p %s\n", debugstr_w( nt_name->Buffer ),
+                   (*pwm)->ldr.DllBase, debugstr_w( (*pwm)->ldr.FullDllName.Buffer ));
+            NtUnmapViewOfSection( NtCurrentProcess(), dll->module );
+            dll->module = NULL;
+            NtClose( *mapping );
+            *mapping = NULL;
+        }
+        return STATUS_SUCCESS;
+    }
+
     attr.Length = sizeof(attr);
     attr.RootDirectory = 0;
     attr.Attributes = OBJ_CASE_INSENSITIVE;
@@ -2921,8 +3546,11 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, const UNICODE_STRING *nt_nam
 {
     void *module = NULL;
     SIZE_T len = 0;
-    NTSTATUS status = NtMapViewOfSection( mapping, NtCurrentProcess(), &module, 0, 0, NULL, &len,
-                                          ViewShare, 0, PAGE_EXECUTE_READ );
+    NTSTATUS status;
+
+    if (!prefetch_depth || !get_prefetched_view( mapping, id, &module, &status ))
+        status = NtMapViewOfSection( mapping, NtCurrentProcess(), &module, 0, 0, NULL, &len,
+                                     ViewShare, 0, PAGE_EXECUTE_READ );
 
     if (!NT_SUCCESS(status)) return status;
 
@@ -4125,6 +4753,7 @@ void WINAPI LdrShutdownProcess(void)
         RtlProcessFlsData( NtCurrentTeb()->FlsSlots, 1 );
 
     process_detach();
+    heap_profile_dump();
 }
 
 
@@ -4251,6 +4880,7 @@ static void free_modref( WINE_MODREF *wm )
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.DllBase );
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_hash );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
 
@@ -4591,6 +5221,36 @@ static void init_wow64( CONTEXT *context )
 #endif
 
 
+/***********************************************************************
+ *           io_uring_thread
+ *
+ * Completion thread of the io_uring file I/O engine, started on demand
+ * by the unix side. Like the loader worker threads, it skips the loader
+ * initialization. It exits when it has been idle for a while.
+ */
+static void CALLBACK io_uring_thread( void *arg )
+{
+    WINE_UNIX_CALL( unix_io_uring_thread, NULL );
+    for (;;) NtTerminateThread( GetCurrentThread(), 0 );
+}
+
+
+/***********************************************************************
+ *           init_io_uring
+ *
+ * Set up the io_uring engine used for overlapped file I/O if enabled
+ * with WINEIOURING.
+ */
+static void init_io_uring(void)
+{
+    WCHAR env_str[16];
+
+    if (NtCurrentTeb()->WowTebOffset) return;
+    if (!get_env( L"WINEIOURING", env_str, sizeof(env_str) ) || !wcstoul( env_str, NULL, 10 )) return;
+    WINE_UNIX_CALL( unix_io_uring_init, io_uring_thread );
+}
+
+
 /* release some address space once dlls are loaded*/
 static void release_address_space(void)
 {
@@ -4617,6 +5277,8 @@ void loader_init( CONTEXT *context, void **entry )
 
     if (process_detaching) NtTerminateThread( GetCurrentThread(), 0 );
 
+    if (NtCurrentTeb()->SameTebFlags & TEB_SKIP_LOADER_INIT) return;  /* loader worker or io_uring thread */
+
     RtlEnterCriticalSection( &loader_section );
 
     if (!imports_fixup_done)
@@ -4626,6 +5288,7 @@ void loader_init( CONTEXT *context, void **entry )
         WINE_MODREF *kernel32;
         PEB *peb = NtCurrentTeb()->Peb;
         WCHAR env_str[16];
+        ULONG rate;
         ULONG heap_flags = HEAP_GROWABLE;
         unsigned int i;
 
@@ -4656,6 +5319,21 @@ void loader_init( CONTEXT *context, void **entry )
             ERR( "Enabling heap top down hack.\n" );
             heap_top_down_hack = TRUE;
         }
+        if (get_env( L"WINE_HEAP_SEGMENT", env_str, sizeof(env_str)) && env_str[0] == L'1')
+        {
+            ERR( "Enabling segment heap backend.\n" );
+            heap_segment_backend = TRUE;
+        }
+        if (get_env( L"WINE_HEAP_PROFILE", env_str, sizeof(env_str)) && (rate = wcstoul( env_str, NULL, 0 )))
+        {
+            WCHAR prefix[MAX_PATH];
+
+            if (!get_env( L"WINE_HEAP_PROFILE_PREFIX", prefix, sizeof(prefix) )) wcscpy( prefix, L"wine-heap" );
+            ERR( "Enabling heap profiler, sampling every %lu bytes.\n", rate );
+            heap_profile_init( rate, prefix );
+        }
+        if (get_env( L"WINEPARALLELIMPORTS", env_str, sizeof(env_str) ) && !NtCurrentTeb()->WowTebOffset)
+            prefetch_threads_max = min( wcstoul( env_str, NULL, 10 ), MAX_PREFETCH_THREADS );
 
         peb->ProcessHeap        = RtlCreateHeap( heap_flags, NULL, 0, 0, NULL, NULL );
 
@@ -4690,6 +5368,7 @@ void loader_init( CONTEXT *context, void **entry )
         node_kernel32 = kernel32->ldr.DdagNode;
         pBaseThreadInitThunk = RtlFindExportedRoutineByName( kernel32->ldr.DllBase, "BaseThreadInitThunk" );
         LdrGetProcedureAddress( kernel32->ldr.DllBase, &ctrl_routine, 0, (void **)&pCtrlRoutine );
+        init_io_uring();
 
         actctx_init();
         locale_init();
@@ -50,6 +50,11 @@ extern UINT_PTR page_size;
 extern BOOL delay_heap_free;
 extern BOOL heap_zero_hack;
 extern BOOL heap_top_down_hack;
+extern BOOL heap_segment_backend;
+extern SIZE_T heap_profile_rate;
+
+extern void heap_profile_init( SIZE_T rate, const WCHAR *prefix );
+extern void heap_profile_dump(void);
 
 /* exceptions */
 extern LONG call_vectored_handlers( EXCEPTION_RECORD *rec, CONTEXT *context );
@@ -38,6 +38,7 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(sync);
 WINE_DECLARE_DEBUG_CHANNEL(relay);
+WINE_DECLARE_DEBUG_CHANNEL(spin);
 
 static const char *debugstr_timeout( const LARGE_INTEGER *timeout )
 {
@@ -142,6 +143,75 @@ DWORD WINAPI RtlRunOnceComplete( RTL_RUN_ONCE *once, ULONG flags, void *context
 }
 
 
+/***********************************************************************
+ * Adaptive spinning
+ ***********************************************************************/
+
+/* Before a thread sleeps on a lock held by another thread, it spins for a
+ * while in case the owner is about to release it. The spin limit is learned
+ * per lock from how long recent spins had to wait for the lock to become
+ * free. It moves towards the length of successful spins and decays when a
+ * spin fails, similarly to glibc adaptive mutexes. There is no cheap way to
+ * tell whether the owner is running, so threads don't spin when there are
+ * already as many spinning threads as processors, leaving no processor for
+ * an owner. Locks are hashed by address, so a few may share their state.
+ * The +spin channel periodically traces each lock's statistics. */
+
+#define MAX_ADAPTIVE_SPIN  1000
+
+/* each slot has its own cache line, so that spinning on one lock doesn't
+ * invalidate the statistics of unrelated locks */
+struct DECLSPEC_CACHEALIGN spin_stats
+{
+    LONG limit;    /* average length of recent spins */
+    LONG spun;     /* spins that found the lock free */
+    LONG slept;    /* spins that ended in a wait */
+    LONG skipped;  /* waits without a spin, all processors busy */
+};
+
+static struct spin_stats spin_stats[256];
+static LONG DECLSPEC_CACHEALIGN spinning_threads;
+
+static void trace_spin_stats( const void *lock, struct spin_stats *stats, LONG *counter )
+{
+    if (InterlockedIncrement( counter ) % 1024) return;
+    TRACE_(spin)( "lock %p: spun %ld, slept %ld, skipped %ld, limit %ld\n", lock,
+                  ReadNoFence( &stats->spun ), ReadNoFence( &stats->slept ),
+                  ReadNoFence( &stats->skipped ), ReadNoFence( &stats->limit ) );
+}
+
+/* spin until (*addr & mask) == value, return FALSE if the lock should be waited on instead */
+static BOOL adaptive_spin( const void *lock, const LONG *addr, LONG mask, LONG value )
+{
+    struct spin_stats *stats = &spin_stats[((ULONG_PTR)lock >> 4) % ARRAY_SIZE(spin_stats)];
+    ULONG cpus = NtCurrentTeb()->Peb->NumberOfProcessors;
+    LONG count = 0, limit = ReadNoFence( &stats->limit );
+    BOOL ret = FALSE;
+
+    if (cpus <= 1) return FALSE;
+
+    if (InterlockedIncrement( &spinning_threads ) < cpus)
+    {
+        for (limit = min( limit * 2 + 10, MAX_ADAPTIVE_SPIN ); count < limit; count++)
+        {
+            if ((ReadNoFence( addr ) & mask) == value)
+            {
+                ret = TRUE;
+                break;
+            }
+            YieldProcessor();
+        }
+        limit = ReadNoFence( &stats->limit );
+        if ((count = limit + ((ret ? count : 0) - limit) / 8) != limit) WriteNoFence( &stats->limit, count );
+        if (TRACE_ON(spin)) trace_spin_stats( lock, stats, ret ? &stats->spun : &stats->slept );
+    }
+    else if (TRACE_ON(spin)) trace_spin_stats( lock, stats, &stats->skipped );
+
+    InterlockedDecrement( &spinning_threads );
+    return ret;
+}
+
+
 /***********************************************************************
  * Critical sections
  ***********************************************************************/
@@ -374,6 +444,12 @@ NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
             YieldProcessor();
         }
     }
+    else if (crit->LockCount != -1 && crit->OwningThread != ULongToHandle(GetCurrentThreadId()))
+    {
+        /* held by another thread, spin for a while before waiting */
+        if (adaptive_spin( crit, &crit->LockCount, ~0, -1 ) &&
+            InterlockedCompareExchange( &crit->LockCount, 0, -1 ) == -1) goto done;
+    }
 
     if (InterlockedIncrement( &crit->LockCount ))
     {
@@ -520,6 +596,7 @@ void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    static const union { struct srw_lock s; LONG l; } owners = { .s = { 0, 0xffff } };
     union { RTL_SRWLOCK *rtl; struct srw_lock *s; LONG *l; } u = { lock };
 
     InterlockedExchangeAdd16( &u.s->exclusive_waiters, 2 );
@@ -549,6 +626,7 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
         } while (InterlockedCompareExchange( u.l, new.l, old.l ) != old.l);
 
         if (!wait) return;
+        if (adaptive_spin( lock, u.l, owners.l, 0 )) continue;
         RtlWaitOnAddress( &u.s->owners, &new.s.owners, sizeof(short), NULL );
     }
 }
@@ -562,6 +640,7 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
+    static const union { struct srw_lock s; LONG l; } exclusive = { .s = { -1, 0 } };
     union { RTL_SRWLOCK *rtl; struct srw_lock *s; LONG *l; } u = { lock };
 
     for (;;)
@@ -588,6 +667,7 @@ void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
         } while (InterlockedCompareExchange( u.l, new.l, old.l ) != old.l);
 
         if (!wait) return;
+        if (adaptive_spin( lock, u.l, exclusive.l, 0 )) continue;
         RtlWaitOnAddress( u.s, &new.s, sizeof(struct srw_lock), NULL );
     }
 }
@@ -827,6 +907,14 @@ NTSTATUS WINAPI RtlSleepConditionVariableSRW( RTL_CONDITION_VARIABLE *variable,
  * NtWaitForAlertByThreadId, which manipulate a single flag (similar to an
  * auto-reset event) per thread. This can be tested by attempting to wake a
  * thread waiting in RtlWaitOnAddress() via NtAlertThreadByThreadId.
+ *
+ * Where the host supports it, 1, 2 and 4-byte waits that fit in an aligned
+ * 32-bit word instead go straight to a host futex on that word. The offset of
+ * the address in the word selects the futex bitset, so that different
+ * addresses sharing a word are woken separately, and the host queues the
+ * waiters of a futex in order, which keeps them fair. Such waiters are not
+ * woken by NtAlertThreadByThreadId. The host only compares 32 bits, so 8-byte
+ * waits, like unaligned ones, use the queues below.
  */
 
 struct futex_entry
@@ -840,9 +928,11 @@ struct futex_queue
 {
     struct list queue;
     LONG lock;
+    LONG host_waiters;  /* threads waiting on a host futex */
 };
 
 static struct futex_queue futex_queues[256];
+static BOOL use_host_futex = TRUE;
 
 static struct futex_queue *get_futex_queue( const void *addr )
 {
@@ -879,6 +969,48 @@ static BOOL compare_addr( const void *addr, const void *cmp, SIZE_T size )
     return FALSE;
 }
 
+static NTSTATUS wait_on_host_futex( struct futex_queue *queue, const void *addr, const void *cmp,
+                                    SIZE_T size, const LARGE_INTEGER *timeout )
+{
+    struct wait_on_address_params params;
+    ULONG_PTR offset = (ULONG_PTR)addr & 3;
+    NTSTATUS ret = STATUS_SUCCESS;
+
+    if (size == 8 || offset + size > 4) return STATUS_NOT_SUPPORTED;
+
+    params.addr = (ULONG_PTR)addr - offset;
+    params.bitset = 1 << offset;
+    params.has_timeout = !!timeout;
+    params.timeout = timeout ? timeout->QuadPart : 0;
+
+    /* Read the word after announcing the wait, so that a waker either sees
+     * the waiter count or has not changed the value yet. */
+    InterlockedIncrement( &queue->host_waiters );
+    params.value = ReadNoFence( (LONG *)(ULONG_PTR)params.addr );
+    if (compare_addr( addr, cmp, size ))
+        ret = WINE_UNIX_CALL( unix_wait_on_address, &params );
+    InterlockedDecrement( &queue->host_waiters );
+
+    if (ret == STATUS_NOT_SUPPORTED) use_host_futex = FALSE;
+    return ret;
+}
+
+static int wake_host_futex( struct futex_queue *queue, const void *addr, int count )
+{
+    struct wake_address_params params;
+    ULONG_PTR offset = (ULONG_PTR)addr & 3;
+
+    MemoryBarrier();
+    if (!ReadNoFence( &queue->host_waiters )) return 0;
+
+    params.addr = (ULONG_PTR)addr - offset;
+    params.bitset = 1 << offset;
+    params.count = count;
+    params.woken = 0;
+    WINE_UNIX_CALL( unix_wake_address, &params );
+    return params.woken;
+}
+
 /***********************************************************************
  *           RtlWaitOnAddress   (NTDLL.@)
  */
@@ -894,6 +1026,12 @@ NTSTATUS WINAPI RtlWaitOnAddress( const void *addr, const void *cmp, SIZE_T size
     if (size != 1 && size != 2 && size != 4 && size != 8)
         return STATUS_INVALID_PARAMETER;
 
+    if (use_host_futex && (ret = wait_on_host_futex( queue, addr, cmp, size, timeout )) != STATUS_NOT_SUPPORTED)
+    {
+        TRACE("returning %#lx\n", ret);
+        return ret;
+    }
+
     entry.addr = addr;
     entry.tid = GetCurrentThreadId();
 
@@ -944,6 +1082,8 @@ void WINAPI RtlWakeAddressAll( const void *addr )
 
     if (!addr) return;
 
+    if (use_host_futex) wake_host_futex( queue, addr, INT_MAX );
+
     spin_lock( &queue->lock );
 
     if (!queue->queue.next)
@@ -983,6 +1123,8 @@ void WINAPI RtlWakeAddressSingle( const void *addr )
 
     if (!addr) return;
 
+    if (use_host_futex && wake_host_futex( queue, addr, 1 )) return;
+
     spin_lock( &queue->lock );
 
     if (!queue->queue.next)
@@ -1030,6 +1030,74 @@ static void test_completion_port_scheduling(void)
     }
 }
 
+struct wait_on_address_wake
+{
+    LONG64 value;
+    LONG ack;
+    unsigned int loops;
+};
+
+static DWORD WINAPI wait_on_address_wake_thread( void *arg )
+{
+    struct wait_on_address_wake *wake = arg;
+    LONG64 value;
+    unsigned int i;
+    NTSTATUS status;
+
+    for (i = 1; i <= wake->loops; i++)
+    {
+        /* only the high dword changes */
+        while ((value = *(volatile LONG64 *)&wake->value) != (LONG64)i << 32)
+        {
+            status = pRtlWaitOnAddress( &wake->value, &value, sizeof(value), NULL );
+            ok( !status, "got %#lx\n", status );
+        }
+        InterlockedExchange( &wake->ack, i );
+        pRtlWakeAddressSingle( &wake->ack );
+    }
+    return 0;
+}
+
+static void test_wait_on_address_wake(void)
+{
+    struct wait_on_address_wake wake;
+    LARGE_INTEGER timeout;
+    NTSTATUS status;
+    HANDLE thread;
+    unsigned int i;
+    LONG ack;
+    DWORD ret;
+
+    if (!pRtlWaitOnAddress)
+    {
+        win_skip("RtlWaitOnAddress not supported, skipping test\n");
+        return;
+    }
+
+    memset( &wake, 0, sizeof(wake) );
+    wake.loops = 2000;
+    thread = CreateThread( NULL, 0, wait_on_address_wake_thread, &wake, 0, NULL );
+
+    timeout.QuadPart = -5000 * 10000;
+    for (i = 1; i <= wake.loops; i++)
+    {
+        InterlockedCompareExchange64( &wake.value, (LONG64)i << 32, (LONG64)(i - 1) << 32 );
+        pRtlWakeAddressAll( &wake.value );
+        while ((ack = ReadAcquire( &wake.ack )) != i)
+        {
+            status = pRtlWaitOnAddress( &wake.ack, &ack, sizeof(ack), &timeout );
+            if (status) break;
+        }
+        if (ack != i) break;
+    }
+    ok( i > wake.loops, "8-byte waiter not woken in loop %u\n", i );
+
+    ret = WaitForSingleObject( thread, 5000 );
+    ok( !ret, "got %lu\n", ret );
+    if (ret) TerminateThread( thread, 0 );
+    CloseHandle( thread );
+}
+
 START_TEST(sync)
 {
     HMODULE module = GetModuleHandleA("ntdll.dll");
@@ -1078,4 +1146,5 @@ START_TEST(sync)
     test_resource();
     test_tid_alert( argv );
     test_completion_port_scheduling();
+    test_wait_on_address_wake();
 }
@@ -2704,6 +2704,132 @@ static void test_query_image_information(void)
     NtClose( file );
 }
 
+static void check_write_watch_( unsigned int line, char *base, SIZE_T offset, SIZE_T size, ULONG flags,
+                                ULONG_PTR max_count, const unsigned int *pages, ULONG_PTR expect )
+{
+    void *addresses[64];
+    ULONG_PTR count = max_count, i;
+    ULONG granularity;
+    NTSTATUS status;
+
+    status = NtGetWriteWatch( NtCurrentProcess(), flags, base + offset * page_size, size * page_size,
+                              addresses, &count, &granularity );
+    ok_(__FILE__, line)( !status, "NtGetWriteWatch failed %lx\n", status );
+    ok_(__FILE__, line)( count == expect, "got count %Iu, expected %Iu\n", count, expect );
+    ok_(__FILE__, line)( granularity == page_size, "got granularity %lu\n", granularity );
+    for (i = 0; i < min( count, expect ); i++)
+        ok_(__FILE__, line)( addresses[i] == base + pages[i] * page_size, "%Iu: got %p, expected %p\n",
+                             i, addresses[i], base + pages[i] * page_size );
+}
+#define check_write_watch(a, b, c, d, e, f, g) check_write_watch_( __LINE__, a, b, c, d, e, f, g )
+
+static void run_write_watch_runs(void)
+{
+    static const unsigned int pages1[] = { 0, 7, 8, 9, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 63 };
+    static const unsigned int pages2[] = { 6, 10, 19, 32, 62 };
+    static const unsigned int pages3[] = { 40, 41, 42, 43, 44, 45, 46, 47 };
+    static const unsigned int pages4[] = { 40, 41, 46, 47 };
+    SIZE_T size = 64 * page_size;
+    char *base = NULL;
+    NTSTATUS status;
+    unsigned int i;
+
+    status = NtAllocateVirtualMemory( NtCurrentProcess(), (void **)&base, 0, &size,
+                                      MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE );
+    ok( !status, "NtAllocateVirtualMemory failed %lx\n", status );
+    if (status) return;
+
+    check_write_watch( base, 0, 64, 0, 64, NULL, 0 );
+
+    /* dirty runs of various lengths, at the ends of the range and across word boundaries */
+    for (i = 0; i < ARRAY_SIZE(pages1); i++) base[pages1[i] * page_size] = 1;
+    check_write_watch( base, 0, 64, 0, 64, pages1, ARRAY_SIZE(pages1) );
+    check_write_watch( base, 0, 64, WRITE_WATCH_FLAG_RESET, 64, pages1, ARRAY_SIZE(pages1) );
+    check_write_watch( base, 0, 64, 0, 64, NULL, 0 );
+
+    /* pages next to the runs that were reset */
+    for (i = 0; i < ARRAY_SIZE(pages2); i++) base[pages2[i] * page_size] = 1;
+    check_write_watch( base, 0, 64, WRITE_WATCH_FLAG_RESET, 64, pages2, ARRAY_SIZE(pages2) );
+    check_write_watch( base, 0, 64, 0, 64, NULL, 0 );
+
+    /* range starting and ending in the middle of a run */
+    for (i = 0; i < ARRAY_SIZE(pages3); i++) base[pages3[i] * page_size] = 1;
+    check_write_watch( base, 42, 4, WRITE_WATCH_FLAG_RESET, 64, pages3 + 2, 4 );
+    check_write_watch( base, 0, 64, 0, 64, pages4, ARRAY_SIZE(pages4) );
+    check_write_watch( base, 46, 18, 0, 64, pages4 + 2, 2 );
+    check_write_watch( base, 0, 64, WRITE_WATCH_FLAG_RESET, 64, pages4, ARRAY_SIZE(pages4) );
+
+    /* run longer than the address buffer, only the returned pages are reset */
+    for (i = 0; i < ARRAY_SIZE(pages3); i++) base[pages3[i] * page_size] = 1;
+    check_write_watch( base, 0, 64, WRITE_WATCH_FLAG_RESET, 3, pages3, 3 );
+    check_write_watch( base, 0, 64, WRITE_WATCH_FLAG_RESET, 64, pages3 + 3, 5 );
+    check_write_watch( base, 0, 64, 0, 64, NULL, 0 );
+
+    size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), (void **)&base, &size, MEM_RELEASE );
+}
+
+static void run_write_watch_benchmark(void)
+{
+    static const SIZE_T size = 0x1000000;
+    static const unsigned int loops = 64;
+    LARGE_INTEGER start, end, freq;
+    ULONG_PTR count, total = 0;
+    unsigned int i, j;
+    void **addresses;
+    NTSTATUS status;
+    ULONG granularity;
+    char *base = NULL;
+    SIZE_T alloc_size = size;
+
+    status = NtAllocateVirtualMemory( NtCurrentProcess(), (void **)&base, 0, &alloc_size,
+                                      MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE );
+    ok( !status, "NtAllocateVirtualMemory failed %lx\n", status );
+    if (status) return;
+    addresses = HeapAlloc( GetProcessHeap(), 0, (size / page_size) * sizeof(*addresses) );
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < loops; i++)
+    {
+        /* dirty every fourth page, plus a contiguous run in the middle */
+        for (j = 0; j < size; j += 4 * page_size) base[j] = i;
+        memset( base + size / 2, i, 64 * page_size );
+
+        count = size / page_size;
+        status = NtGetWriteWatch( NtCurrentProcess(), WRITE_WATCH_FLAG_RESET, base, size,
+                                  addresses, &count, &granularity );
+        ok( !status, "NtGetWriteWatch failed %lx\n", status );
+        total += count;
+    }
+    QueryPerformanceCounter( &end );
+
+    ok( total >= loops * (size / page_size / 4), "got %Iu dirty pages\n", total );
+    trace( "write watch (%s): %u harvest cycles over %#Ix bytes in %.3f ms\n",
+           GetEnvironmentVariableA( "WINE_DISABLE_KERNEL_WRITEWATCH", NULL, 0 ) ? "mprotect" : "default",
+           loops, size, (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart );
+
+    HeapFree( GetProcessHeap(), 0, addresses );
+    alloc_size = 0;
+    NtFreeVirtualMemory( NtCurrentProcess(), (void **)&base, &alloc_size, MEM_RELEASE );
+}
+
+static void test_write_watch_backends(void)
+{
+    HANDLE process;
+
+    /* check and time the kernel write watch backend (if any) and the mprotect fallback */
+    process = create_target_process( "writewatch" );
+    wait_child_process( process );
+    CloseHandle( process );
+
+    SetEnvironmentVariableA( "WINE_DISABLE_KERNEL_WRITEWATCH", "1" );
+    process = create_target_process( "writewatch" );
+    wait_child_process( process );
+    CloseHandle( process );
+    SetEnvironmentVariableA( "WINE_DISABLE_KERNEL_WRITEWATCH", NULL );
+}
+
 START_TEST(virtual)
 {
     HMODULE mod;
@@ -2719,6 +2845,13 @@ START_TEST(virtual)
             Sleep(5000); /* spawned process runs for at most 5 seconds */
             return;
         }
+        if (!strcmp(argv[2], "writewatch"))
+        {
+            page_size = 0x1000;
+            run_write_watch_runs();
+            run_write_watch_benchmark();
+            return;
+        }
         return;
     }
 
@@ -2754,4 +2887,5 @@ START_TEST(virtual)
     test_syscalls();
     test_query_region_information();
     test_query_image_information();
+    test_write_watch_backends();
 }
@@ -87,6 +87,11 @@
 #ifdef HAVE_LINUX_MAJOR_H
 # include <linux/major.h>
 #endif
+#ifdef HAVE_LINUX_IO_URING_H
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/uio.h>
+#endif
 #ifdef HAVE_SYS_PARAM_H
 #include <sys/param.h>
 #endif
@@ -4985,6 +4990,7 @@ NTSTATUS WINAPI NtSetInformationFile( HANDLE handle, IO_STATUS_BLOCK *io,
                 status = wine_server_call( req );
             }
             SERVER_END_REQ;
+            if (!status) completion_set_server_sources( info->CompletionPort );
         }
         else status = STATUS_INVALID_PARAMETER_3;
         break;
@@ -5924,6 +5930,444 @@ static NTSTATUS cancel_async_file_read( HANDLE handle, IO_STATUS_BLOCK *io )
     return count ? STATUS_SUCCESS : STATUS_NOT_FOUND;
 }
 
+/* io_uring engine for overlapped reads and writes on regular files, enabled with WINEIOURING.
+ * The requests are queued to the submission ring and submitted from the calling thread, so
+ * that the requests of concurrent threads are submitted in batches. Each request has its own
+ * dup of the unix fd and a server async, which holds references to the file and the event,
+ * so that it completes properly even if the application closes its handles meanwhile. A
+ * completion thread reaps the completions, updates the IOSB and reports the result to the
+ * async, which signals the event and the completion port. The thread is started on demand
+ * and exits when it has been idle for a while. Requests that can't be queued go through the
+ * usual synchronous path. */
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+
+#define URING_ENTRIES 256
+#define URING_IDLE_TIMEOUT 5  /* seconds before an idle completion thread exits */
+
+struct uring_io
+{
+    struct list     entry;
+    HANDLE          handle;
+    HANDLE          wait;         /* wait handle of the server async */
+    int             unix_handle;  /* dup of the file fd, owned by the request */
+    IO_STATUS_BLOCK *io;
+    client_ptr_t    iosb;
+    struct iovec    iov;
+    off_t           offset;
+    BOOL            write;
+    DWORD           thread_id;
+    LONG            cancelled;
+};
+
+static struct
+{
+    int                  fd;
+    unsigned int        *sq_head;
+    unsigned int        *sq_tail;
+    unsigned int        *sq_mask;
+    unsigned int        *sq_array;
+    unsigned int         sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned int        *cq_head;
+    unsigned int        *cq_tail;
+    unsigned int        *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned int         cq_entries;
+} uring = { -1 };
+
+static pthread_mutex_t uring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uring_cond = PTHREAD_COND_INITIALIZER;
+static struct list uring_requests = LIST_INIT( uring_requests );
+static unsigned int uring_inflight;  /* requests submitted to the ring */
+static unsigned int uring_users;     /* threads in queue_uring_io */
+static BOOL uring_thread_running;
+static PRTL_THREAD_START_ROUTINE uring_thread_entry;  /* PE entry point of the completion thread */
+static int uring_ready;
+
+static inline int uring_enter( unsigned int to_submit, unsigned int min_complete, unsigned int flags )
+{
+    return syscall( __NR_io_uring_enter, uring.fd, to_submit, min_complete, flags, NULL, 0 );
+}
+
+/* get a submission entry, must be called with uring_mutex held */
+static struct io_uring_sqe *uring_get_sqe(void)
+{
+    unsigned int tail = *uring.sq_tail, index;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n( uring.sq_head, __ATOMIC_ACQUIRE ) >= uring.sq_entries) return NULL;
+    index = tail & *uring.sq_mask;
+    sqe = &uring.sqes[index];
+    memset( sqe, 0, sizeof(*sqe) );
+    uring.sq_array[index] = index;
+    return sqe;
+}
+
+/* make the queued submission entries visible, must be called with uring_mutex held */
+static unsigned int uring_commit_sqes( unsigned int count )
+{
+    unsigned int tail = *uring.sq_tail + count;
+
+    __atomic_store_n( uring.sq_tail, tail, __ATOMIC_RELEASE );
+    return tail - __atomic_load_n( uring.sq_head, __ATOMIC_ACQUIRE );
+}
+
+static void uring_submit( unsigned int count )
+{
+    /* this also submits the entries queued by other threads since the last call */
+    while (uring_enter( count, 0, 0 ) == -1 && errno == EINTR);
+}
+
+/***********************************************************************
+ *           io_uring_init
+ *
+ * Create the io_uring instance. Called from the PE side with the entry point of the
+ * completion thread, which calls io_uring_thread.
+ */
+NTSTATUS io_uring_init( void *args )
+{
+    struct io_uring_params params;
+    size_t sq_size, cq_size;
+    char *sq_ring, *cq_ring;
+    void *sqes;
+    int fd;
+
+    if (uring.fd != -1) return STATUS_SUCCESS;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params )) == -1)
+    {
+        WARN( "io_uring not available, errno %d\n", errno );
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) sq_size = cq_size = max( sq_size, cq_size );
+
+    sq_ring = mmap( NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if (sq_ring == MAP_FAILED) goto failed;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) cq_ring = sq_ring;
+    else
+    {
+        cq_ring = mmap( NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+        if (cq_ring == MAP_FAILED)
+        {
+            munmap( sq_ring, sq_size );
+            goto failed;
+        }
+    }
+    sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if (sqes == MAP_FAILED)
+    {
+        if (cq_ring != sq_ring) munmap( cq_ring, cq_size );
+        munmap( sq_ring, sq_size );
+        goto failed;
+    }
+
+    uring.sq_head    = (unsigned int *)(sq_ring + params.sq_off.head);
+    uring.sq_tail    = (unsigned int *)(sq_ring + params.sq_off.tail);
+    uring.sq_mask    = (unsigned int *)(sq_ring + params.sq_off.ring_mask);
+    uring.sq_array   = (unsigned int *)(sq_ring + params.sq_off.array);
+    uring.sq_entries = params.sq_entries;
+    uring.sqes       = sqes;
+    uring.cq_head    = (unsigned int *)(cq_ring + params.cq_off.head);
+    uring.cq_tail    = (unsigned int *)(cq_ring + params.cq_off.tail);
+    uring.cq_mask    = (unsigned int *)(cq_ring + params.cq_off.ring_mask);
+    uring.cqes       = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+    uring.cq_entries = params.cq_entries;
+    uring.fd         = fd;
+    uring_thread_entry = args;
+    __atomic_store_n( &uring_ready, 1, __ATOMIC_RELEASE );
+
+    TRACE( "created io_uring with %u/%u entries\n", uring.sq_entries, uring.cq_entries );
+    return STATUS_SUCCESS;
+
+failed:
+    WARN( "failed to map io_uring, errno %d\n", errno );
+    close( fd );
+    return STATUS_NOT_SUPPORTED;
+}
+
+/* start the completion thread, must be called with uring_mutex held */
+static NTSTATUS start_uring_thread(void)
+{
+    THREAD_BASIC_INFORMATION info;
+    NTSTATUS status;
+    HANDLE thread;
+    TEB *teb;
+
+    if ((status = NtCreateThreadEx( &thread, THREAD_ALL_ACCESS, NULL, NtCurrentProcess(), uring_thread_entry,
+                                    NULL, THREAD_CREATE_FLAGS_CREATE_SUSPENDED, 0, 0, 0, NULL )))
+        return status;
+    if (!(status = NtQueryInformationThread( thread, ThreadBasicInformation, &info, sizeof(info), NULL )))
+    {
+        /* the thread doesn't use the loader, like the loader worker threads */
+        teb = info.TebBaseAddress;
+        teb->SameTebFlags |= TEB_SKIP_THREAD_ATTACH | TEB_SKIP_LOADER_INIT;
+        NtResumeThread( thread, NULL );
+        uring_thread_running = TRUE;
+    }
+    else NtTerminateThread( thread, 0 );
+    NtClose( thread );
+    return status;
+}
+
+/* perform the I/O of a request on the current thread */
+static int uring_io_sync( struct uring_io *req )
+{
+    int res;
+
+    if (req->write) res = pwrite( req->unix_handle, req->iov.iov_base, req->iov.iov_len, req->offset );
+    else res = virtual_locked_pread( req->unix_handle, req->iov.iov_base, req->iov.iov_len, req->offset );
+    return res == -1 ? -errno : res;
+}
+
+static void complete_uring_io( struct uring_io *req, int res )
+{
+    NTSTATUS status;
+    ULONG total = 0;
+
+    /* the buffer may need write watches or guard pages handled, retry on this thread */
+    if (res == -EFAULT) res = uring_io_sync( req );
+
+    if (res == -ECANCELED) status = STATUS_CANCELLED;
+    else if (res == -EFAULT && req->write) status = STATUS_INVALID_USER_BUFFER;
+    else if (res < 0) status = errno_to_status( -res );
+    else
+    {
+        total = res;
+        status = (total || !req->iov.iov_len || req->write) ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+    }
+
+    TRACE( "handle %p, io %p, %s %u bytes at %s, status %#x\n", req->handle, req->io,
+           req->write ? "wrote" : "read", total, wine_dbgstr_longlong( req->offset ), (int)status );
+
+    close( req->unix_handle );
+    set_async_iosb( req->iosb, status, total );
+    set_async_direct_result( &req->wait, status, total, TRUE );
+    if (req->wait) NtClose( req->wait );
+    free( req );
+}
+
+/***********************************************************************
+ *           io_uring_thread
+ *
+ * Completion loop of the io_uring engine, runs on a thread started by start_uring_thread.
+ * Returns when there has been nothing to complete for URING_IDLE_TIMEOUT.
+ */
+NTSTATUS io_uring_thread( void *args )
+{
+    struct io_uring_cqe *cqe;
+    struct uring_io *req;
+    struct timespec deadline;
+    unsigned int head;
+    int res;
+
+    if (uring.fd == -1) return STATUS_NOT_SUPPORTED;
+
+    for (;;)
+    {
+        head = *uring.cq_head;
+        if (head == __atomic_load_n( uring.cq_tail, __ATOMIC_ACQUIRE ))
+        {
+            pthread_mutex_lock( &uring_mutex );
+            if (!uring_inflight)
+            {
+                clock_gettime( CLOCK_REALTIME, &deadline );
+                deadline.tv_sec += URING_IDLE_TIMEOUT;
+                while (!uring_inflight &&
+                       pthread_cond_timedwait( &uring_cond, &uring_mutex, &deadline ) != ETIMEDOUT);
+                if (!uring_inflight && !uring_users)
+                {
+                    uring_thread_running = FALSE;
+                    pthread_mutex_unlock( &uring_mutex );
+                    TRACE( "idle, exiting\n" );
+                    return STATUS_SUCCESS;
+                }
+            }
+            pthread_mutex_unlock( &uring_mutex );
+            /* returns immediately if there are completions already */
+            if (uring_inflight) uring_enter( 0, 1, IORING_ENTER_GETEVENTS );
+            continue;
+        }
+        cqe = &uring.cqes[head & *uring.cq_mask];
+        req = (struct uring_io *)(ULONG_PTR)cqe->user_data;
+        res = cqe->res;
+        __atomic_store_n( uring.cq_head, head + 1, __ATOMIC_RELEASE );
+
+        /* cancel requests have no user data */
+        if (!req) continue;
+
+        pthread_mutex_lock( &uring_mutex );
+        list_remove( &req->entry );
+        uring_inflight--;
+        pthread_mutex_unlock( &uring_mutex );
+
+        complete_uring_io( req, res );
+    }
+}
+
+/* queue an overlapped read or write on a regular file to the ring */
+static NTSTATUS queue_uring_io( HANDLE handle, int unix_handle, HANDLE event, IO_STATUS_BLOCK *io,
+                                ULONG_PTR cvalue, void *buffer, ULONG length, off_t offset, BOOL write )
+{
+    struct io_uring_sqe *sqe;
+    struct uring_io *ioreq = NULL;
+    unsigned int count = 0;
+    NTSTATUS status;
+    HANDLE wait;
+    int fd, res;
+
+    if (!__atomic_load_n( &uring_ready, __ATOMIC_ACQUIRE )) return STATUS_NOT_SUPPORTED;
+
+    /* the completion thread doesn't exit while there are users */
+    pthread_mutex_lock( &uring_mutex );
+    status = uring_thread_running ? STATUS_SUCCESS : start_uring_thread();
+    if (!status) uring_users++;
+    pthread_mutex_unlock( &uring_mutex );
+    if (status) return STATUS_NOT_SUPPORTED;
+
+    /* the server async holds the file and the event, and resets the event */
+    SERVER_START_REQ( register_direct_async )
+    {
+        req->async = server_async( handle, NULL, event, NULL, (void *)cvalue, iosb_client_ptr( io ) );
+        status = wine_server_call( req );
+        wait = wine_server_ptr_handle( reply->wait );
+    }
+    SERVER_END_REQ;
+    if (status != STATUS_ALERTED) goto failed;
+
+    if (!(ioreq = malloc( sizeof(*ioreq) )) || (fd = dup( unix_handle )) == -1)
+    {
+        /* the async is already started, report the failure to it */
+        free( ioreq );
+        set_async_direct_result( &wait, STATUS_NO_MEMORY, 0, FALSE );
+        if (wait) NtClose( wait );
+        goto failed;
+    }
+
+    ioreq->handle       = handle;
+    ioreq->wait         = wait;
+    ioreq->unix_handle  = fd;
+    ioreq->io           = io;
+    ioreq->iosb         = iosb_client_ptr( io );
+    ioreq->iov.iov_base = buffer;
+    ioreq->iov.iov_len  = length;
+    ioreq->offset       = offset;
+    ioreq->write        = write;
+    ioreq->thread_id    = GetCurrentThreadId();
+    ioreq->cancelled    = 0;
+
+    /* the request may complete as soon as it is submitted */
+    io->Status = STATUS_PENDING;
+    io->Information = 0;
+
+    pthread_mutex_lock( &uring_mutex );
+    if (uring_inflight < uring.cq_entries && (sqe = uring_get_sqe()))
+    {
+        sqe->opcode    = write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd        = ioreq->unix_handle;
+        sqe->addr      = (ULONG_PTR)&ioreq->iov;
+        sqe->len       = 1;
+        sqe->off       = offset;
+        sqe->user_data = (ULONG_PTR)ioreq;
+        list_add_tail( &uring_requests, &ioreq->entry );
+        if (!uring_inflight++) pthread_cond_signal( &uring_cond );
+        count = uring_commit_sqes( 1 );
+    }
+    uring_users--;
+    pthread_mutex_unlock( &uring_mutex );
+
+    if (count) uring_submit( count );
+    else
+    {
+        /* the ring is full, the async is already pending so complete it here */
+        res = uring_io_sync( ioreq );
+        complete_uring_io( ioreq, res );
+    }
+    return STATUS_PENDING;
+
+failed:
+    pthread_mutex_lock( &uring_mutex );
+    uring_users--;
+    pthread_mutex_unlock( &uring_mutex );
+    return STATUS_NOT_SUPPORTED;
+}
+
+/* cancel the io_uring requests of a handle, or only the one of io, or only those of the current thread */
+static NTSTATUS cancel_uring_io( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread )
+{
+    DWORD thread_id = GetCurrentThreadId();
+    struct io_uring_sqe *sqe;
+    struct uring_io *req;
+    unsigned int count = 0, pending = 0;
+    NTSTATUS status = STATUS_NOT_FOUND;
+
+    if (!__atomic_load_n( &uring_ready, __ATOMIC_ACQUIRE )) return STATUS_NOT_FOUND;
+
+    TRACE( "handle %p, io %p, only_thread %d.\n", handle, io, only_thread );
+
+    pthread_mutex_lock( &uring_mutex );
+    LIST_FOR_EACH_ENTRY( req, &uring_requests, struct uring_io, entry )
+    {
+        if (req->handle != handle) continue;
+        if (io && req->io != io) continue;
+        if (only_thread && req->thread_id != thread_id) continue;
+        if (InterlockedCompareExchange( &req->cancelled, 1, 0 )) continue;
+
+        if (!(sqe = uring_get_sqe()))
+        {
+            /* the submission queue is full, flush it and try again */
+            uring_submit( uring_commit_sqes( 0 ));
+            pending = 0;
+            if (!(sqe = uring_get_sqe()))
+            {
+                req->cancelled = 0;
+                status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd     = -1;
+        sqe->addr   = (ULONG_PTR)req;
+        pending = uring_commit_sqes( 1 );
+        ++count;
+    }
+    pthread_mutex_unlock( &uring_mutex );
+
+    if (pending) uring_submit( pending );
+    if (status == STATUS_INSUFFICIENT_RESOURCES) return status;
+    return count ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+}
+
+#else  /* HAVE_LINUX_IO_URING_H */
+
+NTSTATUS io_uring_init( void *args )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+NTSTATUS io_uring_thread( void *args )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+static NTSTATUS queue_uring_io( HANDLE handle, int unix_handle, HANDLE event, IO_STATUS_BLOCK *io,
+                                ULONG_PTR cvalue, void *buffer, ULONG length, off_t offset, BOOL write )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+static NTSTATUS cancel_uring_io( HANDLE handle, IO_STATUS_BLOCK *io, BOOL only_thread )
+{
+    return STATUS_NOT_FOUND;
+}
+
+#endif  /* HAVE_LINUX_IO_URING_H */
+
 /******************************************************************************
  *              NtReadFile   (NTDLL.@)
  */
@@ -5971,6 +6415,14 @@ NTSTATUS WINAPI NtReadFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, vo
             goto err;
         }
 
+        if (async_read && length && !apc &&
+            queue_uring_io( handle, unix_handle, event, io, cvalue,
+                            buffer, length, offset->QuadPart, FALSE ) == STATUS_PENDING)
+        {
+            status = STATUS_PENDING;
+            goto err;
+        }
+
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
             /* async I/O doesn't make sense on regular files */
@@ -6289,6 +6741,13 @@ NTSTATUS WINAPI NtWriteFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, v
                 status = STATUS_INVALID_PARAMETER;
                 goto done;
             }
+            else if (async_write && length && !apc &&
+                     queue_uring_io( handle, unix_handle, event, io, cvalue,
+                                     (void *)buffer, length, off, TRUE ) == STATUS_PENDING)
+            {
+                status = STATUS_PENDING;
+                goto err;
+            }
 
             /* async I/O doesn't make sense on regular files */
             while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
@@ -6776,25 +7235,30 @@ NTSTATUS WINAPI NtFlushBuffersFile( HANDLE handle, IO_STATUS_BLOCK *io )
  */
 NTSTATUS WINAPI NtCancelIoFile( HANDLE handle, IO_STATUS_BLOCK *io_status )
 {
-    unsigned int status;
+    unsigned int status, uring_status;
 
     TRACE( "%p %p\n", handle, io_status );
 
     if (ac_odyssey && !cancel_async_file_read( handle, NULL ))
         return (io_status->Status = STATUS_SUCCESS);
 
+    uring_status = cancel_uring_io( handle, NULL, TRUE );
+
     SERVER_START_REQ( cancel_async )
     {
         req->handle      = wine_server_obj_handle( handle );
         req->only_thread = TRUE;
-        if (!(status = wine_server_call( req )))
-        {
-            io_status->Status = status;
-            io_status->Information = 0;
-        }
+        status = wine_server_call( req );
     }
     SERVER_END_REQ;
 
+    if (status == STATUS_NOT_FOUND) status = uring_status;
+    if (!status)
+    {
+        io_status->Status = status;
+        io_status->Information = 0;
+    }
+
     return status;
 }
 
@@ -6804,25 +7268,30 @@ NTSTATUS WINAPI NtCancelIoFile( HANDLE handle, IO_STATUS_BLOCK *io_status )
  */
 NTSTATUS WINAPI NtCancelIoFileEx( HANDLE handle, IO_STATUS_BLOCK *io, IO_STATUS_BLOCK *io_status )
 {
-    unsigned int status;
+    unsigned int status, uring_status;
 
     TRACE( "%p %p %p\n", handle, io, io_status );
 
     if (ac_odyssey && !cancel_async_file_read( handle, io ))
         return (io_status->Status = STATUS_SUCCESS);
 
+    uring_status = cancel_uring_io( handle, io, FALSE );
+
     SERVER_START_REQ( cancel_async )
     {
         req->handle = wine_server_obj_handle( handle );
         req->iosb   = wine_server_client_ptr( io );
-        if (!(status = wine_server_call( req )))
-        {
-            io_status->Status = status;
-            io_status->Information = 0;
-        }
+        status = wine_server_call( req );
     }
     SERVER_END_REQ;
 
+    if (status == STATUS_NOT_FOUND) status = uring_status;
+    if (!status)
+    {
+        io_status->Status = status;
+        io_status->Information = 0;
+    }
+
     return status;
 }
 
@@ -7804,6 +8273,7 @@ NTSTATUS WINAPI NtSetInformationObject( HANDLE handle, OBJECT_INFORMATION_CLASS
             status = wine_server_call( req );
         }
         SERVER_END_REQ;
+        if (!status && p->Inherit) completion_share( handle );
     break;
     }
 
@@ -220,6 +220,33 @@ static char shm_name[29];
 static int shm_fd;
 static volatile void *shm_addrs[8192];
 
+/* Wait profiling, enabled with WINEFSYNC_PROFILE. The statistics are kept per
+ * object in an open addressing table indexed by the shm pointer, and dumped
+ * when the process exits. */
+
+struct fsync_stats
+{
+    void *shm;                    /* shm of the object, NULL for a free entry */
+    enum fsync_type type;         /* object type */
+    HANDLE handle;                /* handle the object was first seen through */
+    DWORD creator_tid;            /* thread that created the object, if it was created in this process */
+    void *creator;                /* caller of the function that created the object */
+    LONG64 waits;                 /* number of waits on the object */
+    LONG64 blocked;               /* number of waits that had to block */
+    LONG64 blocked_time;          /* total time spent blocked, in nanoseconds */
+    LONG64 futile_wakeups;        /* wakeups that didn't lead to acquiring the object */
+    LONG64 spins;                 /* failed attempts to grab the object */
+};
+
+#define FSYNC_STATS_SIZE    16384           /* must be a power of 2 */
+#define FSYNC_STATS_RETIRED ((void *)1)     /* shm of the entries of destroyed objects */
+#define FSYNC_STATS_BUSY    ((void *)2)     /* shm of an entry that is being filled */
+
+static int fsync_profile;
+static struct fsync_stats *fsync_stats;
+
+static void get_stats_name( const struct fsync_stats *stats, char *name, size_t size );
+
 static void *get_shm( unsigned int idx )
 {
     int entry  = (idx * 16) / FSYNC_SHM_PAGE_SIZE;
@@ -249,6 +276,170 @@ static void *get_shm( unsigned int idx )
     return (char *)shm_addrs[entry] + offset;
 }
 
+static inline LONGLONG monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * (LONGLONG)1000000000 + ts.tv_nsec;
+}
+
+/* find the statistics of an object, creating them on first use */
+static struct fsync_stats *get_stats( const struct fsync *obj, HANDLE handle )
+{
+    unsigned int i, hash = ((UINT_PTR)obj->shm >> 4) * 0x9e3779b1;
+    struct fsync_stats *stats;
+    void *shm;
+
+    for (i = 0; i < FSYNC_STATS_SIZE; i++)
+    {
+        stats = &fsync_stats[(hash + i) & (FSYNC_STATS_SIZE - 1)];
+        /* an entry only becomes visible once it is filled */
+        while ((shm = __atomic_load_n( &stats->shm, __ATOMIC_ACQUIRE )) == FSYNC_STATS_BUSY)
+            YieldProcessor();
+        if (shm == obj->shm) return stats;
+        if (shm) continue;
+        shm = NULL;
+        if (__atomic_compare_exchange_n( &stats->shm, &shm, FSYNC_STATS_BUSY, FALSE,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ))
+        {
+            stats->type = obj->type;
+            stats->handle = handle;
+            __atomic_store_n( &stats->shm, obj->shm, __ATOMIC_RELEASE );
+            return stats;
+        }
+        i--;  /* filled by another thread in the meantime, check it again */
+    }
+
+    WARN( "statistics table full\n" );
+    return NULL;
+}
+
+/* return the caller of the current Nt entry point */
+static void *get_syscall_caller(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    CONTEXT context;
+
+    context.ContextFlags = CONTEXT_CONTROL;
+    if (NtGetContextThread( GetCurrentThread(), &context )) return NULL;
+#ifdef __x86_64__
+    return *(void **)context.Rsp;
+#else
+    return *(void **)context.Esp;
+#endif
+#else
+    return NULL;
+#endif
+}
+
+/* record the creation of a new object; stats of a destroyed object that used the same shm are kept apart */
+static void profile_create( enum fsync_type type, HANDLE handle, unsigned int shm_idx )
+{
+    struct fsync_stats *stats;
+    struct fsync obj;
+
+    obj.type = type;
+    obj.shm = get_shm( shm_idx );
+    if (!(stats = get_stats( &obj, handle ))) return;
+    if (stats->waits)
+    {
+        __atomic_store_n( &stats->shm, FSYNC_STATS_RETIRED, __ATOMIC_RELEASE );
+        if (!(stats = get_stats( &obj, handle ))) return;
+    }
+    stats->creator_tid = GetCurrentThreadId();
+    stats->creator = get_syscall_caller();
+}
+
+static void profile_wait_start( struct fsync_stats **stats, const struct fsync *objs,
+                                const HANDLE *handles, DWORD count )
+{
+    DWORD i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (objs[i].type && (stats[i] = get_stats( &objs[i], handles[i] )))
+            __atomic_add_fetch( &stats[i]->waits, 1, __ATOMIC_RELAXED );
+        else
+            stats[i] = NULL;
+    }
+}
+
+static void profile_blocked( struct fsync_stats **stats, DWORD count, LONGLONG start, BOOL first )
+{
+    LONGLONG time = monotonic_ns() - start;
+    DWORD i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!stats[i]) continue;
+        if (first) __atomic_add_fetch( &stats[i]->blocked, 1, __ATOMIC_RELAXED );
+        __atomic_add_fetch( &stats[i]->blocked_time, time, __ATOMIC_RELAXED );
+    }
+}
+
+static inline void profile_spin( struct fsync_stats *stats )
+{
+    if (stats) __atomic_add_fetch( &stats->spins, 1, __ATOMIC_RELAXED );
+}
+
+static inline void profile_futile_wakeup( struct fsync_stats *stats )
+{
+    if (stats) __atomic_add_fetch( &stats->futile_wakeups, 1, __ATOMIC_RELAXED );
+}
+
+static int __cdecl compare_stats( const void *a, const void *b )
+{
+    const struct fsync_stats *s1 = *(const struct fsync_stats * const *)a;
+    const struct fsync_stats *s2 = *(const struct fsync_stats * const *)b;
+
+    if (s1->blocked_time != s2->blocked_time) return s1->blocked_time < s2->blocked_time ? 1 : -1;
+    if (s1->waits != s2->waits) return s1->waits < s2->waits ? 1 : -1;
+    return 0;
+}
+
+/***********************************************************************
+ *           fsync_dump_profile
+ *
+ * Dump the wait statistics of the most contended objects to stderr.
+ */
+void fsync_dump_profile(void)
+{
+    static const char * const types[] =
+        { "?", "semaphore", "auto event", "manual event", "mutex", "auto server", "manual server", "queue" };
+    struct fsync_stats **sorted, *stats;
+    unsigned int i, count = 0;
+    char creator[48], name[96];
+    void *shm;
+
+    if (!fsync_stats) return;
+    if (!(sorted = malloc( FSYNC_STATS_SIZE * sizeof(*sorted) ))) return;
+
+    for (i = 0; i < FSYNC_STATS_SIZE; i++)
+    {
+        shm = __atomic_load_n( &fsync_stats[i].shm, __ATOMIC_ACQUIRE );
+        if (shm && shm != FSYNC_STATS_BUSY && fsync_stats[i].waits) sorted[count++] = &fsync_stats[i];
+    }
+    qsort( sorted, count, sizeof(*sorted), compare_stats );
+
+    fprintf( stderr, "fsync: wait statistics of process %04x, %u objects\n", (int)GetCurrentProcessId(), count );
+    fprintf( stderr, "fsync: %10s %10s %12s %10s %10s %-13s %-8s %-30s %s\n", "waits", "blocked",
+             "blocked ms", "futile", "spins", "type", "handle", "created by", "name" );
+    for (i = 0; i < min( count, (unsigned int)fsync_profile ); i++)
+    {
+        stats = sorted[i];
+        if (stats->creator_tid) snprintf( creator, sizeof(creator), "%04x at %p", (int)stats->creator_tid, stats->creator );
+        else strcpy( creator, "-" );
+        get_stats_name( stats, name, sizeof(name) );
+        fprintf( stderr, "fsync: %10lld %10lld %12.3f %10lld %10lld %-13s %-8p %-30s %s\n",
+                 (long long)stats->waits, (long long)stats->blocked, stats->blocked_time / 1000000.0,
+                 (long long)stats->futile_wakeups, (long long)stats->spins,
+                 types[stats->type < ARRAY_SIZE(types) ? stats->type : 0], stats->handle, creator,
+                 name );
+    }
+    free( sorted );
+}
+
 /* We'd like lookup to be fast. To that end, we use a static list indexed by handle.
  * This is copied and adapted from the fd cache code. */
 
@@ -382,6 +573,29 @@ again:
     return TRUE;
 }
 
+/* get the name of a profiled object, if its handle still refers to it */
+static void get_stats_name( const struct fsync_stats *stats, char *name, size_t size )
+{
+    char buffer[sizeof(OBJECT_NAME_INFORMATION) + 256 * sizeof(WCHAR)];
+    OBJECT_NAME_INFORMATION *info = (OBJECT_NAME_INFORMATION *)buffer;
+    struct fsync obj;
+    BOOL same;
+    ULONG len;
+    int ret;
+
+    strcpy( name, "<closed>" );
+    if (stats->shm == FSYNC_STATS_RETIRED || !get_cached_object( stats->handle, &obj )) return;
+    same = obj.shm == stats->shm;
+    put_object( &obj );
+    if (!same) return;
+
+    strcpy( name, "<unnamed>" );
+    if (NtQueryObject( stats->handle, ObjectNameInformation, info, sizeof(buffer), &len ) || !info->Name.Length)
+        return;
+    ret = ntdll_wcstoumbs( info->Name.Buffer, info->Name.Length / sizeof(WCHAR), name, size - 1, FALSE );
+    name[max( ret, 0 )] = 0;
+}
+
 /* Gets an object. This is either a proper fsync object (i.e. an event,
  * semaphore, etc. created using create_fsync) or a generic synchronizable
  * server-side object which the server will signal (e.g. a process, thread,
@@ -507,6 +721,7 @@ static NTSTATUS create_fsync( enum fsync_type type, HANDLE *handle,
     if (!ret || ret == STATUS_OBJECT_NAME_EXISTS)
     {
         add_to_list( *handle, type, shm_idx );
+        if (fsync_profile && !ret) profile_create( type, *handle, shm_idx );
         TRACE("-> handle %p, shm index %d.\n", *handle, shm_idx);
     }
 
@@ -586,6 +801,16 @@ void fsync_init(void)
 
     current_pid = GetCurrentProcessId();
     assert(current_pid);
+
+    if (getenv( "WINEFSYNC_PROFILE" ) && (fsync_profile = atoi( getenv( "WINEFSYNC_PROFILE" ) )) > 0)
+    {
+        fsync_stats = anon_mmap_alloc( FSYNC_STATS_SIZE * sizeof(*fsync_stats), PROT_READ | PROT_WRITE );
+        if (fsync_stats == MAP_FAILED)
+        {
+            fsync_stats = NULL;
+            fsync_profile = 0;
+        }
+    }
 }
 
 NTSTATUS fsync_create_semaphore( HANDLE *handle, ACCESS_MASK access,
@@ -923,7 +1148,11 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
 
     struct futex_waitv futexes[MAXIMUM_WAIT_OBJECTS + 1];
     struct fsync objs[MAXIMUM_WAIT_OBJECTS];
+    struct fsync_stats *stats[MAXIMUM_WAIT_OBJECTS];
     BOOL msgwait = FALSE, waited = FALSE;
+    ULONG64 blocked_mask = 0;
+    LONGLONG start = 0;
+    int woken = -1;
     int prev_pids[MAXIMUM_WAIT_OBJECTS];
     int has_fsync = 0, has_server = 0;
     clockid_t clock_id = 0;
@@ -985,6 +1214,8 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
         return STATUS_NOT_IMPLEMENTED;
     }
 
+    if (fsync_profile) profile_wait_start( stats, objs, handles, count );
+
     if (TRACE_ON(fsync))
     {
         TRACE("Waiting for %s of %d handles:", wait_any ? "any" : "all", (int)count);
@@ -1130,6 +1361,7 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
                         ERR("Invalid type %#x for handle %p.\n", obj->type, handles[i]);
                         assert(0);
                     }
+                    if (fsync_profile) profile_spin( stats[i] );
                 }
                 else
                 {
@@ -1159,8 +1391,20 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
                 return STATUS_TIMEOUT;
             }
 
+            if (fsync_profile)
+            {
+                if (woken >= 0 && woken < count) profile_futile_wakeup( stats[woken] );
+                start = monotonic_ns();
+            }
+
             ret = futex_wait_multiple( futexes, waitcount, timeout ? &end : NULL, clock_id );
 
+            if (fsync_profile)
+            {
+                profile_blocked( stats, count, start, !waited );
+                woken = ret;
+            }
+
             /* FUTEX_WAIT_MULTIPLE can succeed or return -EINTR, -EAGAIN,
              * -EFAULT/-EACCES, -ETIMEDOUT. In the first three cases we need to
              * try again, bad address is already handled by the fact that we
@@ -1222,7 +1466,13 @@ tryagain:
 
                     while ((current = __atomic_load_n( &mutex->tid, __ATOMIC_SEQ_CST )))
                     {
+                        if (fsync_profile) start = monotonic_ns();
                         status = do_single_wait( &mutex->tid, current, timeout ? &end : NULL, clock_id, alertable );
+                        if (fsync_profile)
+                        {
+                            profile_blocked( &stats[i], 1, start, !(blocked_mask & ((ULONG64)1 << i)) );
+                            blocked_mask |= (ULONG64)1 << i;
+                        }
                         if (status != STATUS_PENDING)
                             break;
                     }
@@ -1234,7 +1484,13 @@ tryagain:
 
                     while (!__atomic_load_n( &event->signaled, __ATOMIC_SEQ_CST ))
                     {
+                        if (fsync_profile) start = monotonic_ns();
                         status = do_single_wait( &event->signaled, 0, timeout ? &end : NULL, clock_id, alertable );
+                        if (fsync_profile)
+                        {
+                            profile_blocked( &stats[i], 1, start, !(blocked_mask & ((ULONG64)1 << i)) );
+                            blocked_mask |= (ULONG64)1 << i;
+                        }
                         if (status != STATUS_PENDING)
                             break;
                     }
@@ -1262,14 +1518,20 @@ tryagain:
                     int tid = __atomic_load_n( &mutex->tid, __ATOMIC_SEQ_CST );
 
                     if (tid && tid != ~0 && tid != CURRENT_TID)
+                    {
+                        if (fsync_profile) profile_futile_wakeup( stats[i] );
                         goto tryagain;
+                    }
                 }
                 else if (obj->type)
                 {
                     struct event *event = obj->shm;
 
                     if (!__atomic_load_n( &event->signaled, __ATOMIC_SEQ_CST ))
+                    {
+                        if (fsync_profile) profile_futile_wakeup( stats[i] );
                         goto tryagain;
+                    }
                 }
             }
 
@@ -1346,6 +1608,7 @@ tryagain:
             return STATUS_SUCCESS;
 
 tooslow:
+            if (fsync_profile) profile_futile_wakeup( stats[i] );
             for (--i; i >= 0; i--)
             {
                 struct fsync *obj = &objs[i];
@@ -1201,6 +1201,10 @@ static const unixlib_entry_t unix_call_funcs[] =
     steamclient_setup_trampolines,
     is_pc_in_native_so,
     debugstr_pc,
+    wait_on_address,
+    wake_address,
+    io_uring_init,
+    io_uring_thread,
 };
 
 
@@ -1208,6 +1212,10 @@ static const unixlib_entry_t unix_call_funcs[] =
 
 static NTSTATUS wow64_load_so_dll( void *args ) { return STATUS_INVALID_IMAGE_FORMAT; }
 static NTSTATUS wow64_unwind_builtin_dll( void *args ) { return STATUS_UNSUCCESSFUL; }
+static NTSTATUS wow64_steamclient_setup_trampolines( void *args ) { return STATUS_NOT_SUPPORTED; }
+static NTSTATUS wow64_debugstr_pc( void *args ) { return STATUS_NOT_SUPPORTED; }
+static NTSTATUS wow64_io_uring_init( void *args ) { return STATUS_NOT_SUPPORTED; }
+static NTSTATUS wow64_io_uring_thread( void *args ) { return STATUS_NOT_SUPPORTED; }
 
 const unixlib_entry_t unix_call_wow64_funcs[] =
 {
@@ -1219,6 +1227,13 @@ const unixlib_entry_t unix_call_wow64_funcs[] =
     wow64_wine_server_handle_to_fd,
     wow64_wine_spawnvp,
     system_time_precise,
+    wow64_steamclient_setup_trampolines,
+    is_pc_in_native_so,
+    wow64_debugstr_pc,
+    wait_on_address,
+    wake_address,
+    wow64_io_uring_init,
+    wow64_io_uring_thread,
 };
 
 #endif  /* _WIN64 */
@@ -315,6 +315,161 @@ static char *save_all_subkeys( char *data, FILE *f )
     return save_subkeys( data, NULL, NULL, f );
 }
 
+/* client-side cache of registry reads, validated against the generation counters
+ * that the server increments in shared memory whenever a key changes, or a handle
+ * to it is closed, so that a reused handle value never hits stale data */
+
+#define REG_CACHE_SIZE     1024  /* number of cache entries, must be a power of 2 */
+#define REG_CACHE_MAX_DATA 4096  /* max. size of cached data */
+#define REG_CACHE_VALUE    (-2)  /* index used for value entries */
+
+struct reg_cache_entry
+{
+    HANDLE        handle;      /* key handle */
+    int           index;       /* subkey index, -1 for the key itself, or REG_CACHE_VALUE */
+    int           info_class;  /* key information class */
+    unsigned int  gen_index;   /* index of the key in the generation table */
+    unsigned int  generation;  /* generation of the key when the data was retrieved */
+    unsigned int  status;      /* status of the request */
+    union
+    {
+        struct reply_header        header;
+        struct get_key_value_reply value;
+        struct enum_key_reply      key;
+    } reply;
+    data_size_t   name_len;    /* length of the value name */
+    data_size_t   data_len;    /* length of the reply data */
+    char          data[1];     /* value name followed by the reply data */
+};
+
+static const registry_shm_t *registry_shm;
+static struct reg_cache_entry *reg_cache[REG_CACHE_SIZE];
+static pthread_mutex_t reg_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* map the registry generation table if the cache is enabled */
+static BOOL use_registry_cache(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+                                  '_','_','w','i','n','e','_','r','e','g','i','s','t','r','y','_',
+                                  'g','e','n','e','r','a','t','i','o','n','s',0};
+    static int enabled = -1;
+    UNICODE_STRING name;
+    OBJECT_ATTRIBUTES attr;
+    SIZE_T size = sizeof(*registry_shm);
+    sigset_t sigset;
+    HANDLE handle;
+    void *ptr = NULL;
+
+    if (enabled != -1) return enabled;
+
+    server_enter_uninterrupted_section( &reg_cache_mutex, &sigset );
+    if (enabled == -1)
+    {
+        enabled = 0;
+        if (getenv( "WINEREGISTRYCACHE" ) && atoi( getenv( "WINEREGISTRYCACHE" )))
+        {
+            init_unicode_string( &name, nameW );
+            InitializeObjectAttributes( &attr, &name, 0, NULL, NULL );
+            if (!NtOpenSection( &handle, SECTION_MAP_READ, &attr ))
+            {
+                if (!NtMapViewOfSection( handle, NtCurrentProcess(), &ptr, 0, 0, NULL, &size,
+                                         ViewShare, 0, PAGE_READONLY ))
+                {
+                    registry_shm = ptr;
+                    enabled = 1;
+                }
+                NtClose( handle );
+            }
+            if (!enabled) WARN( "registry generation table not available, cache disabled\n" );
+        }
+    }
+    server_leave_uninterrupted_section( &reg_cache_mutex, &sigset );
+    return enabled;
+}
+
+static unsigned int reg_cache_hash( HANDLE handle, int index, int info_class, const UNICODE_STRING *name )
+{
+    unsigned int i, hash = HandleToULong( handle ) * 0x9e3779b1 ^ (index * 31 + info_class);
+
+    if (name) for (i = 0; i < name->Length / sizeof(WCHAR); i++) hash = hash * 33 + name->Buffer[i];
+    return (hash ^ (hash >> 16)) & (REG_CACHE_SIZE - 1);
+}
+
+static BOOL reg_cache_match( const struct reg_cache_entry *entry, HANDLE handle, int index, int info_class,
+                             const UNICODE_STRING *name )
+{
+    if (entry->handle != handle || entry->index != index || entry->info_class != info_class) return FALSE;
+    if (name && (entry->name_len != name->Length || memcmp( entry->data, name->Buffer, name->Length )))
+        return FALSE;
+    return entry->generation == registry_shm->generation[entry->gen_index];
+}
+
+/***********************************************************************
+ *           reg_cache_lookup
+ *
+ * Retrieve a cached reply; the data is copied to the reply buffer.
+ */
+static BOOL reg_cache_lookup( HANDLE handle, int index, int info_class, const UNICODE_STRING *name,
+                              void *reply, size_t reply_size, void *data, data_size_t size, unsigned int *status )
+{
+    struct reg_cache_entry *entry;
+    unsigned int hash = reg_cache_hash( handle, index, info_class, name );
+    sigset_t sigset;
+    BOOL ret = FALSE;
+
+    server_enter_uninterrupted_section( &reg_cache_mutex, &sigset );
+    if ((entry = reg_cache[hash]) && reg_cache_match( entry, handle, index, info_class, name ) &&
+        (index == REG_CACHE_VALUE || size >= entry->data_len))
+    {
+        memcpy( reply, &entry->reply, reply_size );
+        ((struct reply_header *)reply)->reply_size = min( size, entry->data_len );
+        if (data) memcpy( data, entry->data + entry->name_len, min( size, entry->data_len ));
+        *status = entry->status;
+        ret = TRUE;
+    }
+    server_leave_uninterrupted_section( &reg_cache_mutex, &sigset );
+    return ret;
+}
+
+/***********************************************************************
+ *           reg_cache_insert
+ *
+ * Store a complete server reply in the cache.
+ */
+static void reg_cache_insert( HANDLE handle, int index, int info_class,
+                              const UNICODE_STRING *name, const void *reply, size_t reply_size,
+                              unsigned int gen_index, unsigned int generation, const void *data,
+                              unsigned int status )
+{
+    struct reg_cache_entry *entry, *old;
+    data_size_t name_len = name ? name->Length : 0;
+    data_size_t data_len = status ? 0 : ((const struct reply_header *)reply)->reply_size;
+    unsigned int hash = reg_cache_hash( handle, index, info_class, name );
+    sigset_t sigset;
+
+    if (gen_index >= REGISTRY_GENERATION_COUNT || data_len > REG_CACHE_MAX_DATA) return;
+    if (!(entry = malloc( offsetof( struct reg_cache_entry, data[name_len + data_len] )))) return;
+
+    entry->handle     = handle;
+    entry->index      = index;
+    entry->info_class = info_class;
+    entry->gen_index  = gen_index;
+    entry->generation = generation;
+    entry->status     = status;
+    memcpy( &entry->reply, reply, reply_size );
+    entry->name_len   = name_len;
+    entry->data_len   = data_len;
+    if (name_len) memcpy( entry->data, name->Buffer, name_len );
+    if (data_len) memcpy( entry->data + name_len, data, data_len );
+
+    server_enter_uninterrupted_section( &reg_cache_mutex, &sigset );
+    old = reg_cache[hash];
+    reg_cache[hash] = entry;
+    server_leave_uninterrupted_section( &reg_cache_mutex, &sigset );
+    free( old );
+}
+
+
 
 /******************************************************************************
  *              NtCreateKey  (NTDLL.@)
@@ -489,9 +644,11 @@ static NTSTATUS enumerate_key( HANDLE handle, int index, KEY_INFORMATION_CLASS i
                                void *info, DWORD length, DWORD *result_len )
 
 {
+    struct enum_key_reply key;
     unsigned int ret;
     void *data_ptr;
     size_t fixed_size;
+    data_size_t data_size;
 
     switch (info_class)
     {
@@ -506,95 +663,109 @@ static NTSTATUS enumerate_key( HANDLE handle, int index, KEY_INFORMATION_CLASS i
     }
     fixed_size = (char *)data_ptr - (char *)info;
 
-    SERVER_START_REQ( enum_key )
+    data_size = length > fixed_size ? length - fixed_size : 0;
+    if (!use_registry_cache() ||
+        !reg_cache_lookup( handle, index, info_class, NULL, &key, sizeof(key), data_ptr, data_size, &ret ))
     {
-        req->hkey       = wine_server_obj_handle( handle );
-        req->index      = index;
-        req->info_class = info_class;
-        if (length > fixed_size) wine_server_set_reply( req, data_ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        SERVER_START_REQ( enum_key )
         {
-            switch (info_class)
-            {
-            case KeyBasicInformation:
-            {
-                KEY_BASIC_INFORMATION keyinfo;
-                keyinfo.LastWriteTime.QuadPart = reply->modif;
-                keyinfo.TitleIndex = 0;
-                keyinfo.NameLength = reply->namelen;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
+            req->hkey       = wine_server_obj_handle( handle );
+            req->index      = index;
+            req->info_class = info_class;
+            if (data_size) wine_server_set_reply( req, data_ptr, data_size );
+            ret = wine_server_call( req );
+            key = *reply;
+        }
+        SERVER_END_REQ;
+
+        /* only cache the complete data */
+        if (registry_shm && (ret == STATUS_NO_MORE_ENTRIES ||
+                             (!ret && wine_server_reply_size( &key ) == key.total)))
+            reg_cache_insert( handle, index, info_class, NULL, &key, sizeof(key),
+                              key.gen_index, key.generation, data_ptr, ret );
+    }
+
+    if (!ret)
+    {
+        switch (info_class)
+        {
+        case KeyBasicInformation:
+        {
+            KEY_BASIC_INFORMATION keyinfo;
+            keyinfo.LastWriteTime.QuadPart = key.modif;
+            keyinfo.TitleIndex = 0;
+            keyinfo.NameLength = key.namelen;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
             break;
-            }
+        }
 
-            case KeyFullInformation:
-            {
-                KEY_FULL_INFORMATION keyinfo;
-                keyinfo.LastWriteTime.QuadPart = reply->modif;
-                keyinfo.TitleIndex = 0;
-                keyinfo.ClassLength = wine_server_reply_size(reply);
-                keyinfo.ClassOffset = keyinfo.ClassLength ? fixed_size : -1;
-                keyinfo.SubKeys = reply->subkeys;
-                keyinfo.MaxNameLen = reply->max_subkey;
-                keyinfo.MaxClassLen = reply->max_class;
-                keyinfo.Values = reply->values;
-                keyinfo.MaxValueNameLen = reply->max_value;
-                keyinfo.MaxValueDataLen = reply->max_data;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
-                break;
-            }
+        case KeyFullInformation:
+        {
+            KEY_FULL_INFORMATION keyinfo;
+            keyinfo.LastWriteTime.QuadPart = key.modif;
+            keyinfo.TitleIndex = 0;
+            keyinfo.ClassLength = wine_server_reply_size(&key);
+            keyinfo.ClassOffset = keyinfo.ClassLength ? fixed_size : -1;
+            keyinfo.SubKeys = key.subkeys;
+            keyinfo.MaxNameLen = key.max_subkey;
+            keyinfo.MaxClassLen = key.max_class;
+            keyinfo.Values = key.values;
+            keyinfo.MaxValueNameLen = key.max_value;
+            keyinfo.MaxValueDataLen = key.max_data;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
+            break;
+        }
 
-            case KeyNodeInformation:
+        case KeyNodeInformation:
+        {
+            KEY_NODE_INFORMATION keyinfo;
+            keyinfo.LastWriteTime.QuadPart = key.modif;
+            keyinfo.TitleIndex = 0;
+            if (key.namelen < wine_server_reply_size(&key))
             {
-                KEY_NODE_INFORMATION keyinfo;
-                keyinfo.LastWriteTime.QuadPart = reply->modif;
-                keyinfo.TitleIndex = 0;
-                if (reply->namelen < wine_server_reply_size(reply))
-                {
-                    keyinfo.ClassLength = wine_server_reply_size(reply) - reply->namelen;
-                    keyinfo.ClassOffset = fixed_size + reply->namelen;
-                }
-                else
-                {
-                    keyinfo.ClassLength = 0;
-                    keyinfo.ClassOffset = -1;
-                }
-                keyinfo.NameLength = reply->namelen;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
-                break;
+                keyinfo.ClassLength = wine_server_reply_size(&key) - key.namelen;
+                keyinfo.ClassOffset = fixed_size + key.namelen;
             }
-
-            case KeyNameInformation:
+            else
             {
-                KEY_NAME_INFORMATION keyinfo;
-                keyinfo.NameLength = reply->namelen;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
-                break;
+                keyinfo.ClassLength = 0;
+                keyinfo.ClassOffset = -1;
             }
+            keyinfo.NameLength = key.namelen;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
+            break;
+        }
 
-            case KeyCachedInformation:
-            {
-                KEY_CACHED_INFORMATION keyinfo;
-                keyinfo.LastWriteTime.QuadPart = reply->modif;
-                keyinfo.TitleIndex = 0;
-                keyinfo.SubKeys = reply->subkeys;
-                keyinfo.MaxNameLen = reply->max_subkey;
-                keyinfo.Values = reply->values;
-                keyinfo.MaxValueNameLen = reply->max_value;
-                keyinfo.MaxValueDataLen = reply->max_data;
-                keyinfo.NameLength = reply->namelen;
-                memcpy( info, &keyinfo, min( length, fixed_size ) );
-                break;
-            }
+        case KeyNameInformation:
+        {
+            KEY_NAME_INFORMATION keyinfo;
+            keyinfo.NameLength = key.namelen;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
+            break;
+        }
 
-            default:
-                break;
-            }
-            *result_len = fixed_size + reply->total;
-            if (length < fixed_size) ret = STATUS_BUFFER_TOO_SMALL;
-            else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+        case KeyCachedInformation:
+        {
+            KEY_CACHED_INFORMATION keyinfo;
+            keyinfo.LastWriteTime.QuadPart = key.modif;
+            keyinfo.TitleIndex = 0;
+            keyinfo.SubKeys = key.subkeys;
+            keyinfo.MaxNameLen = key.max_subkey;
+            keyinfo.Values = key.values;
+            keyinfo.MaxValueNameLen = key.max_value;
+            keyinfo.MaxValueDataLen = key.max_data;
+            keyinfo.NameLength = key.namelen;
+            memcpy( info, &keyinfo, min( length, fixed_size ) );
+            break;
+        }
+
+        default:
+            break;
         }
+        *result_len = fixed_size + key.total;
+        if (length < fixed_size) ret = STATUS_BUFFER_TOO_SMALL;
+        else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
@@ -738,9 +909,11 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
                                  KEY_VALUE_INFORMATION_CLASS info_class,
                                  void *info, DWORD length, DWORD *result_len )
 {
+    struct get_key_value_reply value;
     unsigned int ret;
     UCHAR *data_ptr;
     unsigned int fixed_size, min_size;
+    data_size_t data_size;
 
     TRACE( "(%p,%s,%d,%p,%d)\n", handle, debugstr_us(name), info_class, info, (int)length );
 
@@ -786,21 +959,34 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
         return STATUS_INVALID_PARAMETER;
     }
 
-    SERVER_START_REQ( get_key_value )
+    data_size = length > fixed_size && data_ptr ? length - fixed_size : 0;
+    if (!use_registry_cache() ||
+        !reg_cache_lookup( handle, REG_CACHE_VALUE, 0, name, &value, sizeof(value), data_ptr, data_size, &ret ))
     {
-        req->hkey = wine_server_obj_handle( handle );
-        wine_server_add_data( req, name->Buffer, name->Length );
-        if (length > fixed_size && data_ptr) wine_server_set_reply( req, data_ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        SERVER_START_REQ( get_key_value )
         {
-            copy_key_value_info( info_class, info, length, reply->type,
-                                 name->Length, reply->total );
-            *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : reply->total);
-            if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
-            else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+            req->hkey = wine_server_obj_handle( handle );
+            wine_server_add_data( req, name->Buffer, name->Length );
+            if (data_size) wine_server_set_reply( req, data_ptr, data_size );
+            ret = wine_server_call( req );
+            value = *reply;
         }
+        SERVER_END_REQ;
+
+        /* only cache the complete data */
+        if (registry_shm && (ret == STATUS_OBJECT_NAME_NOT_FOUND ||
+                             (!ret && wine_server_reply_size( &value ) == value.total)))
+            reg_cache_insert( handle, REG_CACHE_VALUE, 0, name, &value, sizeof(value),
+                              value.gen_index, value.generation, data_ptr, ret );
+    }
+
+    if (!ret)
+    {
+        copy_key_value_info( info_class, info, length, value.type, name->Length, value.total );
+        *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : value.total);
+        if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
+        else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
@@ -1020,9 +1206,10 @@ done:
  */
 NTSTATUS WINAPI NtFlushKey( HANDLE key )
 {
+    struct __server_request_info *done_reqs = NULL, **done_ptrs;
     abstime_t timestamp_counter;
     data_size_t size = 0;
-    unsigned int ret;
+    unsigned int ret, status = STATUS_SUCCESS;
     char *data = NULL, *curr_data;
     HANDLE mutex;
     int i, branch_count, branch;
@@ -1055,25 +1242,42 @@ NTSTATUS WINAPI NtFlushKey( HANDLE key )
     }
     if (ret) goto done;
 
+    if (branch_count && !(done_reqs = malloc( branch_count * (sizeof(*done_reqs) + sizeof(*done_ptrs)) )))
+    {
+        ret = STATUS_NO_MEMORY;
+        goto done;
+    }
+    done_ptrs = (struct __server_request_info **)(done_reqs + branch_count);
+
+    /* save all the branches first, then report them as saved in a single server call */
     curr_data = data;
     for (i = 0; i < branch_count; ++i)
     {
+        struct flush_key_done_request *req = &done_reqs[i].u.req.flush_key_done_request;
+
         branch = *(int *)curr_data;
         curr_data += sizeof(int);
-        if ((ret = save_registry_branch( &curr_data ))) goto done;
+        if ((ret = save_registry_branch( &curr_data ))) break;
+
+        memset( &done_reqs[i].u.req, 0, sizeof(done_reqs[i].u.req) );
+        done_reqs[i].name = "flush_key_done";
+        done_reqs[i].u.req.request_header.req = REQ_flush_key_done;
+        done_reqs[i].data_count = 0;
+        req->branch = branch;
+        req->timestamp_counter = timestamp_counter;
+        done_ptrs[i] = &done_reqs[i];
+    }
 
-        SERVER_START_REQ( flush_key_done )
-        {
-            req->branch = branch;
-            req->timestamp_counter = timestamp_counter;
-            ret = wine_server_call( req );
-        }
-        SERVER_END_REQ;
-        if (ret) break;
+    if (i && !(status = server_call_batch( done_ptrs, i )))
+    {
+        for (branch = 0; branch < i && !status; branch++)
+            status = done_reqs[branch].u.reply.reply_header.error;
     }
+    if (!ret) ret = status;
 
 done:
     release_key_flush_mutex( mutex );
+    free( done_reqs );
     free( data );
     return ret;
 }
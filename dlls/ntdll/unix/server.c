@@ -292,6 +292,117 @@ unsigned int CDECL wine_server_call( void *req_ptr )
 }
 
 
+/***********************************************************************
+ *           send_batch
+ *
+ * Perform up to BATCH_MAX_COUNT requests with a single round trip; helper for server_call_batch.
+ */
+static unsigned int send_batch( struct __server_request_info **reqs, unsigned int count )
+{
+    static const char padding[BATCH_ALIGNMENT];
+    struct iovec vec[1 + BATCH_MAX_COUNT * (__SERVER_MAX_DATA + 2)];
+    struct __server_request_info batch;
+    data_size_t size = 0, reply_size = 0, len;
+    unsigned int i, j, done, ret, nb_vec = 1;
+    char *replies = NULL, *ptr;
+    sigset_t old_set;
+    int written;
+
+    for (i = 0; i < count; i++)
+    {
+        struct __server_request_info *req = reqs[i];
+
+        vec[nb_vec].iov_base = &req->u.req;
+        vec[nb_vec++].iov_len = sizeof(req->u.req);
+        for (j = 0; j < req->data_count; j++)
+        {
+            vec[nb_vec].iov_base = (void *)req->data[j].ptr;
+            vec[nb_vec++].iov_len = req->data[j].size;
+        }
+        len = req->u.req.request_header.request_size;
+        if (len % BATCH_ALIGNMENT)
+        {
+            vec[nb_vec].iov_base = (void *)padding;
+            vec[nb_vec++].iov_len = BATCH_ALIGNMENT - len % BATCH_ALIGNMENT;
+        }
+        size += sizeof(req->u.req) + ((len + BATCH_ALIGNMENT - 1) & ~(BATCH_ALIGNMENT - 1));
+        len = req->u.req.request_header.reply_size;
+        reply_size += sizeof(req->u.reply) + ((len + BATCH_ALIGNMENT - 1) & ~(BATCH_ALIGNMENT - 1));
+    }
+    if (!(replies = malloc( reply_size ))) return STATUS_NO_MEMORY;
+
+    memset( &batch.u.req, 0, sizeof(batch.u.req) );
+    batch.u.req.request_header.req = REQ_batch;
+    batch.u.req.request_header.request_size = size;
+    batch.u.req.request_header.reply_size = reply_size;
+    vec[0].iov_base = &batch.u.req;
+    vec[0].iov_len = sizeof(batch.u.req);
+
+    pthread_sigmask( SIG_BLOCK, &server_block_set, &old_set );
+    TRACE_(client)( "batch of %u start\n", count );
+    if ((written = writev( ntdll_get_thread_data()->request_fd, vec, nb_vec )) != size + sizeof(batch.u.req))
+    {
+        if (written >= 0) server_protocol_error( "partial write %d\n", written );
+        if (errno == EPIPE) abort_thread(0);
+        if (errno != EFAULT) server_protocol_perror( "write" );
+        ret = STATUS_ACCESS_VIOLATION;
+        done = 0;
+    }
+    else
+    {
+        read_reply_data( &batch.u.reply, sizeof(batch.u.reply) );
+        if (batch.u.reply.reply_header.reply_size)
+            read_reply_data( replies, batch.u.reply.reply_header.reply_size );
+        ret = batch.u.reply.reply_header.error;
+        done = batch.u.reply.batch_reply.count;
+    }
+    TRACE_(client)( "batch of %u end, %u done\n", count, done );
+    pthread_sigmask( SIG_SETMASK, &old_set, NULL );
+
+    for (i = 0, ptr = replies; i < count; i++)
+    {
+        struct __server_request_info *req = reqs[i];
+
+        if (i >= done)
+        {
+            req->u.reply.reply_header.error = ret ? ret : STATUS_INTERNAL_ERROR;
+            req->u.reply.reply_header.reply_size = 0;
+            continue;
+        }
+        memcpy( &req->u.reply, ptr, sizeof(req->u.reply) );
+        len = req->u.reply.reply_header.reply_size;
+        if (len) memcpy( req->reply_data, ptr + sizeof(req->u.reply), len );
+        ptr += sizeof(req->u.reply) + ((len + BATCH_ALIGNMENT - 1) & ~(BATCH_ALIGNMENT - 1));
+    }
+    free( replies );
+    return ret;
+}
+
+
+/***********************************************************************
+ *           server_call_batch
+ *
+ * Perform several independent server calls, using as few round trips as possible.
+ * The requests are performed in order, each one gets its own reply; the returned
+ * status is that of the batch itself, requests that were not performed get it as
+ * their reply status.
+ */
+unsigned int server_call_batch( struct __server_request_info **reqs, unsigned int count )
+{
+    unsigned int i, ret = STATUS_SUCCESS;
+
+    for (i = 0; i < count && !ret; i += BATCH_MAX_COUNT)
+        ret = send_batch( reqs + i, min( count - i, BATCH_MAX_COUNT ));
+
+    for ( ; i < count; i++)
+    {
+        reqs[i]->u.reply.reply_header.error = ret;
+        reqs[i]->u.reply.reply_header.reply_size = 0;
+    }
+    return ret;
+}
+
+
 /***********************************************************************
  *           unixcall_wine_server_call
  *
@@ -686,6 +797,10 @@ static void invoke_system_apc( const apc_call_t *call, apc_result_t *result, BOO
         if (!self) NtClose( wine_server_ptr_handle(call->dup_handle.dst_process) );
         break;
     }
+    case APC_SHARE_COMPLETION:
+        result->type = call->type;
+        completion_share( wine_server_ptr_handle(call->share_completion.handle) );
+        break;
     default:
         server_protocol_error( "get_apc_request: bad type %d\n", call->type );
         break;
@@ -1547,6 +1662,8 @@ static int init_thread_pipe(void)
  */
 void process_exit_wrapper( int status )
 {
+    if (do_fsync()) fsync_dump_profile();
+    virtual_dump_stats();
     close( fd_socket );
     exit( status );
 }
@@ -1814,6 +1931,10 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
     }
     SERVER_END_REQ;
 
+    if (options & DUPLICATE_CLOSE_SOURCE) socket_cache_close( source );
+    if (!ret && source_process == NtCurrentProcess())
+        completion_dup_handle( source, dest_process, dest ? *dest : 0, attributes, options );
+
     server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
 
     if (fd != -1) close( fd );
@@ -1865,6 +1986,8 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
     if (do_esync())
         esync_close( handle );
 
+    completion_close( handle );
+
     SERVER_START_REQ( close_handle )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -1872,6 +1995,9 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
     }
     SERVER_END_REQ;
 
+    /* the cached socket state must be invalidated once the handle can no longer be used */
+    socket_cache_close( handle );
+
     server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
 
     if (fd != -1) close( fd );
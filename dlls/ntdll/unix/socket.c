@@ -853,12 +853,144 @@ static BOOL is_icmp_over_dgram( int fd )
 #endif
 }
 
+static void complete_async( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
+                            IO_STATUS_BLOCK *io, NTSTATUS status, ULONG_PTR information )
+{
+    ULONG_PTR iosb_ptr = iosb_client_ptr(io);
+
+    io->Status = status;
+    io->Information = information;
+    if (event) NtSetEvent( event, NULL );
+    if (apc) NtQueueApcThread( GetCurrentThread(), (PNTAPCFUNC)apc, (ULONG_PTR)apc_user, iosb_ptr, 0 );
+    if (apc_user) add_completion( handle, (ULONG_PTR)apc_user, status, information, FALSE );
+}
+
+#define SOCKET_CACHE_SIZE 65536
+
+static const socket_shm_t *socket_shm;
+/* per handle: socket serial in the high part, handle tag and state table index in the low part */
+static UINT64 socket_cache[SOCKET_CACHE_SIZE];
+static pthread_mutex_t socket_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* map the socket state table if the fast path is enabled */
+static BOOL use_socket_fast_path(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+                                  '_','_','w','i','n','e','_','s','o','c','k','e','t','_','s','t','a','t','e','s',0};
+    static int enabled = -1;
+    UNICODE_STRING name;
+    OBJECT_ATTRIBUTES attr;
+    SIZE_T size = sizeof(*socket_shm);
+    sigset_t sigset;
+    HANDLE section;
+    void *ptr = NULL;
+
+    if (enabled != -1) return enabled;
+
+    server_enter_uninterrupted_section( &socket_cache_mutex, &sigset );
+    if (enabled == -1)
+    {
+        enabled = 0;
+        if (getenv( "WINESOCKETFASTPATH" ) && atoi( getenv( "WINESOCKETFASTPATH" )))
+        {
+            init_unicode_string( &name, nameW );
+            InitializeObjectAttributes( &attr, &name, 0, NULL, NULL );
+            if (!NtOpenSection( &section, SECTION_MAP_READ, &attr ))
+            {
+                if (!NtMapViewOfSection( section, NtCurrentProcess(), &ptr, 0, 0, NULL, &size,
+                                         ViewShare, 0, PAGE_READONLY ))
+                {
+                    socket_shm = ptr;
+                    enabled = 1;
+                }
+                NtClose( section );
+            }
+            if (!enabled) WARN( "socket state table not available, fast path disabled\n" );
+        }
+    }
+    server_leave_uninterrupted_section( &socket_cache_mutex, &sigset );
+    return enabled;
+}
+
+static inline UINT64 *socket_cache_entry( HANDLE handle )
+{
+    return &socket_cache[(HandleToULong( handle ) >> 2) & (SOCKET_CACHE_SIZE - 1)];
+}
+
+static inline unsigned int socket_cache_tag( HANDLE handle )
+{
+    return (HandleToULong( handle ) >> 18) & 0x3ffff;
+}
+
+/* remember the state table entry returned by a recv_socket or send_socket request */
+static void socket_cache_update( HANDLE handle, unsigned int index, unsigned int serial )
+{
+    UINT64 value = 0;
+
+    if (!socket_shm) return;
+    if (serial && index < SOCKET_STATE_COUNT)
+        value = ((UINT64)serial << 32) | (socket_cache_tag( handle ) << 14) | index;
+    __atomic_store_n( socket_cache_entry( handle ), value, __ATOMIC_RELAXED );
+}
+
+/***********************************************************************
+ *           socket_fast_path
+ *
+ * Check whether the server has nothing to do for a recv or send on this
+ * socket that completes immediately, so that it can be done in the client.
+ * Returns the SOCKET_STATE_* flags of the socket, or 0 if it can't.
+ *
+ * If data arrives while the client receives, the server may report a READ
+ * event in the meantime; socket_fast_path_recv_done() then resets it, as a
+ * recv_socket request would have.
+ */
+static unsigned int socket_fast_path( HANDLE handle, unsigned int flag )
+{
+    UINT64 entry, state;
+
+    if (!use_socket_fast_path()) return 0;
+    entry = __atomic_load_n( socket_cache_entry( handle ), __ATOMIC_RELAXED );
+    if (!(entry >> 32) || ((entry >> 14) & 0x3ffff) != socket_cache_tag( handle )) return 0;
+    state = __atomic_load_n( &socket_shm->state[entry & (SOCKET_STATE_COUNT - 1)], __ATOMIC_ACQUIRE );
+    if ((state >> 32) != (entry >> 32) || !(state & flag)) return 0;
+    return (unsigned int)state;
+}
+
+/***********************************************************************
+ *           socket_fast_path_recv_done
+ *
+ * Called after a recv completed in the client. If the server reported a READ
+ * event since the state was checked, it is reset so that the server polls
+ * the socket again.
+ */
+static void socket_fast_path_recv_done( HANDLE handle )
+{
+    if (socket_fast_path( handle, SOCKET_STATE_RECV )) return;
+
+    SERVER_START_REQ( reset_socket_read_event )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        wine_server_call( req );
+    }
+    SERVER_END_REQ;
+}
+
+/***********************************************************************
+ *           socket_cache_close
+ *
+ * Forget the state table entry of a handle once it has been closed.
+ */
+void socket_cache_close( HANDLE handle )
+{
+    if (socket_shm) __atomic_store_n( socket_cache_entry( handle ), 0, __ATOMIC_RELAXED );
+}
+
 static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
                            int fd, struct async_recv_ioctl *async, int force_async )
 {
     HANDLE wait_handle;
     BOOL nonblocking;
-    unsigned int i, status;
+    unsigned int i, status, state;
     ULONG options;
 
     for (i = 0; i < async->count; ++i)
@@ -870,6 +1002,25 @@ static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
         }
     }
 
+    /* complete the recv without the server if data is already there */
+    if (!apc && !(async->unix_flags & MSG_OOB) && !async->icmp_over_dgram &&
+        (state = socket_fast_path( handle, SOCKET_STATE_RECV )))
+    {
+        ULONG_PTR information;
+
+        status = try_recv( fd, async, &information );
+        if (status != STATUS_DEVICE_NOT_READY)
+        {
+            socket_fast_path_recv_done( handle );
+            release_fileio( &async->io );
+            /* apc_user is only a completion value if the server would post a packet */
+            if (!NT_ERROR(status))
+                complete_async( handle, event, NULL, (state & SOCKET_STATE_COMPLETION) ? apc_user : NULL,
+                                io, status, information );
+            return status;
+        }
+    }
+
     SERVER_START_REQ( recv_socket )
     {
         req->force_async = force_async;
@@ -879,6 +1030,7 @@ static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
         wait_handle = wine_server_ptr_handle( reply->wait );
         options     = reply->options;
         nonblocking = reply->nonblocking;
+        socket_cache_update( handle, reply->state_index, reply->state_serial );
     }
     SERVER_END_REQ;
 
@@ -1146,9 +1298,22 @@ static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
 {
     HANDLE wait_handle;
     BOOL nonblocking;
-    unsigned int status;
+    unsigned int status, state;
     ULONG options;
 
+    /* complete the send without the server if it fits in the socket buffer;
+     * errors and short writes are left to the server path below */
+    if (!apc && !(server_flags & SERVER_SOCKET_IO_SYSTEM) &&
+        (state = socket_fast_path( handle, SOCKET_STATE_SEND )) &&
+        !is_icmp_over_dgram( fd ) && !try_send( fd, async ))
+    {
+        complete_async( handle, event, NULL, (state & SOCKET_STATE_COMPLETION) ? apc_user : NULL,
+                        io, STATUS_SUCCESS, async->sent_len );
+        if (async->fd != -1) close( async->fd );
+        release_fileio( &async->io );
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( send_socket )
     {
         req->flags = server_flags;
@@ -1157,6 +1322,8 @@ static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
         wait_handle = wine_server_ptr_handle( reply->wait );
         options     = reply->options;
         nonblocking = reply->nonblocking;
+        if (!(server_flags & SERVER_SOCKET_IO_SYSTEM))
+            socket_cache_update( handle, reply->state_index, reply->state_serial );
     }
     SERVER_END_REQ;
 
@@ -1528,18 +1695,6 @@ static NTSTATUS sock_transmit( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc,
     return status;
 }
 
-static void complete_async( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
-                            IO_STATUS_BLOCK *io, NTSTATUS status, ULONG_PTR information )
-{
-    ULONG_PTR iosb_ptr = iosb_client_ptr(io);
-
-    io->Status = status;
-    io->Information = information;
-    if (event) NtSetEvent( event, NULL );
-    if (apc) NtQueueApcThread( GetCurrentThread(), (PNTAPCFUNC)apc, (ULONG_PTR)apc_user, iosb_ptr, 0 );
-    if (apc_user) add_completion( handle, (ULONG_PTR)apc_user, status, information, FALSE );
-}
-
 
 static NTSTATUS do_getsockopt( HANDLE handle, IO_STATUS_BLOCK *io, int level,
                                int option, void *out_buffer, ULONG out_size )
@@ -110,6 +110,9 @@ static inline ULONGLONG monotonic_counter(void)
 
 #define FUTEX_WAIT 0
 #define FUTEX_WAKE 1
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
+#define FUTEX_CLOCK_REALTIME 256
 
 static int futex_private = 128;
 
@@ -129,6 +132,29 @@ static inline int futex_wait( const LONG *addr, int val, struct timespec *timeou
     return syscall( __NR_futex, addr, FUTEX_WAIT | futex_private, val, timeout, 0, 0 );
 }
 
+static inline int futex_wait_bitset( const LONG *addr, int val, struct timespec *timeout,
+                                     int flags, unsigned int bitset )
+{
+    /* the timeout is absolute */
+#if (defined(__i386__) || defined(__arm__)) && _TIME_BITS==64
+    if (timeout && sizeof(*timeout) != 8)
+    {
+        struct {
+            long tv_sec;
+            long tv_nsec;
+        } timeout32 = { timeout->tv_sec, timeout->tv_nsec };
+
+        return syscall( __NR_futex, addr, FUTEX_WAIT_BITSET | futex_private | flags, val, &timeout32, 0, bitset );
+    }
+#endif
+    return syscall( __NR_futex, addr, FUTEX_WAIT_BITSET | futex_private | flags, val, timeout, 0, bitset );
+}
+
+static inline int futex_wake_bitset( const LONG *addr, int val, unsigned int bitset )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAKE_BITSET | futex_private, val, NULL, 0, bitset );
+}
+
 static inline int futex_wake( const LONG *addr, int val )
 {
     return syscall( __NR_futex, addr, FUTEX_WAKE | futex_private, val, NULL, 0, 0 );
@@ -936,6 +962,7 @@ NTSTATUS WINAPI NtSetInformationJobObject( HANDLE handle, JOBOBJECTINFOCLASS cla
             status = wine_server_call( req );
         }
         SERVER_END_REQ;
+        if (!status) completion_set_server_sources( ((JOBOBJECT_ASSOCIATE_COMPLETION_PORT *)info)->CompletionPort );
         break;
     case JobObjectBasicUIRestrictions:
         status = STATUS_SUCCESS;
@@ -1864,6 +1891,78 @@ NTSTATUS system_time_precise( void *args )
 }
 
 
+/******************************************************************************
+ *              wait_on_address
+ *
+ * Fast path of RtlWaitOnAddress(), waiting on a futex at the address itself.
+ */
+NTSTATUS wait_on_address( void *args )
+{
+#ifdef __linux__
+    struct wait_on_address_params *params = args;
+    const LONG *addr = (const LONG *)(ULONG_PTR)params->addr;
+    struct timespec timespec, *timeout = NULL;
+    int ret, flags = 0;
+
+    if (!use_futexes()) return STATUS_NOT_SUPPORTED;
+
+    if (params->has_timeout)
+    {
+        LONGLONG end = params->timeout;
+
+        if (end >= 0)  /* absolute system time */
+        {
+            end = max( end - (LONGLONG)ticks_from_time_t( 0 ), 0 );
+            flags = FUTEX_CLOCK_REALTIME;
+        }
+        else
+        {
+            clock_gettime( CLOCK_MONOTONIC, &timespec );
+            end = timespec.tv_sec * (ULONGLONG)TICKSPERSEC + timespec.tv_nsec / 100 - end;
+        }
+        timespec.tv_sec = end / (ULONGLONG)TICKSPERSEC;
+        timespec.tv_nsec = (end % TICKSPERSEC) * 100;
+        if (timespec.tv_sec <= 0x7fffffff) timeout = &timespec;
+    }
+
+    while ((ret = futex_wait_bitset( addr, params->value, timeout, flags, params->bitset )) == -1 &&
+           errno == EINTR) ;
+
+    if (!ret) return STATUS_SUCCESS;
+    switch (errno)
+    {
+    case EAGAIN: return STATUS_SUCCESS;  /* the value has changed */
+    case ETIMEDOUT: return STATUS_TIMEOUT;
+    default: return STATUS_NOT_SUPPORTED;
+    }
+#else
+    return STATUS_NOT_SUPPORTED;
+#endif
+}
+
+
+/******************************************************************************
+ *              wake_address
+ *
+ * Fast path of RtlWakeAddressSingle() and RtlWakeAddressAll().
+ */
+NTSTATUS wake_address( void *args )
+{
+#ifdef __linux__
+    struct wake_address_params *params = args;
+    int ret;
+
+    if (!use_futexes()) return STATUS_NOT_SUPPORTED;
+
+    ret = futex_wake_bitset( (const LONG *)(ULONG_PTR)params->addr, params->count, params->bitset );
+    params->woken = max( ret, 0 );
+    return STATUS_SUCCESS;
+#else
+    return STATUS_NOT_SUPPORTED;
+#endif
+}
+
+
 /******************************************************************************
  *              NtCreateKeyedEvent (NTDLL.@)
  */
@@ -1953,6 +2052,421 @@ NTSTATUS WINAPI NtReleaseKeyedEvent( HANDLE handle, const void *key,
 }
 
 
+/* In-process completion ports, enabled with WINELOCALIOCP. The packets posted with
+ * NtSetIoCompletion to an unnamed port created in this process are queued locally and
+ * dequeued without server calls, threads waiting for them on a futex. Once the server
+ * may queue packets to the port as well (files or jobs associated with it, or packets
+ * posted while a thread waits in the server), threads that find the local queue empty
+ * wait in the server instead, and packets posted while they wait are sent there.
+ * Duplicating a handle to another process, or making one inheritable, moves the
+ * queued packets to the server for good. When another process duplicates a handle
+ * out of this one, the server has a thread of this process do the same through
+ * an APC_SHARE_COMPLETION system APC. */
+
+#ifdef __linux__
+
+#define LOCAL_COMPLETION_BLOCK_SIZE  4096
+#define LOCAL_COMPLETION_POLL        32
+
+struct local_completion
+{
+    LONG             refcount;
+    unsigned int     handles;        /* handles to the port in this process */
+    pthread_mutex_t  mutex;
+    FILE_IO_COMPLETION_INFORMATION *msgs;  /* ring of queued packets */
+    unsigned int     head;
+    unsigned int     count;
+    unsigned int     size;
+    LONG             seq;            /* futex, incremented when packets are queued */
+    unsigned int     waiters;        /* threads waiting on the futex */
+    unsigned int     server_waiters; /* threads waiting in the server */
+    unsigned int     polls;          /* local dequeues since the server queue was checked */
+    BOOL             server_sources; /* the server may have queued packets */
+    BOOL             shared;         /* a handle was given to another process */
+    BOOL             closed;
+};
+
+static struct local_completion **local_completion_blocks[256];
+static pthread_mutex_t local_completion_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static BOOL use_local_completions(void)
+{
+    static int enabled = -1;
+
+    if (enabled == -1)
+    {
+        const char *env = getenv( "WINELOCALIOCP" );
+        enabled = env && atoi( env ) && use_futexes();
+    }
+    return enabled;
+}
+
+static struct local_completion **local_completion_entry( HANDLE handle, BOOL alloc )
+{
+    unsigned int idx = (wine_server_obj_handle( handle ) >> 2) - 1;
+    unsigned int block_idx = idx / LOCAL_COMPLETION_BLOCK_SIZE;
+
+    if (block_idx >= ARRAY_SIZE(local_completion_blocks)) return NULL;
+    if (!local_completion_blocks[block_idx])
+    {
+        if (!alloc) return NULL;
+        if (!(local_completion_blocks[block_idx] = calloc( LOCAL_COMPLETION_BLOCK_SIZE,
+                                                           sizeof(*local_completion_blocks[block_idx]) )))
+            return NULL;
+    }
+    return &local_completion_blocks[block_idx][idx % LOCAL_COMPLETION_BLOCK_SIZE];
+}
+
+static void release_local_completion( struct local_completion *port )
+{
+    if (InterlockedDecrement( &port->refcount )) return;
+    pthread_mutex_destroy( &port->mutex );
+    free( port->msgs );
+    free( port );
+}
+
+/* add a handle to the port, must be called with local_completion_mutex held */
+static void add_local_completion_handle( struct local_completion *port, HANDLE handle )
+{
+    struct local_completion **entry = local_completion_entry( handle, TRUE );
+
+    if (!entry) return;
+    if (*entry) release_local_completion( *entry );
+    InterlockedIncrement( &port->refcount );
+    port->handles++;
+    *entry = port;
+}
+
+static struct local_completion *grab_local_completion( HANDLE handle )
+{
+    struct local_completion **entry, *port = NULL;
+    sigset_t sigset;
+
+    if (!use_local_completions()) return NULL;
+
+    server_enter_uninterrupted_section( &local_completion_mutex, &sigset );
+    if ((entry = local_completion_entry( handle, FALSE )) && (port = *entry))
+        InterlockedIncrement( &port->refcount );
+    server_leave_uninterrupted_section( &local_completion_mutex, &sigset );
+    return port;
+}
+
+/* the server may queue packets to the port, stop waiting on the futex */
+static void set_local_completion_server_sources( struct local_completion *port )
+{
+    if (port->server_sources) return;
+    port->server_sources = TRUE;
+    InterlockedIncrement( &port->seq );
+    if (port->waiters) futex_wake( &port->seq, INT_MAX );
+}
+
+static void create_local_completion( HANDLE handle )
+{
+    struct local_completion *port;
+    sigset_t sigset;
+
+    if (!(port = calloc( 1, sizeof(*port) ))) return;
+    pthread_mutex_init( &port->mutex, NULL );
+    port->refcount = 1;
+
+    server_enter_uninterrupted_section( &local_completion_mutex, &sigset );
+    add_local_completion_handle( port, handle );
+    server_leave_uninterrupted_section( &local_completion_mutex, &sigset );
+    release_local_completion( port );
+}
+
+/* queue a packet locally, fails if it has to be sent to the server */
+static BOOL post_local_completion( struct local_completion *port, ULONG_PTR key, ULONG_PTR value,
+                                   NTSTATUS status, SIZE_T info )
+{
+    FILE_IO_COMPLETION_INFORMATION *msg, *msgs;
+    unsigned int size;
+    sigset_t sigset;
+    BOOL wake;
+
+    server_enter_uninterrupted_section( &port->mutex, &sigset );
+    if (port->shared || port->server_waiters)
+    {
+        set_local_completion_server_sources( port );
+        server_leave_uninterrupted_section( &port->mutex, &sigset );
+        return FALSE;
+    }
+    if (port->count == port->size)
+    {
+        size = max( 64, port->size * 2 );
+        if (!(msgs = malloc( size * sizeof(*msgs) )))
+        {
+            server_leave_uninterrupted_section( &port->mutex, &sigset );
+            return FALSE;
+        }
+        if (port->count)
+        {
+            unsigned int first = min( port->count, port->size - port->head );
+            memcpy( msgs, port->msgs + port->head, first * sizeof(*msgs) );
+            memcpy( msgs + first, port->msgs, (port->count - first) * sizeof(*msgs) );
+        }
+        free( port->msgs );
+        port->msgs = msgs;
+        port->size = size;
+        port->head = 0;
+    }
+    msg = &port->msgs[(port->head + port->count++) % port->size];
+    msg->CompletionKey             = key;
+    msg->CompletionValue           = value;
+    msg->IoStatusBlock.Status      = status;
+    msg->IoStatusBlock.Information = info;
+    InterlockedIncrement( &port->seq );
+    wake = port->waiters != 0;
+    server_leave_uninterrupted_section( &port->mutex, &sigset );
+
+    if (wake) futex_wake( &port->seq, 1 );
+    return TRUE;
+}
+
+/***********************************************************************
+ *           remove_local_completion
+ *
+ * Dequeue up to count local packets, waiting on the futex if needed. Returns
+ * STATUS_PENDING if the caller has to wait in the server, in which case
+ * end_server_completion_wait() must be called once it is done.
+ */
+static NTSTATUS remove_local_completion( struct local_completion *port, HANDLE handle,
+                                         FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
+                                         ULONG *written, const LARGE_INTEGER *timeout, BOOLEAN alertable )
+{
+    static const LARGE_INTEGER zero_timeout;
+    struct timespec timespec, *end = NULL;
+    BOOL server_first = FALSE, timed_out = FALSE;
+    unsigned int i, seq;
+    sigset_t sigset;
+    LONGLONG abs;
+
+    /* packets from the server would wait behind a busy local queue, check for them from time to time */
+    if (port->server_sources && (do_esync() || do_fsync()) &&
+        !(InterlockedIncrement( (LONG *)&port->polls ) % LOCAL_COMPLETION_POLL))
+        server_first = NtWaitForSingleObject( handle, FALSE, &zero_timeout ) == WAIT_OBJECT_0;
+
+    if (timeout && timeout->QuadPart != TIMEOUT_INFINITE)
+    {
+        abs = timeout->QuadPart;
+        if (abs < 0)
+        {
+            LARGE_INTEGER now;
+            NtQuerySystemTime( &now );
+            abs = now.QuadPart - abs;
+        }
+        abs = max( abs - (LONGLONG)ticks_from_time_t( 0 ), 0 );
+        timespec.tv_sec = abs / (ULONGLONG)TICKSPERSEC;
+        timespec.tv_nsec = (abs % TICKSPERSEC) * 100;
+        if (timespec.tv_sec <= 0x7fffffff) end = &timespec;
+    }
+
+    server_enter_uninterrupted_section( &port->mutex, &sigset );
+    for (;;)
+    {
+        if (port->count && !server_first)
+        {
+            *written = min( count, port->count );
+            for (i = 0; i < *written; i++)
+            {
+                info[i] = port->msgs[port->head];
+                port->head = (port->head + 1) % port->size;
+            }
+            port->count -= *written;
+            server_leave_uninterrupted_section( &port->mutex, &sigset );
+            return STATUS_SUCCESS;
+        }
+        if (port->server_sources || port->shared || alertable || server_first)
+        {
+            port->server_waiters++;
+            server_leave_uninterrupted_section( &port->mutex, &sigset );
+            return STATUS_PENDING;
+        }
+        if (port->closed || timed_out || (timeout && !timeout->QuadPart))
+        {
+            server_leave_uninterrupted_section( &port->mutex, &sigset );
+            return port->closed ? STATUS_ABANDONED_WAIT_0 : STATUS_TIMEOUT;
+        }
+        port->waiters++;
+        seq = port->seq;
+        server_leave_uninterrupted_section( &port->mutex, &sigset );
+
+        if (futex_wait_bitset( &port->seq, seq, end, FUTEX_CLOCK_REALTIME, ~0u ) == -1 && errno == ETIMEDOUT)
+            timed_out = TRUE;
+
+        server_enter_uninterrupted_section( &port->mutex, &sigset );
+        port->waiters--;
+    }
+}
+
+static void end_server_completion_wait( struct local_completion *port )
+{
+    sigset_t sigset;
+
+    server_enter_uninterrupted_section( &port->mutex, &sigset );
+    port->server_waiters--;
+    server_leave_uninterrupted_section( &port->mutex, &sigset );
+}
+
+static ULONG local_completion_depth( struct local_completion *port )
+{
+    return ReadNoFence( (LONG *)&port->count );
+}
+
+/***********************************************************************
+ *           completion_set_server_sources
+ *
+ * Called when files or jobs are associated with a completion port.
+ */
+void completion_set_server_sources( HANDLE handle )
+{
+    struct local_completion *port;
+    sigset_t sigset;
+
+    if (!(port = grab_local_completion( handle ))) return;
+    server_enter_uninterrupted_section( &port->mutex, &sigset );
+    set_local_completion_server_sources( port );
+    server_leave_uninterrupted_section( &port->mutex, &sigset );
+    release_local_completion( port );
+}
+
+/* a handle to the port may be used by another process, move the queued packets to the server */
+static void share_local_completion( struct local_completion *port, HANDLE handle )
+{
+    struct __server_request_info reqs[16], *ptrs[16];
+    FILE_IO_COMPLETION_INFORMATION *msg;
+    unsigned int count;
+    sigset_t sigset;
+
+    server_enter_uninterrupted_section( &port->mutex, &sigset );
+    port->shared = TRUE;
+    set_local_completion_server_sources( port );
+    while (port->count)
+    {
+        /* move the queued packets to the server a batch at a time */
+        for (count = 0; count < ARRAY_SIZE(reqs) && port->count; count++)
+        {
+            struct add_completion_request *req = &reqs[count].u.req.add_completion_request;
+
+            msg = &port->msgs[port->head];
+            port->head = (port->head + 1) % port->size;
+            port->count--;
+            memset( &reqs[count].u.req, 0, sizeof(reqs[count].u.req) );
+            reqs[count].name = "add_completion";
+            reqs[count].u.req.request_header.req = REQ_add_completion;
+            reqs[count].data_count = 0;
+            reqs[count].reply_data = NULL;
+            req->handle      = wine_server_obj_handle( handle );
+            req->ckey        = msg->CompletionKey;
+            req->cvalue      = msg->CompletionValue;
+            req->status      = msg->IoStatusBlock.Status;
+            req->information = msg->IoStatusBlock.Information;
+            ptrs[count] = &reqs[count];
+        }
+        server_call_batch( ptrs, count );
+    }
+    server_leave_uninterrupted_section( &port->mutex, &sigset );
+}
+
+/***********************************************************************
+ *           completion_dup_handle
+ *
+ * Track a completion port handle duplicated from the current process. Once a
+ * handle is given to another process, or made inheritable, the locally queued
+ * packets are moved to the server.
+ */
+void completion_dup_handle( HANDLE source, HANDLE dest_process, HANDLE dest, ULONG attributes, ULONG options )
+{
+    struct local_completion *port;
+    sigset_t sigset;
+
+    if (!(port = grab_local_completion( source ))) return;
+
+    if (dest && dest_process == NtCurrentProcess())
+    {
+        server_enter_uninterrupted_section( &local_completion_mutex, &sigset );
+        add_local_completion_handle( port, dest );
+        server_leave_uninterrupted_section( &local_completion_mutex, &sigset );
+        if (attributes & OBJ_INHERIT) share_local_completion( port, dest );
+    }
+    else if (dest) share_local_completion( port, source );
+    release_local_completion( port );
+
+    if (options & DUPLICATE_CLOSE_SOURCE) completion_close( source );
+}
+
+/***********************************************************************
+ *           completion_share
+ *
+ * Called when a handle is made inheritable, or duplicated out of the process by another one.
+ */
+void completion_share( HANDLE handle )
+{
+    struct local_completion *port;
+
+    if (!(port = grab_local_completion( handle ))) return;
+    share_local_completion( port, handle );
+    release_local_completion( port );
+}
+
+/***********************************************************************
+ *           completion_close
+ *
+ * Drop the local state of a completion port handle before it is closed.
+ */
+void completion_close( HANDLE handle )
+{
+    struct local_completion **entry, *port = NULL;
+    sigset_t sigset;
+
+    if (!use_local_completions()) return;
+
+    server_enter_uninterrupted_section( &local_completion_mutex, &sigset );
+    if ((entry = local_completion_entry( handle, FALSE )) && (port = *entry))
+    {
+        *entry = NULL;
+        port->handles--;
+    }
+    server_leave_uninterrupted_section( &local_completion_mutex, &sigset );
+    if (!port) return;
+
+    if (!port->handles)
+    {
+        server_enter_uninterrupted_section( &port->mutex, &sigset );
+        port->closed = TRUE;
+        InterlockedIncrement( &port->seq );
+        if (port->waiters) futex_wake( &port->seq, INT_MAX );
+        server_leave_uninterrupted_section( &port->mutex, &sigset );
+    }
+    release_local_completion( port );
+}
+
+#else  /* __linux__ */
+
+struct local_completion;
+
+static struct local_completion *grab_local_completion( HANDLE handle ) { return NULL; }
+static void release_local_completion( struct local_completion *port ) { }
+static BOOL use_local_completions(void) { return FALSE; }
+static void create_local_completion( HANDLE handle ) { }
+static BOOL post_local_completion( struct local_completion *port, ULONG_PTR key, ULONG_PTR value,
+                                   NTSTATUS status, SIZE_T info ) { return FALSE; }
+static NTSTATUS remove_local_completion( struct local_completion *port, HANDLE handle,
+                                         FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
+                                         ULONG *written, const LARGE_INTEGER *timeout, BOOLEAN alertable )
+{
+    return STATUS_PENDING;
+}
+static void end_server_completion_wait( struct local_completion *port ) { }
+static ULONG local_completion_depth( struct local_completion *port ) { return 0; }
+void completion_set_server_sources( HANDLE handle ) { }
+void completion_dup_handle( HANDLE source, HANDLE dest_process, HANDLE dest, ULONG attributes, ULONG options ) { }
+void completion_share( HANDLE handle ) { }
+void completion_close( HANDLE handle ) { }
+
+#endif  /* __linux__ */
+
+
 /***********************************************************************
  *             NtCreateIoCompletion (NTDLL.@)
  */
@@ -1960,11 +2474,16 @@ NTSTATUS WINAPI NtCreateIoCompletion( HANDLE *handle, ACCESS_MASK access, OBJECT
                                       ULONG threads )
 {
     unsigned int status;
+    BOOL local;
     data_size_t len;
     struct object_attributes *objattr;
 
     TRACE( "(%p, %x, %p, %d)\n", handle, (int)access, attr, (int)threads );
 
+    /* ports that other processes can open or inherit are left to the server */
+    local = use_local_completions() &&
+            !(attr && ((attr->ObjectName && attr->ObjectName->Length) || (attr->Attributes & OBJ_INHERIT)));
+
     *handle = 0;
     if ((status = alloc_object_attributes( attr, &objattr, &len ))) return status;
 
@@ -1972,11 +2491,14 @@ NTSTATUS WINAPI NtCreateIoCompletion( HANDLE *handle, ACCESS_MASK access, OBJECT
     {
         req->access     = access;
         req->concurrent = threads;
+        req->local      = local;
         wine_server_add_data( req, objattr, len );
         if (!(status = wine_server_call( req ))) *handle = wine_server_ptr_handle( reply->handle );
     }
     SERVER_END_REQ;
 
+    if (!status && local) create_local_completion( *handle );
+
     free( objattr );
     return status;
 }
@@ -2013,10 +2535,18 @@ NTSTATUS WINAPI NtOpenIoCompletion( HANDLE *handle, ACCESS_MASK access, const OB
 NTSTATUS WINAPI NtSetIoCompletion( HANDLE handle, ULONG_PTR key, ULONG_PTR value,
                                    NTSTATUS status, SIZE_T count )
 {
+    struct local_completion *port;
     unsigned int ret;
 
     TRACE( "(%p, %lx, %lx, %x, %lx)\n", handle, key, value, (int)status, count );
 
+    if ((port = grab_local_completion( handle )))
+    {
+        BOOL posted = post_local_completion( port, key, value, status, count );
+        release_local_completion( port );
+        if (posted) return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( add_completion )
     {
         req->handle      = wine_server_obj_handle( handle );
@@ -2031,17 +2561,12 @@ NTSTATUS WINAPI NtSetIoCompletion( HANDLE handle, ULONG_PTR key, ULONG_PTR value
 }
 
 
-/***********************************************************************
- *             NtRemoveIoCompletion (NTDLL.@)
- */
-NTSTATUS WINAPI NtRemoveIoCompletion( HANDLE handle, ULONG_PTR *key, ULONG_PTR *value,
-                                      IO_STATUS_BLOCK *io, LARGE_INTEGER *timeout )
+static NTSTATUS remove_server_completion( HANDLE handle, ULONG_PTR *key, ULONG_PTR *value,
+                                         IO_STATUS_BLOCK *io, LARGE_INTEGER *timeout )
 {
     HANDLE wait_handle = NULL;
     unsigned int status;
 
-    TRACE( "(%p, %p, %p, %p, %p)\n", handle, key, value, io, timeout );
-
     if (timeout && !timeout->QuadPart && (do_esync() || do_fsync()))
     {
         status = NtWaitForSingleObject( handle, FALSE, timeout );
@@ -2084,17 +2609,45 @@ NTSTATUS WINAPI NtRemoveIoCompletion( HANDLE handle, ULONG_PTR *key, ULONG_PTR *
 
 
 /***********************************************************************
- *             NtRemoveIoCompletionEx (NTDLL.@)
+ *             NtRemoveIoCompletion (NTDLL.@)
  */
-NTSTATUS WINAPI NtRemoveIoCompletionEx( HANDLE handle, FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
-                                        ULONG *written, LARGE_INTEGER *timeout, BOOLEAN alertable )
+NTSTATUS WINAPI NtRemoveIoCompletion( HANDLE handle, ULONG_PTR *key, ULONG_PTR *value,
+                                      IO_STATUS_BLOCK *io, LARGE_INTEGER *timeout )
+{
+    FILE_IO_COMPLETION_INFORMATION info;
+    struct local_completion *port;
+    unsigned int status;
+    ULONG written;
+
+    TRACE( "(%p, %p, %p, %p, %p)\n", handle, key, value, io, timeout );
+
+    if (!(port = grab_local_completion( handle )))
+        return remove_server_completion( handle, key, value, io, timeout );
+
+    status = remove_local_completion( port, handle, &info, 1, &written, timeout, FALSE );
+    if (status == STATUS_PENDING)
+    {
+        status = remove_server_completion( handle, key, value, io, timeout );
+        end_server_completion_wait( port );
+    }
+    else if (!status)
+    {
+        *key   = info.CompletionKey;
+        *value = info.CompletionValue;
+        *io    = info.IoStatusBlock;
+    }
+    release_local_completion( port );
+    return status;
+}
+
+
+static NTSTATUS remove_server_completions( HANDLE handle, FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
+                                           ULONG *written, LARGE_INTEGER *timeout, BOOLEAN alertable )
 {
     HANDLE wait_handle = NULL;
     unsigned int status;
     ULONG i = 0;
 
-    TRACE( "%p %p %u %p %p %u\n", handle, info, (int)count, written, timeout, alertable );
-
     if (timeout && !timeout->QuadPart && (do_esync() || do_fsync()))
     {
         status = NtWaitForSingleObject( handle, alertable, timeout );
@@ -2154,12 +2707,39 @@ done:
 }
 
 
+/***********************************************************************
+ *             NtRemoveIoCompletionEx (NTDLL.@)
+ */
+NTSTATUS WINAPI NtRemoveIoCompletionEx( HANDLE handle, FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
+                                        ULONG *written, LARGE_INTEGER *timeout, BOOLEAN alertable )
+{
+    struct local_completion *port;
+    unsigned int status;
+
+    TRACE( "%p %p %u %p %p %u\n", handle, info, (int)count, written, timeout, alertable );
+
+    if (!(port = grab_local_completion( handle )))
+        return remove_server_completions( handle, info, count, written, timeout, alertable );
+
+    status = remove_local_completion( port, handle, info, count, written, timeout, alertable );
+    if (status == STATUS_PENDING)
+    {
+        status = remove_server_completions( handle, info, count, written, timeout, alertable );
+        end_server_completion_wait( port );
+    }
+    else if (status) *written = 1;
+    release_local_completion( port );
+    return status;
+}
+
+
 /***********************************************************************
  *             NtQueryIoCompletion (NTDLL.@)
  */
 NTSTATUS WINAPI NtQueryIoCompletion( HANDLE handle, IO_COMPLETION_INFORMATION_CLASS class,
                                      void *buffer, ULONG len, ULONG *ret_len )
 {
+    struct local_completion *port;
     unsigned int status;
 
     TRACE( "(%p, %d, %p, 0x%x, %p)\n", handle, class, buffer, (int)len, ret_len );
@@ -2180,6 +2760,11 @@ NTSTATUS WINAPI NtQueryIoCompletion( HANDLE handle, IO_COMPLETION_INFORMATION_CL
                 if (!(status = wine_server_call( req ))) *info = reply->depth;
             }
             SERVER_END_REQ;
+            if (!status && (port = grab_local_completion( handle )))
+            {
+                *info += local_completion_depth( port );
+                release_local_completion( port );
+            }
         }
         else status = STATUS_INFO_LENGTH_MISMATCH;
         break;
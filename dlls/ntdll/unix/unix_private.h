@@ -134,6 +134,11 @@ static const LONG teb_offset = 0x2000;
 #define FILE_WRITE_TO_END_OF_FILE      ((LONGLONG)-1)
 #define FILE_USE_FILE_POINTER_POSITION ((LONGLONG)-2)
 
+/* SameTebFlags bits used by the loader */
+#define TEB_SKIP_THREAD_ATTACH  0x0008
+#define TEB_LOADER_WORKER       0x2000
+#define TEB_SKIP_LOADER_INIT    0x4000
+
 /* callbacks to PE ntdll from the Unix side */
 extern void *pDbgUiRemoteBreakin;
 extern void *pKiRaiseUserExceptionDispatcher;
@@ -208,6 +213,7 @@ extern NTSTATUS load_start_exe( WCHAR **image, void **module );
 extern void start_server( BOOL debug );
 
 extern unsigned int server_call_unlocked( void *req_ptr );
+extern unsigned int server_call_batch( struct __server_request_info **reqs, unsigned int count );
 extern void server_enter_uninterrupted_section( pthread_mutex_t *mutex, sigset_t *sigset );
 extern void server_leave_uninterrupted_section( pthread_mutex_t *mutex, sigset_t *sigset );
 extern unsigned int server_select( const select_op_t *select_op, data_size_t size, UINT flags,
@@ -267,6 +273,14 @@ extern NTSTATUS get_thread_context( HANDLE handle, void *context, BOOL *self, US
 extern unsigned int alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_attributes **ret,
                                              data_size_t *ret_len );
 extern NTSTATUS system_time_precise( void *args );
+extern NTSTATUS wait_on_address( void *args );
+extern NTSTATUS wake_address( void *args );
+extern void completion_set_server_sources( HANDLE handle );
+extern void completion_dup_handle( HANDLE source, HANDLE dest_process, HANDLE dest, ULONG attributes, ULONG options );
+extern void completion_share( HANDLE handle );
+extern void completion_close( HANDLE handle );
+extern NTSTATUS io_uring_init( void *args );
+extern NTSTATUS io_uring_thread( void *args );
 
 extern void *steamclient_handle_fault( LPCVOID addr, DWORD err );
 extern void *anon_mmap_fixed( void *start, size_t size, int prot, int flags );
@@ -304,6 +318,7 @@ extern SIZE_T virtual_uninterrupted_read_memory( const void *addr, void *buffer,
 extern NTSTATUS virtual_uninterrupted_write_memory( void *addr, const void *buffer, SIZE_T size );
 extern void virtual_set_force_exec( BOOL enable );
 extern void virtual_set_large_address_space(void);
+extern void virtual_dump_stats(void);
 extern void virtual_fill_image_information( const pe_image_info_t *pe_info,
                                             SECTION_IMAGE_INFORMATION *info );
 extern void *get_builtin_so_handle( void *module );
@@ -345,6 +360,7 @@ extern NTSTATUS sock_read( HANDLE handle, int fd, HANDLE event, PIO_APC_ROUTINE
                            IO_STATUS_BLOCK *io, void *buffer, ULONG length );
 extern NTSTATUS sock_write( HANDLE handle, int fd, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
                             IO_STATUS_BLOCK *io, const void *buffer, ULONG length );
+extern void socket_cache_close( HANDLE handle );
 extern NTSTATUS tape_DeviceIoControl( HANDLE device, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
                                       IO_STATUS_BLOCK *io, UINT code, void *in_buffer,
                                       UINT in_size, void *out_buffer, UINT out_size );
@@ -257,6 +257,7 @@ struct file_view
 #define VPROT_PLACEHOLDER      0x0400
 #define VPROT_FREE_PLACEHOLDER 0x0800
 #define VPROT_NATIVE           0x1000
+#define VPROT_LARGE_PAGES      0x2000  /* view is mapped with host huge pages */
 
 /* Conversion from VPROT_* to Win32 flags */
 static const BYTE VIRTUAL_Win32Flags[16] =
@@ -282,6 +283,13 @@ static const BYTE VIRTUAL_Win32Flags[16] =
 static struct wine_rb_tree views_tree;
 static pthread_mutex_t virtual_mutex;
 
+/* Sequence counter for the lock-free queries, odd while the views tree, the view
+ * fields or the page protection bytes are being changed. View structures and
+ * page protection tables are never unmapped, so readers can safely walk them
+ * and only have to validate the result against the counter. */
+static LONG views_seq;
+static unsigned int views_write_depth;  /* nesting of views_write_begin, protected by virtual_mutex */
+
 static const UINT page_shift = 12;
 static const UINT_PTR page_mask = 0xfff;
 static const UINT_PTR granularity_mask = 0xffff;
@@ -303,6 +311,8 @@ static void *working_set_limit   = (void *)0x7fff0000;
 #endif
 
 static void *host_addr_space_limit;  /* top of the host virtual address space */
+static size_t large_page_size;       /* host huge page size, 0 if not supported */
+static BOOL use_huge_pages;          /* request transparent huge pages for large private views */
 
 static struct file_view *arm64ec_view;
 static const ptrdiff_t max_try_map_step = 0x40000000;
@@ -351,6 +361,7 @@ static const size_t view_block_size = 0x100000;
 static void *preload_reserve_start;
 static void *preload_reserve_end;
 static BOOL force_exec_prot;  /* whether to force PROT_EXEC on all PROT_READ mmaps */
+static char *reloc_cache_dir;  /* directory of the relocated image cache, set with WINERELOCCACHE */
 
 struct range_entry
 {
@@ -361,6 +372,80 @@ struct range_entry
 static struct range_entry *free_ranges;
 static struct range_entry *free_ranges_end;
 
+/* Operation statistics, enabled with WINEVMSTATS. The counters are dumped along
+ * with a histogram of the virtual_mutex hold times when the process exits. */
+
+enum vm_op
+{
+    VM_OP_ALLOCATE,
+    VM_OP_FREE,
+    VM_OP_PROTECT,
+    VM_OP_MAP,
+    VM_OP_UNMAP,
+    VM_OP_QUERY,
+    VM_OP_FAULT,
+    VM_OP_COUNT
+};
+
+#define VM_HOLD_MIN_SHIFT   8   /* first histogram bucket is below 256ns */
+#define VM_HOLD_BUCKETS     20  /* last histogram bucket is 64ms and above */
+
+static BOOL vm_stats;
+static LONG64 vm_op_count[VM_OP_COUNT];
+static LONG64 vm_op_failed[VM_OP_COUNT];
+static LONG64 vm_hold_histogram[VM_HOLD_BUCKETS];  /* the hold statistics are protected by virtual_mutex */
+static LONG64 vm_hold_count;
+static LONG64 vm_hold_total;
+static LONG64 vm_hold_max;
+static LONG64 vm_hold_start;
+static unsigned int vm_hold_depth;
+
+static inline LONG64 vm_stats_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * (LONG64)1000000000 + ts.tv_nsec;
+}
+
+static inline void vm_stats_op( enum vm_op op, NTSTATUS status )
+{
+    if (!vm_stats) return;
+    InterlockedIncrement64( &vm_op_count[op] );
+    if (NT_ERROR( status )) InterlockedIncrement64( &vm_op_failed[op] );
+}
+
+static inline void vm_stats_hold_begin(void)
+{
+    if (vm_stats && !vm_hold_depth++) vm_hold_start = vm_stats_time();
+}
+
+static void vm_stats_hold_end(void)
+{
+    LONG64 time;
+    unsigned int bucket = 0;
+
+    if (!vm_stats || --vm_hold_depth) return;
+    time = vm_stats_time() - vm_hold_start;
+    while (bucket < VM_HOLD_BUCKETS - 1 && time >> (VM_HOLD_MIN_SHIFT + bucket)) bucket++;
+    vm_hold_histogram[bucket]++;
+    vm_hold_count++;
+    vm_hold_total += time;
+    if (time > vm_hold_max) vm_hold_max = time;
+}
+
+static inline void virtual_lock( sigset_t *sigset )
+{
+    server_enter_uninterrupted_section( &virtual_mutex, sigset );
+    vm_stats_hold_begin();
+}
+
+static inline void virtual_unlock( sigset_t *sigset )
+{
+    vm_stats_hold_end();
+    server_leave_uninterrupted_section( &virtual_mutex, sigset );
+}
+
 
 static inline BOOL is_beyond_limit( const void *addr, size_t size, const void *limit )
 {
@@ -998,7 +1083,7 @@ void *get_builtin_so_handle( void *module )
     void *ret = NULL;
     struct builtin_module *builtin;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     LIST_FOR_EACH_ENTRY( builtin, &builtin_modules, struct builtin_module, entry )
     {
         if (builtin->module != module) continue;
@@ -1006,7 +1091,7 @@ void *get_builtin_so_handle( void *module )
         if (ret) builtin->refcount++;
         break;
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return ret;
 }
 
@@ -1021,7 +1106,7 @@ static NTSTATUS get_builtin_unix_funcs( void *module, BOOL wow, const void **fun
     NTSTATUS status = STATUS_DLL_NOT_FOUND;
     struct builtin_module *builtin;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     LIST_FOR_EACH_ENTRY( builtin, &builtin_modules, struct builtin_module, entry )
     {
         if (builtin->module != module) continue;
@@ -1034,7 +1119,7 @@ static NTSTATUS get_builtin_unix_funcs( void *module, BOOL wow, const void **fun
         }
         break;
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return status;
 }
 
@@ -1048,7 +1133,7 @@ NTSTATUS load_builtin_unixlib( void *module, const char *name )
     NTSTATUS status = STATUS_SUCCESS;
     struct builtin_module *builtin;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     LIST_FOR_EACH_ENTRY( builtin, &builtin_modules, struct builtin_module, entry )
     {
         if (builtin->module != module) continue;
@@ -1057,7 +1142,7 @@ NTSTATUS load_builtin_unixlib( void *module, const char *name )
         if (!builtin->unix_handle) builtin->unix_handle = dlopen( builtin->unix_path, RTLD_NOW );
         break;
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return status;
 }
 
@@ -1248,6 +1333,55 @@ static inline int is_view_valloc( const struct file_view *view )
     return !(view->protect & (SEC_FILE | SEC_RESERVE | SEC_COMMIT));
 }
 
+/***********************************************************************
+ *           views_write_begin
+ *
+ * Start a change visible to lock-free readers. virtual_mutex must be held by caller.
+ */
+static void views_write_begin(void)
+{
+    if (views_write_depth++) return;
+    WriteNoFence( &views_seq, views_seq + 1 );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+
+/***********************************************************************
+ *           views_write_end
+ *
+ * End a change started with views_write_begin. virtual_mutex must be held by caller.
+ */
+static void views_write_end(void)
+{
+    if (--views_write_depth) return;
+    WriteRelease( &views_seq, views_seq + 1 );
+}
+
+
+/***********************************************************************
+ *           views_read_begin
+ *
+ * Start a lock-free read, returns FALSE if a change is in progress.
+ */
+static BOOL views_read_begin( LONG *seq )
+{
+    *seq = ReadAcquire( &views_seq );
+    return !(*seq & 1);
+}
+
+
+/***********************************************************************
+ *           views_read_end
+ *
+ * Check that nothing changed during a lock-free read.
+ */
+static BOOL views_read_end( LONG seq )
+{
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    return ReadNoFence( &views_seq ) == seq;
+}
+
+
 /***********************************************************************
  *           get_page_vprot
  *
@@ -1331,6 +1465,7 @@ static void set_page_vprot( const void *addr, size_t size, BYTE vprot )
     size_t idx = (size_t)addr >> page_shift;
     size_t end = ((size_t)addr + size + page_mask) >> page_shift;
 
+    views_write_begin();
 #ifdef _WIN64
     while (idx >> pages_vprot_shift != end >> pages_vprot_shift)
     {
@@ -1342,6 +1477,7 @@ static void set_page_vprot( const void *addr, size_t size, BYTE vprot )
 #else
     memset( pages_vprot + idx, vprot, end - idx );
 #endif
+    views_write_end();
 }
 
 
@@ -1355,6 +1491,7 @@ static void set_page_vprot_bits( const void *addr, size_t size, BYTE set, BYTE c
     size_t idx = (size_t)addr >> page_shift;
     size_t end = ((size_t)addr + size + page_mask) >> page_shift;
 
+    views_write_begin();
 #ifdef _WIN64
     for ( ; idx < end; idx++)
     {
@@ -1364,6 +1501,7 @@ static void set_page_vprot_bits( const void *addr, size_t size, BYTE set, BYTE c
 #else
     for ( ; idx < end; idx++) pages_vprot[idx] = (pages_vprot[idx] & ~clear) | set;
 #endif
+    views_write_end();
 }
 
 
@@ -1547,21 +1685,42 @@ static void VIRTUAL_Dump(void)
     struct file_view *view;
 
     TRACE( "Dump of all virtual memory views:\n" );
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     WINE_RB_FOR_EACH_ENTRY( view, &views_tree, struct file_view, entry )
     {
         dump_view( view );
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
 }
 #endif
 
 
+/***********************************************************************
+ *           get_free_ranges_info
+ *
+ * Return the number of free ranges, and the size of the largest one.
+ * virtual_mutex must be held by caller.
+ */
+static unsigned int get_free_ranges_info( SIZE_T *largest, SIZE_T *total )
+{
+    struct range_entry *r;
+
+    *largest = *total = 0;
+    for (r = free_ranges; r != free_ranges_end; ++r)
+    {
+        SIZE_T size = (char *)r->end - (char *)r->base;
+        *total += size;
+        if (size > *largest) *largest = size;
+    }
+    return free_ranges_end - free_ranges;
+}
+
 static void dump_memory_statistics(void)
 {
     struct file_view *view;
     SIZE_T anon_reserved = 0, anon_committed = 0, mapped = 0, mapped_committed = 0, marked_native = 0;
-    SIZE_T size, c_size;
+    SIZE_T size, c_size, largest_free, total_free;
+    unsigned int views = 0, ranges;
     char *base;
     BYTE vprot;
 
@@ -1569,6 +1728,7 @@ static void dump_memory_statistics(void)
 
     WINE_RB_FOR_EACH_ENTRY( view, &views_tree, struct file_view, entry )
     {
+        views++;
         if (view->protect & VPROT_NATIVE)
         {
             marked_native += view->size;
@@ -1602,6 +1762,60 @@ static void dump_memory_statistics(void)
     TRACE_(virtstat)( "Total: res %lu, comm %lu; Anon: res %lu, comm %lu, marked Unix %lu.\n",
                       anon_reserved + mapped, anon_committed + mapped_committed, anon_reserved, anon_committed,
                       marked_native );
+    ranges = get_free_ranges_info( &largest_free, &total_free );
+    TRACE_(virtstat)( "Views %u, free ranges %u, largest free range %lu.\n",
+                      views, ranges, largest_free / (1024 * 1024) );
+}
+
+
+/***********************************************************************
+ *           virtual_dump_stats
+ *
+ * Dump the operation counters, the virtual_mutex hold times and the state
+ * of the address space to stderr.
+ */
+void virtual_dump_stats(void)
+{
+    static const char * const op_names[VM_OP_COUNT] =
+        { "allocate", "free", "protect", "map", "unmap", "query", "fault" };
+    unsigned int i, views = 0, valloc_views = 0, image_views = 0, ranges;
+    SIZE_T reserved = 0, largest_free, total_free;
+    struct file_view *view;
+
+    if (!vm_stats) return;
+
+    fprintf( stderr, "virtual: statistics of process %04x\n", (int)GetCurrentProcessId() );
+    for (i = 0; i < VM_OP_COUNT; i++)
+        fprintf( stderr, "virtual: %-10s %12lld calls, %lld failed\n", op_names[i],
+                 (long long)vm_op_count[i], (long long)vm_op_failed[i] );
+
+    /* don't wait for a thread that got killed while holding the mutex */
+    if (pthread_mutex_trylock( &virtual_mutex )) return;
+
+    fprintf( stderr, "virtual: mutex held %lld times, total %.3f ms, max %.3f ms\n",
+             (long long)vm_hold_count, vm_hold_total / 1000000.0, vm_hold_max / 1000000.0 );
+    for (i = 0; i < VM_HOLD_BUCKETS; i++)
+    {
+        if (!vm_hold_histogram[i]) continue;
+        if (!i) fprintf( stderr, "virtual:   %10s < %8lld ns: %lld\n", "", 1ll << VM_HOLD_MIN_SHIFT,
+                         (long long)vm_hold_histogram[i] );
+        else fprintf( stderr, "virtual:   %10lld - %8lld ns: %lld\n", 1ll << (VM_HOLD_MIN_SHIFT + i - 1),
+                      1ll << (VM_HOLD_MIN_SHIFT + i), (long long)vm_hold_histogram[i] );
+    }
+
+    WINE_RB_FOR_EACH_ENTRY( view, &views_tree, struct file_view, entry )
+    {
+        views++;
+        reserved += view->size;
+        if (is_view_valloc( view )) valloc_views++;
+        else if (view->protect & SEC_IMAGE) image_views++;
+    }
+    ranges = get_free_ranges_info( &largest_free, &total_free );
+    fprintf( stderr, "virtual: %u views (%u anonymous, %u image), %lu MiB reserved\n",
+             views, valloc_views, image_views, (unsigned long)(reserved / (1024 * 1024)) );
+    fprintf( stderr, "virtual: %u free ranges, %lu MiB free, largest %lu MiB\n", ranges,
+             (unsigned long)(total_free / (1024 * 1024)), (unsigned long)(largest_free / (1024 * 1024)) );
+    mutex_unlock( &virtual_mutex );
 }
 
 /***********************************************************************
@@ -1832,7 +2046,9 @@ static void free_view( struct file_view *view )
 static void unregister_view( struct file_view *view )
 {
     free_ranges_remove_view( view );
+    views_write_begin();
     wine_rb_remove( &views_tree, &view->entry );
+    views_write_end();
 }
 
 
@@ -1858,7 +2074,9 @@ static void delete_view( struct file_view *view ) /* [in] View */
  */
 static void register_view( struct file_view *view )
 {
+    views_write_begin();
     wine_rb_put( &views_tree, view->base, &view->entry );
+    views_write_end();
     free_ranges_insert_view( view );
 }
 
@@ -2050,6 +2268,18 @@ static BOOL set_vprot( struct file_view *view, void *base, size_t size, BYTE vpr
 }
 
 
+/***********************************************************************
+ *           splits_large_pages
+ *
+ * Check if a range of a view only covers part of some of its host huge pages.
+ */
+static BOOL splits_large_pages( const struct file_view *view, const void *base, size_t size )
+{
+    if (!(view->protect & VPROT_LARGE_PAGES)) return FALSE;
+    return (((UINT_PTR)base | size) & (large_page_size - 1)) != 0;
+}
+
+
 /***********************************************************************
  *           set_protection
  *
@@ -2061,6 +2291,8 @@ static NTSTATUS set_protection( struct file_view *view, void *base, SIZE_T size,
     NTSTATUS status;
 
     if ((status = get_vprot_flags( protect, &vprot, view->protect & SEC_IMAGE ))) return status;
+    /* the host cannot change the protection of part of a huge page */
+    if (splits_large_pages( view, base, size )) return STATUS_INVALID_PARAMETER;
     if (is_view_valloc( view ))
     {
         if (vprot & VPROT_WRITECOPY) return STATUS_INVALID_PAGE_PROTECTION;
@@ -2089,7 +2321,9 @@ static void commit_arm64ec_map( struct file_view *view )
     size_t size = ROUND_SIZE( start, end + 1 - start );
     void *base = ROUND_ADDR( (char *)arm64ec_view->base + start, page_mask );
 
+    views_write_begin();
     view->protect |= VPROT_ARM64EC;
+    views_write_end();
     set_vprot( arm64ec_view, base, size, VPROT_READ | VPROT_WRITE | VPROT_COMMITTED );
 }
 
@@ -2359,6 +2593,58 @@ static void *alloc_free_area( char *limit_low, char *limit_high, size_t size, BO
     return result;
 }
 
+/***********************************************************************
+ *           is_huge_page_view_size
+ *
+ * Check if a private view is large enough for the transparent huge pages policy.
+ */
+static BOOL is_huge_page_view_size( size_t size )
+{
+    return use_huge_pages && large_page_size && size >= 4 * large_page_size;
+}
+
+
+/***********************************************************************
+ *           advise_huge_pages
+ *
+ * Ask the kernel to back a committed range with transparent huge pages.
+ */
+static void advise_huge_pages( void *base, size_t size )
+{
+#ifdef MADV_HUGEPAGE
+    if (madvise( base, size, MADV_HUGEPAGE ))
+        WARN( "madvise(MADV_HUGEPAGE) failed for %p-%p: %s\n", base, (char *)base + size, strerror(errno) );
+#endif
+}
+
+
+/***********************************************************************
+ *           map_large_pages
+ *
+ * Back a MEM_LARGE_PAGES view with huge pages, falling back to transparent huge pages.
+ * virtual_mutex must be held by caller.
+ */
+static void map_large_pages( struct file_view *view )
+{
+#ifdef MAP_HUGETLB
+    int unix_prot = get_unix_prot( view->protect );
+
+    if (anon_mmap_fixed( view->base, view->size, unix_prot, MAP_HUGETLB ) != MAP_FAILED)
+    {
+        views_write_begin();
+        view->protect |= VPROT_LARGE_PAGES;
+        views_write_end();
+        return;
+    }
+    WARN( "no huge pages available for %p-%p (%s), using transparent huge pages\n",
+          view->base, (char *)view->base + view->size, strerror(errno) );
+    /* a failed fixed mapping may have removed the previous one */
+    anon_mmap_fixed( view->base, view->size, unix_prot, 0 );
+#endif
+    advise_huge_pages( view->base, view->size );
+}
+
+
 /***********************************************************************
  *           map_fixed_area
  *
@@ -2451,8 +2737,10 @@ static NTSTATUS map_view( struct file_view **view_ret, void *base, size_t size,
 
         TRACE( "found view %p, size %p, protect %#x.\n", view->base, (void *)view->size, view->protect );
 
+        views_write_begin();
         view->protect = vprot | VPROT_PLACEHOLDER;
         set_vprot( view, base, size, vprot );
+        views_write_end();
         if (vprot & VPROT_WRITEWATCH)
         {
             kernel_writewatch_register_range( view, base, size );
@@ -2657,16 +2945,20 @@ static NTSTATUS remove_pages_from_view( struct file_view *view, char *base, size
         new_view->size    = (char *)view->base + view->size - (char *)new_view->base;
         new_view->protect = view->protect;
 
+        /* keep lock-free readers out until both views are in the tree */
+        views_write_begin();
         unregister_view( view );
         view->size = base - (char *)view->base;
         register_view( view );
         register_view( new_view );
+        views_write_end();
 
         VIRTUAL_DEBUG_DUMP_VIEW( view );
         VIRTUAL_DEBUG_DUMP_VIEW( new_view );
     }
     else
     {
+        views_write_begin();
         unregister_view( view );
         if (view->base == base)
         {
@@ -2676,6 +2968,7 @@ static NTSTATUS remove_pages_from_view( struct file_view *view, char *base, size
         else view->size = base - (char *)view->base;
 
         register_view( view );
+        views_write_end();
         VIRTUAL_DEBUG_DUMP_VIEW( view );
     }
     return STATUS_SUCCESS;
@@ -2696,17 +2989,21 @@ static NTSTATUS free_pages_preserve_placeholder( struct file_view *view, char *b
     if (!(view->protect & VPROT_PLACEHOLDER)) return STATUS_CONFLICTING_ADDRESSES;
     if (view->protect & VPROT_FREE_PLACEHOLDER && size == view->size) return STATUS_CONFLICTING_ADDRESSES;
 
+    views_write_begin();
     if (size < view->size)
     {
         status = remove_pages_from_view( view, base, size );
-        if (status) return status;
-
-        status = create_view( &view, base, size, VPROT_PLACEHOLDER | VPROT_FREE_PLACEHOLDER );
-        if (status) return status;
+        if (!status) status = create_view( &view, base, size, VPROT_PLACEHOLDER | VPROT_FREE_PLACEHOLDER );
+        if (status)
+        {
+            views_write_end();
+            return status;
+        }
     }
 
     view->protect = VPROT_PLACEHOLDER | VPROT_FREE_PLACEHOLDER;
     set_page_vprot( view->base, view->size, 0 );
+    views_write_end();
     anon_mmap_fixed( view->base, view->size, PROT_NONE, 0 );
     return STATUS_SUCCESS;
 }
@@ -2729,10 +3026,12 @@ static NTSTATUS free_pages( struct file_view *view, char *base, size_t size )
         return STATUS_SUCCESS;
     }
 
+    views_write_begin();
     status = remove_pages_from_view( view, base, size );
+    if (!status) set_page_vprot( base, size, 0 );
+    views_write_end();
     if (!status)
     {
-        set_page_vprot( base, size, 0 );
         if (view->protect & VPROT_ARM64EC) clear_arm64ec_range( base, size );
         unmap_area( base, size );
     }
@@ -2770,6 +3069,8 @@ static NTSTATUS coalesce_placeholders( struct file_view *view, char *base, size_
 
     if (view_count < 2 || size != views_size) return STATUS_CONFLICTING_ADDRESSES;
 
+    /* keep lock-free readers out until the merged view is in the tree */
+    views_write_begin();
     for (i = 1; i < view_count; ++i)
     {
         curr_view = RB_ENTRY_VALUE( rb_next( &view->entry ), struct file_view, entry );
@@ -2780,6 +3081,7 @@ static NTSTATUS coalesce_placeholders( struct file_view *view, char *base, size_
     unregister_view( view );
     view->size = views_size;
     register_view( view );
+    views_write_end();
 
     VIRTUAL_DEBUG_DUMP_VIEW( view );
 
@@ -3132,6 +3434,186 @@ static IMAGE_BASE_RELOCATION *process_relocation_block( char *page, IMAGE_BASE_R
 }
 
 
+/***********************************************************************
+ *           relocate_image
+ *
+ * Apply the base relocations of an image mapped at ptr.
+ */
+static void relocate_image( char *ptr, const IMAGE_DATA_DIRECTORY *dir, SIZE_T total_size, INT_PTR delta )
+{
+    IMAGE_BASE_RELOCATION *rel = (IMAGE_BASE_RELOCATION *)(ptr + dir->VirtualAddress);
+    IMAGE_BASE_RELOCATION *end = (IMAGE_BASE_RELOCATION *)((char *)rel + dir->Size);
+
+    while (rel && rel < end - 1 && rel->SizeOfBlock && rel->VirtualAddress < total_size)
+        rel = process_relocation_block( ptr + rel->VirtualAddress, rel, delta );
+}
+
+
+/***********************************************************************
+ *           get_reloc_pages
+ *
+ * Build a map of the image pages that are modified by relocations, header included.
+ */
+static BYTE *get_reloc_pages( char *ptr, const IMAGE_DATA_DIRECTORY *dir, SIZE_T header_size,
+                              SIZE_T total_size )
+{
+    IMAGE_BASE_RELOCATION *rel, *end;
+    SIZE_T start, last, count = total_size >> page_shift;
+    const USHORT *reloc, *reloc_end;
+    BYTE *pages;
+
+    if (!(pages = calloc( count, 1 ))) return NULL;
+
+    memset( pages, 1, min( ROUND_SIZE( 0, header_size ) >> page_shift, count ));
+    rel = (IMAGE_BASE_RELOCATION *)(ptr + dir->VirtualAddress);
+    end = (IMAGE_BASE_RELOCATION *)((char *)rel + dir->Size);
+    while (rel < end - 1 && rel->SizeOfBlock >= sizeof(*rel) && rel->VirtualAddress < total_size)
+    {
+        start = rel->VirtualAddress;
+        last = start + 0xfff;
+        reloc_end = (const USHORT *)((char *)rel + rel->SizeOfBlock);
+        /* a fixup at the end of a block may spill over into the next page */
+        for (reloc = (const USHORT *)(rel + 1); reloc < reloc_end; reloc++)
+            if ((*reloc >> 12) != IMAGE_REL_BASED_ABSOLUTE && (*reloc & 0xfff) > 0x1000 - sizeof(INT64))
+                last = start + 0x1000 + sizeof(INT64) - 1;
+        start >>= page_shift;
+        last = min( last, total_size - 1 ) >> page_shift;
+        memset( pages + start, 1, last - start + 1 );
+        rel = (IMAGE_BASE_RELOCATION *)((char *)rel + rel->SizeOfBlock);
+    }
+    return pages;
+}
+
+
+/***********************************************************************
+ *           get_reloc_cache_name
+ *
+ * The cache file name identifies the image file, its machine and the relocated address.
+ */
+static char *get_reloc_cache_name( const struct stat *st, USHORT machine, ULONG64 map_addr )
+{
+    unsigned long mtime_nsec = 0, ctime_nsec = 0;
+    char *name;
+
+    /* a dll rewritten in place within the same second must get a different name */
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    mtime_nsec = st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    mtime_nsec = st->st_mtimespec.tv_nsec;
+#endif
+#ifdef HAVE_STRUCT_STAT_ST_CTIM
+    ctime_nsec = st->st_ctim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_CTIMESPEC)
+    ctime_nsec = st->st_ctimespec.tv_nsec;
+#endif
+
+    if (asprintf( &name, "%s/%llx-%llx-%llx-%llx.%lx-%llx.%lx-%04x-%llx", reloc_cache_dir,
+                  (unsigned long long)st->st_dev, (unsigned long long)st->st_ino,
+                  (unsigned long long)st->st_size, (unsigned long long)st->st_mtime, mtime_nsec,
+                  (unsigned long long)st->st_ctime, ctime_nsec, machine,
+                  (unsigned long long)map_addr ) == -1)
+        return NULL;
+    return name;
+}
+
+
+/***********************************************************************
+ *           store_reloc_cache
+ *
+ * Write the relocated pages of an image to a new cache file, and return its fd.
+ */
+static int store_reloc_cache( const char *ptr, const BYTE *pages, SIZE_T count, const char *name )
+{
+    SIZE_T i, start, size;
+    BOOL ret = TRUE;
+    char *tmp_name;
+    int fd;
+
+    if (asprintf( &tmp_name, "%s.XXXXXX", name ) == -1) return -1;
+    if ((fd = mkstemp( tmp_name )) == -1)
+    {
+        WARN_(module)( "cannot create %s: %s\n", tmp_name, strerror( errno ));
+        free( tmp_name );
+        return -1;
+    }
+
+    /* the file has the layout of the image, pages without relocations are left as holes */
+    for (i = 0; i < count && ret; i++)
+    {
+        if (!pages[i]) continue;
+        for (start = i; i < count && pages[i]; i++) ;
+        size = (i - start) << page_shift;
+        ret = pwrite( fd, ptr + (start << page_shift), size, start << page_shift ) == size;
+    }
+    if (ret && !ftruncate( fd, count << page_shift ) && !rename( tmp_name, name ))
+        TRACE_(module)( "stored relocated image %s\n", name );
+    else
+    {
+        WARN_(module)( "cannot store relocated image %s\n", name );
+        unlink( tmp_name );
+        close( fd );
+        fd = -1;
+    }
+    free( tmp_name );
+    return fd;
+}
+
+
+/***********************************************************************
+ *           relocate_image_cached
+ *
+ * Relocate an image through the relocated image cache. The pages modified by
+ * relocations are mapped from the cache file, so that they stay clean and can
+ * be shared with the other processes using the image at the same address.
+ * virtual_mutex must be held by caller.
+ */
+static NTSTATUS relocate_image_cached( struct file_view *view, IMAGE_NT_HEADERS *nt,
+                                       const IMAGE_DATA_DIRECTORY *dir, const struct stat *st,
+                                       SIZE_T header_size, ULONG64 map_addr, INT_PTR delta )
+{
+    char *ptr = view->base, *name = NULL;
+    SIZE_T i, start, count = view->size >> page_shift;
+    NTSTATUS status = STATUS_SUCCESS;
+    struct stat cache_st;
+    BYTE *pages;
+    int fd = -1;
+
+    if ((pages = get_reloc_pages( ptr, dir, header_size, view->size )) &&
+        (name = get_reloc_cache_name( st, nt->FileHeader.Machine, map_addr )) &&
+        (fd = open( name, O_RDONLY )) != -1)
+    {
+        if (!fstat( fd, &cache_st ) && cache_st.st_size == view->size)
+            TRACE_(module)( "using relocated image %s\n", name );
+        else
+        {
+            WARN_(module)( "ignoring invalid relocated image %s\n", name );
+            close( fd );
+            fd = -1;
+        }
+    }
+    if (fd == -1)
+    {
+        relocate_image( ptr, dir, view->size, delta );
+        if (name) fd = store_reloc_cache( ptr, pages, count, name );
+    }
+    if (fd != -1)
+    {
+        for (i = 0; i < count && !status; i++)
+        {
+            if (!pages[i]) continue;
+            for (start = i; i < count && pages[i]; i++) ;
+            status = map_file_into_view( view, fd, start << page_shift, (i - start) << page_shift,
+                                         start << page_shift, VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY,
+                                         FALSE );
+        }
+        close( fd );
+    }
+    free( name );
+    free( pages );
+    return status;
+}
+
+
 /***********************************************************************
  *           map_image_into_view
  *
@@ -3154,6 +3636,7 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
     char *header_end;
     char *ptr = view->base;
     SIZE_T header_size, total_size = view->size;
+    BOOL has_shared_sections = FALSE;
     INT_PTR delta;
 
     TRACE_(module)( "mapping PE file %s at %p-%p\n", debugstr_w(filename), ptr, ptr + total_size );
@@ -3259,6 +3742,7 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
                                         VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY, FALSE );
             }
             pos += map_size;
+            has_shared_sections = TRUE;
             continue;
         }
 
@@ -3327,11 +3811,14 @@ static NTSTATUS map_image_into_view( struct file_view *view, const WCHAR *filena
 
         if ((dir = get_data_dir( nt, total_size, IMAGE_DIRECTORY_ENTRY_BASERELOC )))
         {
-            IMAGE_BASE_RELOCATION *rel = (IMAGE_BASE_RELOCATION *)(ptr + dir->VirtualAddress);
-            IMAGE_BASE_RELOCATION *end = (IMAGE_BASE_RELOCATION *)((char *)rel + dir->Size);
-
-            while (rel && rel < end - 1 && rel->SizeOfBlock && rel->VirtualAddress < total_size)
-                rel = process_relocation_block( ptr + rel->VirtualAddress, rel, delta );
+            /* pages of shared sections must not be replaced by private cache pages */
+            if (reloc_cache_dir && !has_shared_sections)
+            {
+                if ((status = relocate_image_cached( view, nt, dir, &st, header_size,
+                                                     image_info->map_addr, delta )))
+                    return status;
+            }
+            else relocate_image( ptr, dir, total_size, delta );
         }
     }
 
@@ -3514,7 +4001,7 @@ static NTSTATUS virtual_map_image( HANDLE mapping, void **addr_ptr, SIZE_T *size
         SERVER_END_REQ;
     }
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     status = map_image_view( &view, image_info, size, limit_low, limit_high, alloc_type );
     if (status) goto done;
@@ -3529,6 +4016,8 @@ static NTSTATUS virtual_map_image( HANDLE mapping, void **addr_ptr, SIZE_T *size
             req->size    = size;
             req->entry   = image_info->entry_point;
             req->machine = image_info->machine;
+            /* views mapped ahead by the loader worker threads are announced when the loader claims them */
+            req->defer_event = !!(NtCurrentTeb()->SameTebFlags & TEB_LOADER_WORKER);
             status = wine_server_call( req );
         }
         SERVER_END_REQ;
@@ -3543,7 +4032,7 @@ static NTSTATUS virtual_map_image( HANDLE mapping, void **addr_ptr, SIZE_T *size
     else delete_view( view );
 
 done:
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     if (needs_close) close( unix_fd );
     if (shared_needs_close) close( shared_fd );
     return status;
@@ -3638,7 +4127,7 @@ static unsigned int virtual_map_section( HANDLE handle, PVOID *addr_ptr, ULONG_P
 
     if ((res = server_get_unix_fd( handle, 0, &unix_handle, &needs_close, NULL, NULL ))) return res;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     res = map_view( &view, base, size, alloc_type, vprot, limit_low, limit_high, 0 );
     if (res) goto done;
@@ -3669,7 +4158,7 @@ static unsigned int virtual_map_section( HANDLE handle, PVOID *addr_ptr, ULONG_P
     else delete_view( view );
 
 done:
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     if (needs_close) close( unix_handle );
     TRACE("status %#x.\n", res);
     return res;
@@ -3730,6 +4219,8 @@ void virtual_init(void)
     pthread_mutex_init( &virtual_mutex, &attr );
     pthread_mutexattr_destroy( &attr );
 
+    if ((env_var = getenv( "WINEVMSTATS" )) && atoi( env_var )) vm_stats = TRUE;
+
 #ifdef __aarch64__
     host_addr_space_limit = get_host_addr_space_limit();
     TRACE( "host addr space limit: %p\n", host_addr_space_limit );
@@ -3743,6 +4234,11 @@ void virtual_init(void)
     if (use_kernel_writewatch)
         MESSAGE( "wine: using kernel write watches, use_kernel_writewatch %d.\n", use_kernel_writewatch );
 
+    if ((env_var = getenv( "WINEHUGEPAGES" )) && atoi( env_var )) use_huge_pages = TRUE;
+
+    if ((env_var = getenv( "WINERELOCCACHE" )) && *env_var && (reloc_cache_dir = strdup( env_var )))
+        mkdir( reloc_cache_dir, 0700 );
+
     if (preload_info && *preload_info)
         for (i = 0; (*preload_info)[i].size; i++)
             mmap_add_reserved_area( (*preload_info)[i].addr, (*preload_info)[i].size );
@@ -3942,7 +4438,7 @@ NTSTATUS virtual_create_builtin_view( void *module, const UNICODE_STRING *nt_nam
     void *base = wine_server_get_ptr( info->base );
     int i;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     status = create_view( &view, base, size, SEC_IMAGE | SEC_FILE | VPROT_SYSTEM |
                           VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY | VPROT_EXEC );
     if (!status)
@@ -3979,7 +4475,7 @@ NTSTATUS virtual_create_builtin_view( void *module, const UNICODE_STRING *nt_nam
         }
         else delete_view( view );
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
 
     return status;
 }
@@ -4150,7 +4646,7 @@ NTSTATUS virtual_alloc_teb( TEB **ret_teb )
     NTSTATUS status = STATUS_SUCCESS;
     SIZE_T block_size = signal_stack_mask + 1;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if (next_free_teb)
     {
         ptr = next_free_teb;
@@ -4166,7 +4662,7 @@ NTSTATUS virtual_alloc_teb( TEB **ret_teb )
             if ((status = NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, user_space_wow_limit,
                                                    &total, MEM_RESERVE, PAGE_READWRITE )))
             {
-                server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+                virtual_unlock( &sigset );
                 return status;
             }
             teb_block = ptr;
@@ -4177,14 +4673,14 @@ NTSTATUS virtual_alloc_teb( TEB **ret_teb )
                                  MEM_COMMIT, PAGE_READWRITE );
     }
     *ret_teb = teb = init_teb( ptr, is_wow64() );
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
 
     if ((status = signal_alloc_thread( teb )))
     {
-        server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+        virtual_lock( &sigset );
         *(void **)ptr = next_free_teb;
         next_free_teb = ptr;
-        server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+        virtual_unlock( &sigset );
     }
     return status;
 }
@@ -4218,13 +4714,13 @@ void virtual_free_teb( TEB *teb )
         NtFreeVirtualMemory( GetCurrentProcess(), &ptr, &size, MEM_RELEASE );
     }
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     list_remove( &thread_data->entry );
     ptr = teb;
     if (!is_win64) ptr = (char *)ptr - teb_offset;
     *(void **)ptr = next_free_teb;
     next_free_teb = ptr;
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
 }
 
 
@@ -4238,7 +4734,7 @@ NTSTATUS virtual_clear_tls_index( ULONG index )
 
     if (index < TLS_MINIMUM_AVAILABLE)
     {
-        server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+        virtual_lock( &sigset );
         LIST_FOR_EACH_ENTRY( thread_data, &teb_list, struct ntdll_thread_data, entry )
         {
             TEB *teb = CONTAINING_RECORD( thread_data, TEB, GdiTebBatch );
@@ -4249,14 +4745,14 @@ NTSTATUS virtual_clear_tls_index( ULONG index )
 #endif
             teb->TlsSlots[index] = 0;
         }
-        server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+        virtual_unlock( &sigset );
     }
     else
     {
         index -= TLS_MINIMUM_AVAILABLE;
         if (index >= 8 * sizeof(peb->TlsExpansionBitmapBits)) return STATUS_INVALID_PARAMETER;
 
-        server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+        virtual_lock( &sigset );
         LIST_FOR_EACH_ENTRY( thread_data, &teb_list, struct ntdll_thread_data, entry )
         {
             TEB *teb = CONTAINING_RECORD( thread_data, TEB, GdiTebBatch );
@@ -4271,7 +4767,7 @@ NTSTATUS virtual_clear_tls_index( ULONG index )
 #endif
             if (teb->TlsExpansionSlots) teb->TlsExpansionSlots[index] = 0;
         }
-        server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+        virtual_unlock( &sigset );
     }
     return STATUS_SUCCESS;
 }
@@ -4356,7 +4852,7 @@ NTSTATUS virtual_set_tls_information( PROCESS_TLS_INFORMATION *t )
     unsigned int idx = 0;
     sigset_t sigset;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     LIST_FOR_EACH_ENTRY_REV( thread_data, &teb_list, struct ntdll_thread_data, entry )
     {
         TEB *teb = CONTAINING_RECORD( thread_data, TEB, GdiTebBatch );
@@ -4364,7 +4860,7 @@ NTSTATUS virtual_set_tls_information( PROCESS_TLS_INFORMATION *t )
         if (idx == t->ThreadDataCount) break;
         if ((ret = virtual_set_tls_information_teb( t, &idx, teb ))) break;
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return ret;
 }
 
@@ -4387,7 +4883,7 @@ NTSTATUS virtual_alloc_thread_stack( INITIAL_TEB *stack, ULONG_PTR limit_low, UL
     if (size < 1024 * 1024) size = 1024 * 1024;  /* Xlib needs a large stack */
     size = (size + 0xffff) & ~0xffff;  /* round to 64K boundary */
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     status = map_view( &view, NULL, size, 0, VPROT_READ | VPROT_WRITE | VPROT_COMMITTED,
                        limit_low, limit_high, 0 );
@@ -4420,7 +4916,7 @@ NTSTATUS virtual_alloc_thread_stack( INITIAL_TEB *stack, ULONG_PTR limit_low, UL
     stack->StackBase = (char *)view->base + view->size;
     stack->StackLimit = (char *)view->base + (guard_page ? 2 * page_size : 0);
 done:
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return status;
 }
 
@@ -4451,6 +4947,9 @@ void virtual_map_user_shared_data(void)
     }
     if (needs_close) close( fd );
     NtClose( section );
+
+    large_page_size = user_shared_data->LargePageMinimum;
+    if (use_huge_pages) TRACE( "using transparent huge pages, large page size %#zx\n", large_page_size );
 }
 
 
@@ -4539,6 +5038,7 @@ NTSTATUS virtual_handle_fault( void *addr, DWORD err, void *stack )
     BYTE vprot;
 
     mutex_lock( &virtual_mutex );  /* no need for signal masking inside signal handler */
+    vm_stats_hold_begin();
     vprot = get_page_vprot( page );
 
 #ifdef __APPLE__
@@ -4590,7 +5090,9 @@ NTSTATUS virtual_handle_fault( void *addr, DWORD err, void *stack )
         else
             set_page_vprot_bits( page, page_size, 0, VPROT_READ | VPROT_EXEC );
     }
+    vm_stats_hold_end();
     mutex_unlock( &virtual_mutex );
+    vm_stats_op( VM_OP_FAULT, ret );
     return ret;
 }
 
@@ -4629,12 +5131,14 @@ void *virtual_setup_exception( void *stack_ptr, size_t size, EXCEPTION_RECORD *r
     else if (stack < stack_info.limit)
     {
         mutex_lock( &virtual_mutex );  /* no need for signal masking inside signal handler */
+        vm_stats_hold_begin();
         if ((get_page_vprot( stack ) & VPROT_GUARD) &&
             grow_thread_stack( ROUND_ADDR( stack, page_mask ), &stack_info ))
         {
             rec->ExceptionCode = STATUS_STACK_OVERFLOW;
             rec->NumberParameters = 0;
         }
+        vm_stats_hold_end();
         mutex_unlock( &virtual_mutex );
     }
 #if defined(VALGRIND_MAKE_MEM_UNDEFINED)
@@ -4684,14 +5188,14 @@ unsigned int virtual_locked_server_call( void *req_ptr )
 
     if (!size) return wine_server_call( req_ptr );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if (!(ret = check_write_access( addr, size, &has_write_watch )))
     {
         ret = server_call_unlocked( req );
         if (has_write_watch) update_write_watches( addr, size, wine_server_reply_size( req ));
     }
     else memset( &req->u.reply, 0, sizeof(req->u.reply) );
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return ret;
 }
 
@@ -4708,14 +5212,14 @@ ssize_t virtual_locked_read( int fd, void *addr, size_t size )
     ssize_t ret = read( fd, addr, size );
     if (ret != -1 || use_kernel_writewatch || errno != EFAULT) return ret;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if (!check_write_access( addr, size, &has_write_watch ))
     {
         ret = read( fd, addr, size );
         err = errno;
         if (has_write_watch) update_write_watches( addr, size, max( 0, ret ));
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     errno = err;
     return ret;
 }
@@ -4733,14 +5237,14 @@ ssize_t virtual_locked_pread( int fd, void *addr, size_t size, off_t offset )
     ssize_t ret = pread( fd, addr, size, offset );
     if (ret != -1 || use_kernel_writewatch || errno != EFAULT) return ret;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if (!check_write_access( addr, size, &has_write_watch ))
     {
         ret = pread( fd, addr, size, offset );
         err = errno;
         if (has_write_watch) update_write_watches( addr, size, max( 0, ret ));
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     errno = err;
     return ret;
 }
@@ -4759,7 +5263,7 @@ ssize_t virtual_locked_recvmsg( int fd, struct msghdr *hdr, int flags )
     ssize_t ret = recvmsg( fd, hdr, flags );
     if (ret != -1 || use_kernel_writewatch || errno != EFAULT) return ret;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     for (i = 0; i < hdr->msg_iovlen; i++)
         if (check_write_access( hdr->msg_iov[i].iov_base, hdr->msg_iov[i].iov_len, &has_write_watch ))
             break;
@@ -4771,7 +5275,7 @@ ssize_t virtual_locked_recvmsg( int fd, struct msghdr *hdr, int flags )
     if (has_write_watch)
         while (i--) update_write_watches( hdr->msg_iov[i].iov_base, hdr->msg_iov[i].iov_len, 0 );
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     errno = err;
     return ret;
 }
@@ -4786,10 +5290,10 @@ BOOL virtual_is_valid_code_address( const void *addr, SIZE_T size )
     BOOL ret = FALSE;
     sigset_t sigset;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if ((view = find_view( addr, size )))
         ret = !(view->protect & VPROT_SYSTEM);  /* system views are not visible to the app */
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return ret;
 }
 
@@ -4876,7 +5380,7 @@ SIZE_T virtual_uninterrupted_read_memory( const void *addr, void *buffer, SIZE_T
 
     if (!size) return 0;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if ((view = find_view( addr, size )))
     {
         if (!(view->protect & VPROT_SYSTEM))
@@ -4892,7 +5396,7 @@ SIZE_T virtual_uninterrupted_read_memory( const void *addr, void *buffer, SIZE_T
             }
         }
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return bytes_read;
 }
 
@@ -4912,13 +5416,13 @@ NTSTATUS virtual_uninterrupted_write_memory( void *addr, const void *buffer, SIZ
 
     if (!size) return STATUS_SUCCESS;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if (!(ret = check_write_access( addr, size, &has_write_watch )))
     {
         memcpy( addr, buffer, size );
         if (has_write_watch) update_write_watches( addr, size, size );
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return ret;
 }
 
@@ -4933,7 +5437,7 @@ void virtual_set_force_exec( BOOL enable )
     struct file_view *view;
     sigset_t sigset;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if (!force_exec_prot != !enable)  /* change all existing views */
     {
         force_exec_prot = enable;
@@ -4951,7 +5455,7 @@ void virtual_set_force_exec( BOOL enable )
             mprotect_range( view->base, view->size, commit, 0 );
         }
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
 }
 
 /* free reserved areas within a given range */
@@ -5096,12 +5600,24 @@ static NTSTATUS allocate_virtual_memory( void **ret, SIZE_T *size_ptr, ULONG typ
         return STATUS_INVALID_PARAMETER;
     }
 
+    if (type & MEM_LARGE_PAGES)
+    {
+        if (!large_page_size) return STATUS_NOT_SUPPORTED;
+        if ((type & (MEM_COMMIT | MEM_RESERVE)) != (MEM_COMMIT | MEM_RESERVE) ||
+            (type & (MEM_WRITE_WATCH | MEM_RESERVE_PLACEHOLDER | MEM_REPLACE_PLACEHOLDER)) ||
+            ((UINT_PTR)base & (large_page_size - 1)) || (size & (large_page_size - 1)))
+            return STATUS_INVALID_PARAMETER;
+        if (align < large_page_size) align = large_page_size;
+    }
+    else if (!base && !align && !(type & MEM_WRITE_WATCH) && is_huge_page_view_size( size ))
+        align = large_page_size;
+
     if (type & MEM_RESERVE_PLACEHOLDER && (protect != PAGE_NOACCESS)) return STATUS_INVALID_PARAMETER;
     if (!arm64ec_view && (attributes & MEM_EXTENDED_PARAMETER_EC_CODE)) return STATUS_INVALID_PARAMETER;
 
     /* Reserve the memory */
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     if ((type & MEM_RESERVE) || !base)
     {
@@ -5117,7 +5633,14 @@ static NTSTATUS allocate_virtual_memory( void **ret, SIZE_T *size_ptr, ULONG typ
             else status = map_view( &view, base, size, type, vprot, limit_low, limit_high,
                                     align ? align - 1 : granularity_mask );
 
-            if (status == STATUS_SUCCESS) base = view->base;
+            if (status == STATUS_SUCCESS)
+            {
+                base = view->base;
+                if (type & MEM_LARGE_PAGES) map_large_pages( view );
+                else if ((vprot & (VPROT_COMMITTED | VPROT_WRITEWATCH)) == VPROT_COMMITTED &&
+                         is_huge_page_view_size( size ))
+                    advise_huge_pages( base, size );
+            }
         }
     }
     else if (type & MEM_RESET)
@@ -5141,6 +5664,9 @@ static NTSTATUS allocate_virtual_memory( void **ret, SIZE_T *size_ptr, ULONG typ
             }
             SERVER_END_REQ;
         }
+        else if (!status && !(view->protect & (SEC_COMMIT | SEC_RESERVE | VPROT_WRITEWATCH | VPROT_SYSTEM)) &&
+                 is_huge_page_view_size( view->size ))
+            advise_huge_pages( base, size );
     }
 
     if (!status && (attributes & MEM_EXTENDED_PARAMETER_EC_CODE))
@@ -5155,7 +5681,7 @@ static NTSTATUS allocate_virtual_memory( void **ret, SIZE_T *size_ptr, ULONG typ
         dump_memory_statistics();
     }
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
 
     if (status == STATUS_SUCCESS)
     {
@@ -5176,8 +5702,10 @@ static NTSTATUS allocate_virtual_memory( void **ret, SIZE_T *size_ptr, ULONG typ
 NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR zero_bits,
                                          SIZE_T *size_ptr, ULONG type, ULONG protect )
 {
-    static const ULONG type_mask = MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH | MEM_RESET;
+    static const ULONG type_mask = MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH | MEM_RESET |
+                                   MEM_LARGE_PAGES;
     ULONG_PTR limit;
+    unsigned int status;
 
     TRACE("%p %p %08lx %x %08x\n", process, *ret, *size_ptr, (int)type, (int)protect );
 
@@ -5193,7 +5721,6 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
     {
         apc_call_t call;
         apc_result_t result;
-        unsigned int status;
 
         memset( &call, 0, sizeof(call) );
 
@@ -5224,7 +5751,9 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
     else
         limit = 0;
 
-    return allocate_virtual_memory( ret, size_ptr, type, protect, 0, limit, 0, 0 );
+    status = allocate_virtual_memory( ret, size_ptr, type, protect, 0, limit, 0, 0 );
+    vm_stats_op( VM_OP_ALLOCATE, status );
+    return status;
 }
 
 
@@ -5316,7 +5845,8 @@ NTSTATUS WINAPI NtAllocateVirtualMemoryEx( HANDLE process, PVOID *ret, SIZE_T *s
                                            ULONG count )
 {
     static const ULONG type_mask = MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH
-                                   | MEM_RESET | MEM_RESERVE_PLACEHOLDER | MEM_REPLACE_PLACEHOLDER;
+                                   | MEM_RESET | MEM_RESERVE_PLACEHOLDER | MEM_REPLACE_PLACEHOLDER
+                                   | MEM_LARGE_PAGES;
     ULONG_PTR limit_low = 0;
     ULONG_PTR limit_high = 0;
     ULONG_PTR align = 0;
@@ -5362,8 +5892,10 @@ NTSTATUS WINAPI NtAllocateVirtualMemoryEx( HANDLE process, PVOID *ret, SIZE_T *s
         return result.virtual_alloc_ex.status;
     }
 
-    return allocate_virtual_memory( ret, size_ptr, type, protect,
-                                    limit_low, limit_high, align, attributes );
+    status = allocate_virtual_memory( ret, size_ptr, type, protect,
+                                      limit_low, limit_high, align, attributes );
+    vm_stats_op( VM_OP_ALLOCATE, status );
+    return status;
 }
 
 
@@ -5409,7 +5941,7 @@ NTSTATUS WINAPI NtFreeVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T *si
     if (size) size = ROUND_SIZE( addr, size );
     base = ROUND_ADDR( addr, page_mask );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     /* avoid freeing the DOS area when a broken app passes a NULL pointer */
     if (!base)
@@ -5426,6 +5958,7 @@ NTSTATUS WINAPI NtFreeVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T *si
     else if (!size && base != view->base) status = STATUS_FREE_VM_NOT_AT_BASE;
     else if ((char *)view->base + view->size - base < size && !(type & MEM_COALESCE_PLACEHOLDERS))
              status = STATUS_UNABLE_TO_FREE_VM;
+    else if (size && splits_large_pages( view, base, size )) status = STATUS_INVALID_PARAMETER;
     else switch (type)
     {
     case MEM_DECOMMIT:
@@ -5456,7 +5989,8 @@ NTSTATUS WINAPI NtFreeVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T *si
     }
 
     dump_memory_statistics();
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
+    vm_stats_op( VM_OP_FREE, status );
     return status;
 }
 
@@ -5510,7 +6044,7 @@ NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T
     size = ROUND_SIZE( addr, size );
     base = ROUND_ADDR( addr, page_mask );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     if ((view = find_view( base, size )))
     {
@@ -5553,7 +6087,8 @@ NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T
 
     if (!status) VIRTUAL_DEBUG_DUMP_VIEW( view );
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
+    vm_stats_op( VM_OP_PROTECT, status );
 
     if (status == STATUS_SUCCESS)
     {
@@ -5565,6 +6100,104 @@ NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T
 }
 
 
+/***********************************************************************
+ *           is_vprot_range_allocated
+ *
+ * Check that the page protection bytes of a range have been allocated.
+ */
+static BOOL is_vprot_range_allocated( const void *base, size_t size )
+{
+#ifdef _WIN64
+    size_t idx = (size_t)base >> page_shift;
+    size_t end = ((size_t)base + size + page_mask) >> page_shift;
+
+    if (end < idx || end > pages_vprot_size << pages_vprot_shift) return FALSE;
+    for (idx >>= pages_vprot_shift; idx < (end + pages_vprot_mask) >> pages_vprot_shift; idx++)
+        if (!__atomic_load_n( &pages_vprot[idx], __ATOMIC_RELAXED )) return FALSE;
+#endif
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           fill_basic_memory_info_lockfree
+ *
+ * Try to fill the basic memory info without taking virtual_mutex.
+ * Returns FALSE if the views changed meanwhile or the locked path is needed.
+ */
+static BOOL fill_basic_memory_info_lockfree( char *base, MEMORY_BASIC_INFORMATION *info )
+{
+    char *alloc_base = 0, *alloc_end = working_set_limit, *view_base, *view_end;
+    struct wine_rb_entry *ptr;
+    struct file_view *view;
+    unsigned int protect, depth = 0;
+    LONG seq;
+    BYTE vprot;
+
+    if (!views_read_begin( &seq )) return FALSE;
+
+    ptr = __atomic_load_n( &views_tree.root, __ATOMIC_RELAXED );
+    while (ptr)
+    {
+        /* a concurrent rebalancing may send us in circles, the tree depth is bounded otherwise */
+        if (++depth > 2 * 8 * sizeof(void *)) return FALSE;
+
+        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+        view_base = __atomic_load_n( &view->base, __ATOMIC_RELAXED );
+        view_end = view_base + __atomic_load_n( &view->size, __ATOMIC_RELAXED );
+        if (view_base > base)
+        {
+            alloc_end = view_base;
+            ptr = __atomic_load_n( &ptr->left, __ATOMIC_RELAXED );
+        }
+        else if (view_end <= base)
+        {
+            alloc_base = view_end;
+            ptr = __atomic_load_n( &ptr->right, __ATOMIC_RELAXED );
+        }
+        else
+        {
+            alloc_base = view_base;
+            alloc_end = view_end;
+            break;
+        }
+    }
+
+    info->BaseAddress = base;
+    info->RegionSize  = alloc_end - base;
+
+    if (!ptr)
+    {
+#ifdef __i386__
+        return FALSE;  /* free space may be reported as reserved, see fill_basic_memory_info */
+#endif
+        info->State             = MEM_FREE;
+        info->Protect           = PAGE_NOACCESS;
+        info->AllocationBase    = 0;
+        info->AllocationProtect = 0;
+        info->Type              = 0;
+    }
+    else
+    {
+        protect = __atomic_load_n( &view->protect, __ATOMIC_RELAXED );
+        /* the committed state of SEC_RESERVE views is kept by the server */
+        if (protect & SEC_RESERVE) return FALSE;
+        if (!is_vprot_range_allocated( base, alloc_end - base )) return FALSE;
+
+        info->AllocationBase = alloc_base;
+        info->RegionSize = get_vprot_range_size( base, alloc_end - base, ~VPROT_WRITEWATCH, &vprot );
+        info->State = (vprot & VPROT_COMMITTED) ? MEM_COMMIT : MEM_RESERVE;
+        info->Protect = (vprot & VPROT_COMMITTED) ? get_win32_prot( vprot, protect ) : 0;
+        info->AllocationProtect = get_win32_prot( protect, protect );
+        if (protect & SEC_IMAGE) info->Type = MEM_IMAGE;
+        else if (protect & (SEC_FILE | SEC_COMMIT)) info->Type = MEM_MAPPED;
+        else info->Type = MEM_PRIVATE;
+    }
+
+    return views_read_end( seq );
+}
+
+
 static unsigned int fill_basic_memory_info( const void *addr, MEMORY_BASIC_INFORMATION *info )
 {
     char *base, *alloc_base = 0, *alloc_end = working_set_limit;
@@ -5576,9 +6209,11 @@ static unsigned int fill_basic_memory_info( const void *addr, MEMORY_BASIC_INFOR
 
     if (is_beyond_limit( base, 1, working_set_limit )) return STATUS_INVALID_PARAMETER;
 
+    if (fill_basic_memory_info_lockfree( base, info )) return STATUS_SUCCESS;
+
     /* Find the view containing the address */
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     ptr = views_tree.root;
     while (ptr)
     {
@@ -5678,7 +6313,7 @@ static unsigned int fill_basic_memory_info( const void *addr, MEMORY_BASIC_INFOR
         else if (view->protect & (SEC_FILE | SEC_RESERVE | SEC_COMMIT)) info->Type = MEM_MAPPED;
         else info->Type = MEM_PRIVATE;
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
 
     return STATUS_SUCCESS;
 }
@@ -5942,7 +6577,7 @@ static NTSTATUS get_working_set_ex( HANDLE process, LPCVOID addr,
     start = ref[0].addr;
     end = ref[count - 1].addr + page_size;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     init_fill_working_set_info_data( &data, end );
 
     view = find_view_range( start, end - start );
@@ -5973,7 +6608,7 @@ static NTSTATUS get_working_set_ex( HANDLE process, LPCVOID addr,
 
     free_fill_working_set_info_data( &data );
     if (ref != ref_buffer) free( ref );
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
 
     if (res_len)
         *res_len = len;
@@ -6140,6 +6775,8 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
     TRACE("(%p, %p, info_class=%d, %p, %ld, %p)\n",
           process, addr, info_class, buffer, len, res_len);
 
+    vm_stats_op( VM_OP_QUERY, STATUS_SUCCESS );
+
     switch(info_class)
     {
         case MemoryBasicInformation:
@@ -6326,8 +6963,10 @@ NTSTATUS WINAPI NtMapViewOfSection( HANDLE handle, HANDLE process, PVOID *addr_p
         return result.map_view.status;
     }
 
-    return virtual_map_section( handle, addr_ptr, 0, get_zero_bits_limit( zero_bits ), commit_size,
-                                offset_ptr, size_ptr, alloc_type, protect, 0 );
+    res = virtual_map_section( handle, addr_ptr, 0, get_zero_bits_limit( zero_bits ), commit_size,
+                               offset_ptr, size_ptr, alloc_type, protect, 0 );
+    vm_stats_op( VM_OP_MAP, res );
+    return res;
 }
 
 /***********************************************************************
@@ -6400,8 +7039,10 @@ NTSTATUS WINAPI NtMapViewOfSectionEx( HANDLE handle, HANDLE process, PVOID *addr
         return result.map_view_ex.status;
     }
 
-    return virtual_map_section( handle, addr_ptr, limit_low, limit_high, 0,
-                                offset_ptr, size_ptr, alloc_type, protect, machine );
+    status = virtual_map_section( handle, addr_ptr, limit_low, limit_high, 0,
+                                  offset_ptr, size_ptr, alloc_type, protect, machine );
+    vm_stats_op( VM_OP_MAP, status );
+    return status;
 }
 
 
@@ -6431,7 +7072,7 @@ static NTSTATUS unmap_view_of_section( HANDLE process, PVOID addr, ULONG flags )
         return status;
     }
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if (!(view = find_view( addr, 0 )) || is_view_valloc( view )) goto done;
 
     if (flags & MEM_PRESERVE_PLACEHOLDER && !(view->protect & VPROT_PLACEHOLDER))
@@ -6450,7 +7091,7 @@ static NTSTATUS unmap_view_of_section( HANDLE process, PVOID addr, ULONG flags )
             {
                 TRACE( "not freeing in-use builtin %p\n", view->base );
                 builtin->refcount--;
-                server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+                virtual_unlock( &sigset );
                 return STATUS_SUCCESS;
             }
         }
@@ -6474,7 +7115,7 @@ static NTSTATUS unmap_view_of_section( HANDLE process, PVOID addr, ULONG flags )
     }
     else FIXME( "failed to unmap %p %x\n", view->base, status );
 done:
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return status;
 }
 
@@ -6485,7 +7126,10 @@ done:
  */
 NTSTATUS WINAPI NtUnmapViewOfSection( HANDLE process, PVOID addr )
 {
-    return unmap_view_of_section( process, addr, 0 );
+    NTSTATUS status = unmap_view_of_section( process, addr, 0 );
+
+    vm_stats_op( VM_OP_UNMAP, status );
+    return status;
 }
 
 /***********************************************************************
@@ -6495,6 +7139,7 @@ NTSTATUS WINAPI NtUnmapViewOfSection( HANDLE process, PVOID addr )
 NTSTATUS WINAPI NtUnmapViewOfSectionEx( HANDLE process, PVOID addr, ULONG flags )
 {
     static const ULONG type_mask = MEM_UNMAP_WITH_TRANSIENT_BOOST | MEM_PRESERVE_PLACEHOLDER;
+    NTSTATUS status;
 
     if (flags & ~type_mask)
     {
@@ -6502,7 +7147,9 @@ NTSTATUS WINAPI NtUnmapViewOfSectionEx( HANDLE process, PVOID addr, ULONG flags
         return STATUS_INVALID_PARAMETER;
     }
     if (flags & MEM_UNMAP_WITH_TRANSIENT_BOOST) FIXME( "Ignoring MEM_UNMAP_WITH_TRANSIENT_BOOST.\n" );
-    return unmap_view_of_section( process, addr, flags );
+    status = unmap_view_of_section( process, addr, flags );
+    vm_stats_op( VM_OP_UNMAP, status );
+    return status;
 }
 
 /******************************************************************************
@@ -6626,7 +7273,7 @@ NTSTATUS WINAPI NtFlushVirtualMemory( HANDLE process, LPCVOID *addr_ptr,
         return result.virtual_flush.status;
     }
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
     if (!(view = find_view( addr, *size_ptr ))) status = STATUS_INVALID_PARAMETER;
     else
     {
@@ -6636,7 +7283,7 @@ NTSTATUS WINAPI NtFlushVirtualMemory( HANDLE process, LPCVOID *addr_ptr,
         if (msync( addr, *size_ptr, MS_ASYNC )) status = STATUS_NOT_MAPPED_DATA;
 #endif
     }
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return status;
 }
 
@@ -6663,7 +7310,7 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
     TRACE( "%p %x %p-%p %p %lu\n", process, (int)flags, base, (char *)base + size,
            addresses, *count );
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     if (is_write_watch_range( base, size ))
     {
@@ -6678,19 +7325,29 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
             goto done;
         }
 
+        /* scan the range in runs of identical write watch state, so that clean
+         * stretches are skipped a word at a time and only dirty runs get re-protected */
         while (pos < *count && addr < end)
         {
-            if (!(get_page_vprot( addr ) & VPROT_WRITEWATCH)) addresses[pos++] = addr;
-            addr += page_size;
+            SIZE_T i, run;
+            BYTE vprot;
+
+            run = get_vprot_range_size( addr, end - addr, VPROT_WRITEWATCH, &vprot );
+            if (!(vprot & VPROT_WRITEWATCH))
+            {
+                run = min( run, (*count - pos) << page_shift );
+                for (i = 0; i < run; i += page_size) addresses[pos++] = addr + i;
+                if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( addr, run );
+            }
+            addr += run;
         }
-        if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( base, addr - (char *)base );
         *count = pos;
         *granularity = page_size;
     }
     else status = STATUS_INVALID_PARAMETER;
 
 done:
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return status;
 }
 
@@ -6711,14 +7368,14 @@ NTSTATUS WINAPI NtResetWriteWatch( HANDLE process, PVOID base, SIZE_T size )
 
     if (!size) return STATUS_INVALID_PARAMETER;
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     if (is_write_watch_range( base, size ))
         reset_write_watches( base, size );
     else
         status = STATUS_INVALID_PARAMETER;
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return status;
 }
 
@@ -6847,7 +7504,7 @@ NTSTATUS WINAPI NtAreMappedFilesTheSame(PVOID addr1, PVOID addr2)
 
     TRACE("%p %p\n", addr1, addr2);
 
-    server_enter_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_lock( &sigset );
 
     view1 = find_view( addr1, 0 );
     view2 = find_view( addr2, 0 );
@@ -6871,7 +7528,7 @@ NTSTATUS WINAPI NtAreMappedFilesTheSame(PVOID addr1, PVOID addr2)
         SERVER_END_REQ;
     }
 
-    server_leave_uninterrupted_section( &virtual_mutex, &sigset );
+    virtual_unlock( &sigset );
     return status;
 }
 
@@ -79,6 +79,23 @@ struct debugstr_pc_args
     unsigned int size;
 };
 
+struct wait_on_address_params
+{
+    ULONG64      addr;         /* aligned 32-bit word */
+    LONGLONG     timeout;
+    LONG         value;
+    unsigned int bitset;
+    BOOL         has_timeout;
+};
+
+struct wake_address_params
+{
+    ULONG64      addr;         /* aligned 32-bit word */
+    unsigned int bitset;
+    int          count;
+    int          woken;
+};
+
 enum ntdll_unix_funcs
 {
     unix_load_so_dll,
@@ -92,6 +109,10 @@ enum ntdll_unix_funcs
     unix_steamclient_setup_trampolines,
     unix_is_pc_in_native_so,
     unix_debugstr_pc,
+    unix_wait_on_address,
+    unix_wake_address,
+    unix_io_uring_init,
+    unix_io_uring_thread,
 };
 
 extern unixlib_handle_t __wine_unixlib_handle;
@@ -25,6 +25,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -35,6 +36,8 @@
 #include "file.h"
 #include "handle.h"
 #include "request.h"
+#include "process.h"
+#include "thread.h"
 #include "esync.h"
 #include "fsync.h"
 
@@ -79,6 +82,7 @@ struct completion
     struct list    wait_queue;
     unsigned int   depth;
     int            closed;
+    process_id_t   local_pid;   /* process that may queue packets locally, see share_completion() */
     int                esync_fd;
     unsigned int       fsync_idx;
 };
@@ -298,7 +302,7 @@ static struct completion_wait *create_completion_wait( struct completion *comple
 }
 
 static struct completion *create_completion( struct object *root, const struct unicode_str *name,
-                                             unsigned int attr, unsigned int concurrent,
+                                             unsigned int attr, unsigned int concurrent, int local,
                                              const struct security_descriptor *sd )
 {
     struct completion *completion;
@@ -311,6 +315,7 @@ static struct completion *create_completion( struct object *root, const struct u
             list_init( &completion->wait_queue );
             completion->depth = 0;
             completion->closed = 0;
+            completion->local_pid = local ? current->process->id : 0;
         }
     }
     if (do_esync()) completion->esync_fd = esync_create_fd( 0, 0 );
@@ -324,6 +329,29 @@ struct completion *get_completion_obj( struct process *process, obj_handle_t han
     return (struct completion *) get_handle_obj( process, handle, access, &completion_ops );
 }
 
+/* a handle was duplicated out of a process by another process, or into another process; if it is
+ * a port that the process queues packets to locally, have it move them to the server */
+void share_completion( struct process *process, obj_handle_t handle )
+{
+    struct completion *completion;
+    apc_call_t data;
+
+    if (!(completion = (struct completion *)get_handle_obj( process, handle, 0, NULL ))) return;
+    if (completion->obj.ops == &completion_ops && completion->local_pid == process->id)
+    {
+        completion->local_pid = 0;
+        /* the process notices the handles it gives away itself */
+        if (current->process != process)
+        {
+            memset( &data, 0, sizeof(data) );
+            data.share_completion.type   = APC_SHARE_COMPLETION;
+            data.share_completion.handle = handle;
+            thread_queue_apc( process, NULL, NULL, &data );
+        }
+    }
+    release_object( completion );
+}
+
 void add_completion( struct completion *completion, apc_param_t ckey, apc_param_t cvalue,
                      unsigned int status, apc_param_t information )
 {
@@ -359,7 +387,7 @@ DECL_HANDLER(create_completion)
 
     if (!objattr) return;
 
-    if ((completion = create_completion( root, &name, objattr->attributes, req->concurrent, sd )))
+    if ((completion = create_completion( root, &name, objattr->attributes, req->concurrent, req->local, sd )))
     {
         reply->handle = alloc_handle( current->process, completion, req->access, objattr->attributes );
         release_object( completion );
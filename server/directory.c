@@ -241,7 +241,7 @@ int directory_link_name( struct object *obj, struct object_name *name, struct ob
         set_error( STATUS_OBJECT_TYPE_MISMATCH );
         return 0;
     }
-    namespace_add( dir->entries, name );
+    if (!namespace_add( dir->entries, name )) return 0;
     name->parent = grab_object( parent );
     return 1;
 }
@@ -250,7 +250,7 @@ static void directory_destroy( struct object *obj )
 {
     struct directory *dir = (struct directory *)obj;
     assert( obj->ops == &directory_ops );
-    free( dir->entries );
+    free_namespace( dir->entries );
 }
 
 static struct directory *create_directory( struct object *root, const struct unicode_str *name,
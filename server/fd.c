@@ -3033,6 +3033,24 @@ DECL_HANDLER(register_async)
     }
 }
 
+/* create an async for an I/O performed by the client */
+DECL_HANDLER(register_direct_async)
+{
+    struct async *async;
+    struct fd *fd;
+
+    if (!(fd = get_handle_fd_obj( current->process, req->async.handle, 0 ))) return;
+
+    if ((async = create_request_async( fd, fd->comp_flags, &req->async, 0 )))
+    {
+        /* the client performs the I/O and reports the result with set_async_direct_result */
+        set_error( STATUS_ALERTED );
+        reply->wait = async_handoff( async, NULL, 0 );
+        release_object( async );
+    }
+    release_object( fd );
+}
+
 /* attach completion object to a fd */
 DECL_HANDLER(set_completion_info)
 {
@@ -3044,6 +3062,7 @@ DECL_HANDLER(set_completion_info)
         {
             fd->completion = get_completion_obj( current->process, req->chandle, IO_COMPLETION_MODIFY_STATE );
             fd->comp_key = req->ckey;
+            sock_update_completion( fd );
         }
         else set_error( STATUS_INVALID_PARAMETER );
         release_object( fd );
@@ -3076,6 +3095,7 @@ DECL_HANDLER(set_fd_completion_mode)
             fd->comp_flags |= req->flags & ( FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
                                            | FILE_SKIP_SET_EVENT_ON_HANDLE
                                            | FILE_SKIP_SET_USER_EVENT_ON_FAST_IO );
+            sock_update_completion( fd );
         }
         else
             set_error( STATUS_INVALID_PARAMETER );
@@ -214,6 +214,7 @@ extern struct object *create_console_device( struct object *root, const struct u
                                               unsigned int attr, const struct security_descriptor *sd );
 extern struct object *create_socket_device( struct object *root, const struct unicode_str *name,
                                               unsigned int attr, const struct security_descriptor *sd );
+extern void sock_update_completion( struct fd *fd );
 extern struct object *create_unix_device( struct object *root, const struct unicode_str *name,
                                           unsigned int attr, const struct security_descriptor *sd, const char *unix_path );
 
@@ -228,6 +229,7 @@ extern struct dir *get_dir_obj( struct process *process, obj_handle_t handle, un
 /* completion */
 
 extern struct completion *get_completion_obj( struct process *process, obj_handle_t handle, unsigned int access );
+extern void share_completion( struct process *process, obj_handle_t handle );
 extern void add_completion( struct completion *completion, apc_param_t ckey, apc_param_t cvalue,
                             unsigned int status, apc_param_t information );
 extern void cleanup_thread_completion( struct thread *thread );
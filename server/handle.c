@@ -38,6 +38,7 @@
 #include "thread.h"
 #include "security.h"
 #include "request.h"
+#include "file.h"
 
 struct handle_entry
 {
@@ -45,14 +46,19 @@ struct handle_entry
     unsigned int   access;    /* access rights */
 };
 
+/* The entries are allocated in pages that never move, so that growing the table */
+/* doesn't need to copy it. The free entries below the last used one are chained */
+/* through their access field. */
+
 struct handle_table
 {
-    struct object        obj;         /* object header */
-    struct process      *process;     /* process owning this table */
-    int                  count;       /* number of allocated entries */
-    int                  last;        /* last used entry */
-    int                  free;        /* first entry that may be free */
-    struct handle_entry *entries;     /* handle entries */
+    struct object         obj;         /* object header */
+    struct process       *process;     /* process owning this table */
+    int                   count;       /* number of allocated entries */
+    int                   last;        /* last used entry */
+    int                   free;        /* first entry of the free list, -1 if empty */
+    int                   nb_pages;    /* size of the pages array */
+    struct handle_entry **pages;       /* pages of handle entries */
 };
 
 static struct handle_table *global_table;
@@ -66,6 +72,9 @@ static struct handle_table *global_table;
 #define MIN_HANDLE_ENTRIES  32
 #define MAX_HANDLE_ENTRIES  0x00ffffff
 
+#define HANDLE_PAGE_SHIFT   8
+#define HANDLE_PAGE_SIZE    (1 << HANDLE_PAGE_SHIFT)
+
 
 /* handle to table index conversion */
 
@@ -79,6 +88,12 @@ static inline int handle_to_index( obj_handle_t handle )
     return (handle >> 2) - 1;
 }
 
+/* return the entry for a given index, which must be below the table count */
+static inline struct handle_entry *get_entry( struct handle_table *table, int index )
+{
+    return table->pages[index >> HANDLE_PAGE_SHIFT] + (index & (HANDLE_PAGE_SIZE - 1));
+}
+
 /* global handle conversion */
 
 #define HANDLE_OBFUSCATOR 0x544a4def
@@ -156,9 +171,9 @@ static void handle_table_dump( struct object *obj, int verbose )
     fprintf( stderr, "Handle table last=%d count=%d process=%p\n",
              table->last, table->count, table->process );
     if (!verbose) return;
-    entry = table->entries;
-    for (i = 0; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         fprintf( stderr, "    %04x: %p %08x ",
                  index_to_handle(i), entry->ptr, entry->access );
@@ -176,9 +191,12 @@ static void handle_table_destroy( struct object *obj )
 
     assert( obj->ops == &handle_table_ops );
 
-    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
-        struct object *obj = entry->ptr;
+        struct object *obj;
+
+        entry = get_entry( table, i );
+        obj = entry->ptr;
         entry->ptr = NULL;
         if (obj)
         {
@@ -187,7 +205,8 @@ static void handle_table_destroy( struct object *obj )
             release_object_from_handle( obj );
         }
     }
-    free( table->entries );
+    for (i = 0; i < table->count / HANDLE_PAGE_SIZE; i++) free( table->pages[i] );
+    free( table->pages );
 }
 
 /* close all the process handles and free the handle table */
@@ -199,6 +218,39 @@ void close_process_handles( struct process *process )
     if (table) release_object( table );
 }
 
+/* grow a handle table by one page of entries */
+static int grow_handle_table( struct handle_table *table )
+{
+    struct handle_entry **new_pages, *page;
+    int index = table->count / HANDLE_PAGE_SIZE;
+
+    if (table->count > MAX_HANDLE_ENTRIES - HANDLE_PAGE_SIZE)
+    {
+        set_error( STATUS_INSUFFICIENT_RESOURCES );
+        return 0;
+    }
+    if (index == table->nb_pages)
+    {
+        int nb_pages = max( table->nb_pages * 2, 4 );
+
+        if (!(new_pages = realloc( table->pages, nb_pages * sizeof(*new_pages) )))
+        {
+            set_error( STATUS_INSUFFICIENT_RESOURCES );
+            return 0;
+        }
+        table->pages    = new_pages;
+        table->nb_pages = nb_pages;
+    }
+    if (!(page = calloc( HANDLE_PAGE_SIZE, sizeof(*page) )))
+    {
+        set_error( STATUS_INSUFFICIENT_RESOURCES );
+        return 0;
+    }
+    table->pages[index] = page;
+    table->count += HANDLE_PAGE_SIZE;
+    return 1;
+}
+
 /* allocate a new handle table */
 struct handle_table *alloc_handle_table( struct process *process, int count )
 {
@@ -207,47 +259,55 @@ struct handle_table *alloc_handle_table( struct process *process, int count )
     if (count < MIN_HANDLE_ENTRIES) count = MIN_HANDLE_ENTRIES;
     if (!(table = alloc_object( &handle_table_ops )))
         return NULL;
-    table->process = process;
-    table->count   = count;
-    table->last    = -1;
-    table->free    = 0;
-    if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
-    release_object( table );
-    return NULL;
+    table->process  = process;
+    table->count    = 0;
+    table->last     = -1;
+    table->free     = -1;
+    table->nb_pages = 0;
+    table->pages    = NULL;
+    while (table->count < count)
+    {
+        if (grow_handle_table( table )) continue;
+        release_object( table );
+        return NULL;
+    }
+    return table;
 }
 
-/* grow a handle table */
-static int grow_handle_table( struct handle_table *table )
+/* put all the free entries below the last used one in the free list, lowest index first */
+static void build_free_list( struct handle_table *table )
 {
-    struct handle_entry *new_entries;
-    int count = min( table->count * 2, MAX_HANDLE_ENTRIES );
+    struct handle_entry *entry;
+    int i;
 
-    if (count == table->count ||
-        !(new_entries = realloc( table->entries, count * sizeof(struct handle_entry) )))
+    table->free = -1;
+    for (i = table->last; i >= 0; i--)
     {
-        set_error( STATUS_INSUFFICIENT_RESOURCES );
-        return 0;
+        entry = get_entry( table, i );
+        if (entry->ptr) continue;
+        entry->access = table->free;
+        table->free = i;
     }
-    table->entries = new_entries;
-    table->count   = count;
-    return 1;
 }
 
-/* allocate the first free entry in the handle table */
+/* allocate a free entry in the handle table */
 static obj_handle_t alloc_entry( struct handle_table *table, void *obj, unsigned int access )
 {
-    struct handle_entry *entry = table->entries + table->free;
+    struct handle_entry *entry;
     int i;
 
-    for (i = table->free; i <= table->last; i++, entry++) if (!entry->ptr) goto found;
-    if (i >= table->count)
+    if ((i = table->free) != -1)
     {
-        if (!grow_handle_table( table )) return 0;
-        entry = table->entries + i;  /* the entries may have moved */
+        entry = get_entry( table, i );
+        table->free = entry->access;
+    }
+    else
+    {
+        i = table->last + 1;
+        if (i >= table->count && !grow_handle_table( table )) return 0;
+        table->last = i;
+        entry = get_entry( table, i );
     }
-    table->last = i;
- found:
-    table->free = i + 1;
     entry->ptr    = grab_object_for_handle( obj );
     entry->access = access;
     return index_to_handle(i);
@@ -337,45 +397,23 @@ static struct handle_entry *get_handle( struct process *process, obj_handle_t ha
     index = handle_to_index( handle );
     if (index < 0) return NULL;
     if (index > table->last) return NULL;
-    entry = table->entries + index;
+    entry = get_entry( table, index );
     if (!entry->ptr) return NULL;
     return entry;
 }
 
-/* attempt to shrink a table */
-static void shrink_handle_table( struct handle_table *table )
-{
-    struct handle_entry *entry = table->entries + table->last;
-    struct handle_entry *new_entries;
-    int count = table->count;
-
-    while (table->last >= 0)
-    {
-        if (entry->ptr) break;
-        table->last--;
-        entry--;
-    }
-    if (table->last >= count / 4) return;  /* no need to shrink */
-    if (count < MIN_HANDLE_ENTRIES * 2) return;  /* too small to shrink */
-    count /= 2;
-    if (!(new_entries = realloc( table->entries, count * sizeof(*new_entries) ))) return;
-    table->count   = count;
-    table->entries = new_entries;
-}
-
 static void inherit_handle( struct process *parent, const obj_handle_t handle, struct handle_table *table )
 {
     struct handle_entry *dst, *src;
     int index;
 
-    dst = table->entries;
-
     src = get_handle( parent, handle );
     if (!src || !(src->access & RESERVED_INHERIT)) return;
     index = handle_to_index( handle );
-    if (dst[index].ptr) return;
+    dst = get_entry( table, index );
+    if (dst->ptr) return;
     grab_object_for_handle( src->ptr );
-    dst[index] = *src;
+    *dst = *src;
     table->last = max( table->last, index );
 }
 
@@ -397,8 +435,6 @@ struct handle_table *copy_handle_table( struct process *process, struct process
 
     if (handles)
     {
-        memset( table->entries, 0, parent_table->count * sizeof(*table->entries) );
-
         for (i = 0; i < handle_count; i++)
         {
             inherit_handle( parent, handles[i], table );
@@ -413,18 +449,21 @@ struct handle_table *copy_handle_table( struct process *process, struct process
     {
         if ((table->last = parent_table->last) >= 0)
         {
-            struct handle_entry *ptr = table->entries;
-            memcpy( ptr, parent_table->entries, (table->last + 1) * sizeof(struct handle_entry) );
-            for (i = 0; i <= table->last; i++, ptr++)
+            for (i = 0; i <= table->last / HANDLE_PAGE_SIZE; i++)
+                memcpy( table->pages[i], parent_table->pages[i], HANDLE_PAGE_SIZE * sizeof(struct handle_entry) );
+            for (i = 0; i <= table->last; i++)
             {
+                struct handle_entry *ptr = get_entry( table, i );
+
                 if (!ptr->ptr) continue;
                 if (ptr->access & RESERVED_INHERIT) grab_object_for_handle( ptr->ptr );
                 else ptr->ptr = NULL; /* don't inherit this entry */
             }
         }
     }
-    /* attempt to shrink the table */
-    shrink_handle_table( table );
+    /* don't keep the unused entries at the end of the table */
+    while (table->last >= 0 && !get_entry( table, table->last )->ptr) table->last--;
+    build_free_list( table );
     return table;
 }
 
@@ -434,15 +473,25 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     struct handle_table *table;
     struct handle_entry *entry;
     struct object *obj;
+    int index;
 
     if (!(entry = get_handle( process, handle ))) return STATUS_INVALID_HANDLE;
     if (entry->access & RESERVED_CLOSE_PROTECT) return STATUS_HANDLE_NOT_CLOSABLE;
     obj = entry->ptr;
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
-    entry->ptr = NULL;
-    table = handle_is_global(handle) ? global_table : process->handles;
-    if (entry < table->entries + table->free) table->free = entry - table->entries;
-    if (entry == table->entries + table->last) shrink_handle_table( table );
+    if (handle_is_global(handle))
+    {
+        table = global_table;
+        index = handle_to_index( handle_global_to_local( handle ));
+    }
+    else
+    {
+        table = process->handles;
+        index = handle_to_index( handle );
+    }
+    entry->ptr    = NULL;
+    entry->access = table->free;
+    table->free   = index;
     release_object_from_handle( obj );
     return STATUS_SUCCESS;
 }
@@ -522,8 +571,9 @@ obj_handle_t find_inherited_handle( struct process *process, const struct object
 
     if (!table) return 0;
 
-    for (i = 0, ptr = table->entries; i <= table->last; i++, ptr++)
+    for (i = 0; i <= table->last; i++)
     {
+        ptr = get_entry( table, i );
         if (!ptr->ptr) continue;
         if (ptr->ptr->ops != ops) continue;
         if (ptr->access & RESERVED_INHERIT) return index_to_handle(i);
@@ -535,14 +585,13 @@ obj_handle_t find_inherited_handle( struct process *process, const struct object
 unsigned int get_obj_handle_count( struct process *process, const struct object *obj )
 {
     struct handle_table *table = process->handles;
-    struct handle_entry *ptr;
     unsigned int count = 0;
     int i;
 
     if (!table) return 0;
 
-    for (i = 0, ptr = table->entries; i <= table->last; i++, ptr++)
-        if (ptr->ptr == obj) ++count;
+    for (i = 0; i <= table->last; i++)
+        if (get_entry( table, i )->ptr == obj) ++count;
     return count;
 }
 
@@ -695,6 +744,8 @@ DECL_HANDLER(dup_handle)
         {
             reply->handle = duplicate_handle( src, req->src_handle, dst,
                                               req->access, req->attributes, req->options );
+            if (reply->handle && (src != dst || src != current->process))
+                share_completion( src, req->src_handle );
             release_object( dst );
         }
         /* close the handle no matter what happened */
@@ -849,8 +900,9 @@ static int enum_handles( struct process *process, void *user )
     if (!table)
         return 0;
 
-    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr) continue;
         if (!info->handle)
         {
@@ -910,8 +962,9 @@ static int enum_process_handles_cb( struct process *process, void *user )
     if (!table)
         return 0;
 
-    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+    for (i = 0; i <= table->last; i++)
     {
+        entry = get_entry( table, i );
         if (!entry->ptr || entry->ptr->ops != info->ops) continue;
         if ((info->cb)( process, entry->ptr, info->user )) return 1;
     }
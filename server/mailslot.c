@@ -316,7 +316,7 @@ static int mailslot_link_name( struct object *obj, struct object_name *name, str
         set_error( STATUS_OBJECT_NAME_INVALID );
         return 0;
     }
-    namespace_add( dev->mailslots, name );
+    if (!namespace_add( dev->mailslots, name )) return 0;
     name->parent = grab_object( parent );
     return 1;
 }
@@ -427,7 +427,7 @@ static void mailslot_device_destroy( struct object *obj )
 {
     struct mailslot_device *device = (struct mailslot_device*)obj;
     assert( obj->ops == &mailslot_device_ops );
-    free( device->mailslots );
+    free_namespace( device->mailslots );
 }
 
 struct object *create_mailslot_device( struct object *root, const struct unicode_str *name,
@@ -142,6 +142,7 @@ struct memory_view
     client_ptr_t    base;            /* view base address (in process addr space) */
     mem_size_t      size;            /* view size */
     file_pos_t      start;           /* start offset in mapping */
+    int             event_deferred;  /* load dll debug event deferred until the view is claimed */
     data_size_t     namelen;
     WCHAR           name[1];         /* filename for .so dll image views */
 };
@@ -443,7 +444,7 @@ static void set_process_machine( struct process *process, struct memory_view *vi
 
 static int generate_dll_event( struct thread *thread, int code, struct memory_view *view )
 {
-    if (!(view->flags & SEC_IMAGE)) return 0;
+    if (!(view->flags & SEC_IMAGE) || view->event_deferred) return 0;
     generate_debug_event( thread, code, view );
     return 1;
 }
@@ -1293,6 +1294,32 @@ struct object *create_shared_mapping( struct object *root, const struct unicode_
     return &mapping->obj;
 }
 
+/* size of the host huge pages, reported as the large page minimum */
+static unsigned int get_large_page_size(void)
+{
+    unsigned long size = 0;
+#ifdef linux
+    char line[256];
+    FILE *f;
+
+    /* explicit huge pages, used for MEM_LARGE_PAGES allocations */
+    if ((f = fopen( "/proc/meminfo", "r" )))
+    {
+        while (fgets( line, sizeof(line), f ))
+            if (sscanf( line, "Hugepagesize: %lu kB", &size ) == 1) break;
+        fclose( f );
+        size *= 1024;
+    }
+    /* transparent huge pages, used as a fallback */
+    if (!size && (f = fopen( "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r" )))
+    {
+        if (fscanf( f, "%lu", &size ) != 1) size = 0;
+        fclose( f );
+    }
+#endif
+    return size;
+}
+
 struct object *create_user_data_mapping( struct object *root, const struct unicode_str *name,
                                         unsigned int attr, const struct security_descriptor *sd )
 {
@@ -1306,6 +1333,7 @@ struct object *create_user_data_mapping( struct object *root, const struct unico
     {
         user_shared_data = ptr;
         user_shared_data->SystemCall = 1;
+        user_shared_data->LargePageMinimum = get_large_page_size();
     }
     return &mapping->obj;
 }
@@ -1429,6 +1457,7 @@ DECL_HANDLER(map_view)
         view->base      = req->base;
         view->size      = req->size;
         view->start     = req->start;
+        view->event_deferred = 0;
         view->flags     = mapping->flags;
         view->namelen   = 0;
         view->fd        = !is_fd_removable( mapping->fd ) ? (struct fd *)grab_object( mapping->fd ) : NULL;
@@ -1467,6 +1496,7 @@ DECL_HANDLER(map_image_view)
         view->size      = req->size;
         view->flags     = mapping->flags;
         view->start     = 0;
+        view->event_deferred = req->defer_event;
         view->namelen   = 0;
         view->fd        = !is_fd_removable( mapping->fd ) ? (struct fd *)grab_object( mapping->fd ) : NULL;
         view->committed = NULL;
@@ -1528,6 +1558,20 @@ DECL_HANDLER(unmap_view)
     free_memory_view( view );
 }
 
+/* claim an image view mapped with a deferred debug event */
+DECL_HANDLER(claim_image_view)
+{
+    struct memory_view *view = find_mapped_view( current->process, req->base );
+
+    if (!view || !view->event_deferred) return;
+    view->event_deferred = 0;
+    /* keep the views in loading order for the startup events */
+    list_remove( &view->entry );
+    list_add_tail( &current->process->views, &view->entry );
+    if (is_process_init_done( current->process ))
+        generate_dll_event( current, DbgLoadDllStateChange, view );
+}
+
 /* get information about a mapped image view */
 DECL_HANDLER(get_image_view_info)
 {
@@ -544,7 +544,7 @@ static void named_pipe_device_destroy( struct object *obj )
 {
     struct named_pipe_device *device = (struct named_pipe_device*)obj;
     assert( obj->ops == &named_pipe_device_ops );
-    free( device->pipes );
+    free_namespace( device->pipes );
 }
 
 struct object *create_named_pipe_device( struct object *root, const struct unicode_str *name,
@@ -1361,7 +1361,7 @@ static int named_pipe_link_name( struct object *obj, struct object_name *name, s
         set_error( STATUS_OBJECT_NAME_INVALID );
         return 0;
     }
-    namespace_add( dev->pipes, name );
+    if (!namespace_add( dev->pipes, name )) return 0;
     name->parent = grab_object( parent );
     return 1;
 }
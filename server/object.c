@@ -43,12 +43,29 @@
 #include "security.h"
 
 
+struct name_slot
+{
+    unsigned int        hash;            /* full hash value of the name */
+    struct object_name *name;            /* name in this slot, NULL if free */
+};
+
 struct namespace
 {
-    unsigned int        hash_size;       /* size of hash table */
-    struct list         names[1];        /* array of hash entry lists */
+    unsigned int        size;            /* number of slots, always a power of 2 */
+    unsigned int        count;           /* number of names in the table */
+    unsigned int        used;            /* number of non-free slots, including deleted ones */
+    struct name_slot   *slots;           /* open addressing hash table */
 };
 
+/* marker for a slot whose name has been removed */
+#define DELETED_NAME ((struct object_name *)1)
+
+/* namespace lookup statistics */
+static unsigned int namespace_lookups;
+static unsigned __int64 namespace_probes;
+static unsigned int namespace_max_probes;
+static unsigned int namespace_resizes;
+
 
 struct type_descr no_type =
 {
@@ -134,11 +151,95 @@ void *memdup( const void *data, size_t len )
 
 /*****************************************************************/
 
-void namespace_add( struct namespace *namespace, struct object_name *ptr )
+static inline unsigned int get_name_hash( const WCHAR *str, data_size_t len )
+{
+    unsigned int hash = hash_strW( str, len, UINT_MAX );
+
+    /* similar names only differ in the low bits, mix them to avoid clustering */
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/* store a name in the first free slot of its probe sequence */
+static void insert_name( struct namespace *namespace, struct object_name *ptr, unsigned int hash )
+{
+    unsigned int mask = namespace->size - 1, i = hash & mask;
+
+    while (namespace->slots[i].name && namespace->slots[i].name != DELETED_NAME) i = (i + 1) & mask;
+    if (!namespace->slots[i].name) namespace->used++;
+    namespace->slots[i].hash = hash;
+    namespace->slots[i].name = ptr;
+    ptr->namespace = namespace;
+    ptr->slot = i;
+    namespace->count++;
+}
+
+/* rehash the table into a new slot array, dropping the deleted entries */
+static int resize_namespace( struct namespace *namespace, unsigned int size )
 {
-    unsigned int hash = hash_strW( ptr->name, ptr->len, namespace->hash_size );
+    struct name_slot *old_slots = namespace->slots;
+    unsigned int i, old_size = namespace->size;
 
-    list_add_head( &namespace->names[hash], &ptr->entry );
+    if (!(namespace->slots = mem_alloc( size * sizeof(*namespace->slots) )))
+    {
+        namespace->slots = old_slots;
+        return 0;
+    }
+    memset( namespace->slots, 0, size * sizeof(*namespace->slots) );
+    namespace->size  = size;
+    namespace->count = 0;
+    namespace->used  = 0;
+    for (i = 0; i < old_size; i++)
+    {
+        struct object_name *ptr = old_slots[i].name;
+        if (ptr && ptr != DELETED_NAME) insert_name( namespace, ptr, old_slots[i].hash );
+    }
+    free( old_slots );
+    namespace_resizes++;
+    return 1;
+}
+
+int namespace_add( struct namespace *namespace, struct object_name *ptr )
+{
+    /* keep the load factor, deleted slots included, below 3/4 */
+    if ((namespace->used + 1) * 4 > namespace->size * 3)
+    {
+        unsigned int size = namespace->size;
+        if ((namespace->count + 1) * 2 > size) size *= 2;
+        if (!resize_namespace( namespace, size )) return 0;
+    }
+    insert_name( namespace, ptr, get_name_hash( ptr->name, ptr->len ));
+    return 1;
+}
+
+/* remove a name from the namespace it has been added to */
+static void namespace_remove( struct object_name *ptr )
+{
+    struct namespace *namespace = ptr->namespace;
+    unsigned int mask = namespace->size - 1;
+
+    assert( namespace->slots[ptr->slot].name == ptr );
+    /* the slot can be freed if it doesn't break a probe sequence */
+    if (!namespace->slots[(ptr->slot + 1) & mask].name)
+    {
+        namespace->slots[ptr->slot].name = NULL;
+        namespace->used--;
+    }
+    else namespace->slots[ptr->slot].name = DELETED_NAME;
+    namespace->count--;
+    ptr->namespace = NULL;
+}
+
+/* dump the namespace lookup statistics */
+void dump_namespace_stats( FILE *file )
+{
+    fprintf( file, "# namespace lookups probes max_probes resizes\n" );
+    fprintf( file, "namespace %u %llu %u %u\n", namespace_lookups,
+             (unsigned long long)namespace_probes, namespace_max_probes, namespace_resizes );
 }
 
 /* allocate a name for an object */
@@ -150,6 +251,7 @@ static struct object_name *alloc_name( const struct unicode_str *name )
     {
         ptr->len = name->len;
         ptr->parent = NULL;
+        ptr->namespace = NULL;
         memcpy( ptr->name, name->str, name->len );
     }
     return ptr;
@@ -457,28 +559,34 @@ void release_object( void *ptr )
 struct object *find_object( const struct namespace *namespace, const struct unicode_str *name,
                             unsigned int attributes )
 {
-    const struct list *list;
-    struct list *p;
+    const struct name_slot *slot;
+    unsigned int hash, mask = namespace->size - 1, i, probes = 0;
+    struct object *obj = NULL;
 
     if (!name || !name->len) return NULL;
 
-    list = &namespace->names[ hash_strW( name->str, name->len, namespace->hash_size ) ];
-    LIST_FOR_EACH( p, list )
+    hash = get_name_hash( name->str, name->len );
+    for (i = hash & mask; (slot = &namespace->slots[i])->name; i = (i + 1) & mask)
     {
-        const struct object_name *ptr = LIST_ENTRY( p, struct object_name, entry );
-        if (ptr->len != name->len) continue;
+        const struct object_name *ptr = slot->name;
+
+        probes++;
+        if (ptr == DELETED_NAME || slot->hash != hash || ptr->len != name->len) continue;
         if (attributes & OBJ_CASE_INSENSITIVE)
         {
-            if (!memicmp_strW( ptr->name, name->str, name->len ))
-                return grab_object( ptr->obj );
+            if (memicmp_strW( ptr->name, name->str, name->len )) continue;
         }
         else
         {
-            if (!memcmp( ptr->name, name->str, name->len ))
-                return grab_object( ptr->obj );
+            if (memcmp( ptr->name, name->str, name->len )) continue;
         }
+        obj = grab_object( ptr->obj );
+        break;
     }
-    return NULL;
+    namespace_lookups++;
+    namespace_probes += probes;
+    namespace_max_probes = max( namespace_max_probes, probes );
+    return obj;
 }
 
 /* find an object by its index; the refcount is incremented */
@@ -486,12 +594,12 @@ struct object *find_object_index( const struct namespace *namespace, unsigned in
 {
     unsigned int i;
 
-    /* FIXME: not efficient at all */
-    for (i = 0; i < namespace->hash_size; i++)
+    if (index < namespace->count)
     {
-        const struct object_name *ptr;
-        LIST_FOR_EACH_ENTRY( ptr, &namespace->names[i], const struct object_name, entry )
+        for (i = 0; i < namespace->size; i++)
         {
+            const struct object_name *ptr = namespace->slots[i].name;
+            if (!ptr || ptr == DELETED_NAME) continue;
             if (!index--) return grab_object( ptr->obj );
         }
     }
@@ -499,21 +607,35 @@ struct object *find_object_index( const struct namespace *namespace, unsigned in
     return NULL;
 }
 
-/* allocate a namespace */
+/* allocate a namespace; the table grows as needed, hash_size is only the initial size hint */
 struct namespace *create_namespace( unsigned int hash_size )
 {
     struct namespace *namespace;
-    unsigned int i;
+    unsigned int size = 8;
 
-    namespace = mem_alloc( sizeof(*namespace) + (hash_size - 1) * sizeof(namespace->names[0]) );
-    if (namespace)
+    while (size < hash_size) size *= 2;
+    if (!(namespace = mem_alloc( sizeof(*namespace) ))) return NULL;
+    if (!(namespace->slots = mem_alloc( size * sizeof(*namespace->slots) )))
     {
-        namespace->hash_size      = hash_size;
-        for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
+        free( namespace );
+        return NULL;
     }
+    memset( namespace->slots, 0, size * sizeof(*namespace->slots) );
+    namespace->size  = size;
+    namespace->count = 0;
+    namespace->used  = 0;
     return namespace;
 }
 
+/* free a namespace; all the names must have been removed already */
+void free_namespace( struct namespace *namespace )
+{
+    if (!namespace) return;
+    assert( !namespace->count );
+    free( namespace->slots );
+    free( namespace );
+}
+
 /* functions for unimplemented/default object operations */
 
 int no_add_queue( struct object *obj, struct wait_queue_entry *entry )
@@ -715,7 +837,7 @@ int no_link_name( struct object *obj, struct object_name *name, struct object *p
 
 void default_unlink_name( struct object *obj, struct object_name *name )
 {
-    list_remove( &name->entry );
+    if (name->namespace) namespace_remove( name );
 }
 
 struct object *no_open_file( struct object *obj, unsigned int access, unsigned int sharing,
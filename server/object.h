@@ -22,6 +22,7 @@
 #define __WINE_SERVER_OBJECT_H
 
 #include <poll.h>
+#include <stdio.h>
 #include <sys/time.h>
 #include "wine/server_protocol.h"
 #include "wine/list.h"
@@ -129,7 +130,8 @@ struct object
 
 struct object_name
 {
-    struct list         entry;           /* entry in the hash list */
+    struct namespace   *namespace;       /* namespace containing this name */
+    unsigned int        slot;            /* slot index in the namespace table */
     struct object      *obj;             /* object owning this name */
     struct object      *parent;          /* parent object */
     data_size_t         len;             /* name length in bytes */
@@ -146,7 +148,8 @@ struct wait_queue_entry
 extern void *mem_alloc( size_t size ) __WINE_ALLOC_SIZE(1) __WINE_DEALLOC(free) __WINE_MALLOC;
 extern void *memdup( const void *data, size_t len ) __WINE_ALLOC_SIZE(2) __WINE_DEALLOC(free);
 extern void *alloc_object( const struct object_ops *ops );
-extern void namespace_add( struct namespace *namespace, struct object_name *ptr );
+extern int namespace_add( struct namespace *namespace, struct object_name *ptr );
+extern void dump_namespace_stats( FILE *file );
 extern const WCHAR *get_object_name( struct object *obj, data_size_t *len );
 extern WCHAR *default_get_full_name( struct object *obj, data_size_t *ret_len ) __WINE_DEALLOC(free) __WINE_MALLOC;
 extern void dump_object_name( struct object *obj );
@@ -160,6 +163,7 @@ extern void *open_named_object( struct object *parent, const struct object_ops *
                                 const struct unicode_str *name, unsigned int attributes );
 extern void unlink_named_object( struct object *obj );
 extern struct namespace *create_namespace( unsigned int hash_size );
+extern void free_namespace( struct namespace *namespace );
 extern void free_kernel_objects( struct object *obj );
 /* grab/release_object can take any pointer, but you better make sure */
 /* that the thing pointed to starts with a struct object... */
@@ -247,6 +251,7 @@ extern unsigned short supported_machines[8];
 extern unsigned short native_machine;
 extern void init_registry(void);
 extern void flush_registry(void);
+extern int registry_child_exited( int pid, int status );
 
 static inline int is_machine_32bit( unsigned short machine )
 {
@@ -145,6 +145,7 @@ void sigchld_callback(void)
         {
             struct thread *thread = get_thread_from_tid( pid );
             if (!thread) thread = get_thread_from_pid( pid );
+            if (!thread && registry_child_exited( pid, status )) continue;
             handle_child_status( thread, pid, status, -1 );
         }
         else break;
@@ -33,8 +33,10 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -91,6 +93,9 @@ struct key
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
     abstime_t         timestamp_counter; /* timestamp counter at last change */
+    struct hive      *hive;        /* hive image to load the subkeys and values from, if not loaded yet */
+    unsigned int      hive_offset; /* offset of the key in the hive image */
+    unsigned int      gen_index;   /* index of the key in the registry generation table */
 };
 
 /* key flags */
@@ -125,6 +130,10 @@ static abstime_t change_timestamp_counter;
 /* the root of the registry tree */
 static struct key *root_key;
 
+/* generation counters shared with the clients to invalidate their cached registry data */
+static registry_shm_t *registry_shared;
+static unsigned int next_gen_index;
+
 static const timeout_t ticks_1601_to_1970 = (timeout_t)86400 * (369 * 365 + 89) * TICKS_PER_SEC;
 static enum prefix_type prefix_type;
 
@@ -133,17 +142,98 @@ static const WCHAR symlink_value[] = {'S','y','m','b','o','l','i','c','L','i','n
 static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_value) };
 
 static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static void load_key_from_hive( struct key *key );
+
+/*
+ * Hive images
+ *
+ * When WINESERVER_REGISTRY_IMAGE is set, a binary image of each branch is written to
+ * <branch file>.bin every time the branch file is saved. On startup, if the image matches
+ * the branch file, it is mapped instead of parsing the text, and each key only gets its
+ * subkeys and values created from the image the first time they are needed. The text
+ * format remains the reference: an image is ignored once the branch file has changed.
+ */
+
+#define HIVE_MAGIC   "WINEHIVE"
+#define HIVE_VERSION 2
+
+struct hive_header
+{
+    char             magic[8];     /* HIVE_MAGIC */
+    unsigned int     version;      /* HIVE_VERSION */
+    unsigned int     prefix_type;  /* prefix type of the branch */
+    unsigned __int64 file_size;    /* size of the branch file the image matches */
+    unsigned __int64 file_mtime;   /* modification time of the branch file */
+    unsigned __int64 file_mtime_nsec; /* nanoseconds part of the modification time */
+    unsigned __int64 file_ino;     /* inode of the branch file */
+    unsigned int     size;         /* total size of the image */
+    unsigned int     root;         /* offset of the root key */
+};
+
+struct hive_key
+{
+    timeout_t        modif;        /* last modification time */
+    unsigned int     flags;        /* saved key flags (KEY_SYMLINK) */
+    unsigned int     namelen;      /* name length in bytes */
+    unsigned int     name;         /* offset of the name */
+    unsigned int     classlen;     /* class length in bytes */
+    unsigned int     class;        /* offset of the class */
+    unsigned int     subkey_count; /* number of subkeys */
+    unsigned int     subkeys;      /* offset of the subkey offsets, in find_subkey() order */
+    unsigned int     value_count;  /* number of values */
+    unsigned int     values;       /* offset of the hive_value array, in find_value() order */
+};
+
+struct hive_value
+{
+    unsigned int     type;         /* value type */
+    unsigned int     namelen;      /* name length in bytes */
+    unsigned int     name;         /* offset of the name */
+    unsigned int     len;          /* data length in bytes */
+    unsigned int     data;         /* offset of the data */
+};
+
+/* a mapped hive image; it is never unmapped since keys keep pointing to it */
+struct hive
+{
+    const char      *base;         /* base of the mapping */
+    size_t           size;         /* size of the mapping */
+    const char      *path;         /* branch file name */
+    const struct key *root;        /* root key of the branch */
+    int              failed;       /* some keys could not be loaded, the branch must not be saved */
+};
+
+#define HIVE_MAX_DEPTH 512
+
+#define HIVE_ALIGN(size) (((size) + 7) & ~7)
+
+static int use_hive_images;
+
+/* load the subkeys and values of a key from its hive image if not done yet */
+static inline void load_lazy_key( const struct key *key )
+{
+    if (key->hive) load_key_from_hive( (struct key *)key );
+}
 
 /* information about where to save a registry branch */
 struct save_branch_info
 {
     struct key  *key;
     const char  *path;
+    FILE        *journal;          /* journal of the changes since the last save */
+    int          journal_old;      /* an older journal is still waiting to be compacted */
+    pid_t        compact_pid;      /* pid of the process compacting the journal */
+    abstime_t    compact_counter;  /* change counter at the start of the compaction */
+    struct timeout_user *compact_timeout;  /* pending compaction */
 };
 
 #define MAX_SAVE_BRANCH_INFO 3
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
+static struct hive *hives[MAX_SAVE_BRANCH_INFO];  /* hive images of the branches */
+
+/* journal size that triggers a compaction, 0 if journaling is disabled */
+static long journal_limit;
 
 unsigned int supported_machines_count = 0;
 unsigned short supported_machines[8];
@@ -294,6 +384,7 @@ static struct key *find_subkey( const struct key *key, const struct unicode_str
     int i, min, max, res;
     data_size_t len;
 
+    load_lazy_key( key );
     min = 0;
     max = key->last_subkey;
     while (min <= max)
@@ -339,27 +430,34 @@ static int grow_subkeys( struct key *key )
     return 1;
 }
 
+/* save the name and options of a key to a text file */
+static void save_key_header( const struct key *key, const struct key *base, FILE *f )
+{
+    fprintf( f, "\n[" );
+    if (key != base) dump_path( key, base, f );
+    fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+    fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
+    if (key->class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( key->class, key->classlen, f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+}
+
 /* save a registry and all its subkeys to a text file */
 static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
 {
     int i;
 
     if (key->flags & KEY_VOLATILE) return;
+    load_lazy_key( key );
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
     {
-        fprintf( f, "\n[" );
-        if (key != base) dump_path( key, base, f );
-        fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
-        fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
-        if (key->class)
-        {
-            fprintf( f, "#class=\"" );
-            dump_strW( key->class, key->classlen, f, "\"\"" );
-            fprintf( f, "\"\n" );
-        }
-        if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+        save_key_header( key, base, f );
         for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
     }
     for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
@@ -569,6 +667,7 @@ static struct object *key_lookup_name( struct object *obj, struct unicode_str *n
     {
         name->str += next / sizeof(WCHAR);
         name->len -= next;
+        load_lazy_key( found );
         if ((attr & OBJ_KEY_WOW64) && found->wow6432node && !is_wow6432node( name->str, name->len ))
             found = found->wow6432node;
     }
@@ -595,6 +694,7 @@ static int key_link_name( struct object *obj, struct object_name *name, struct o
         return 0;
     }
 
+    load_lazy_key( parent_key );
     if (parent_key->last_subkey + 1 == parent_key->nb_subkeys)
     {
         /* need to grow the array */
@@ -655,6 +755,8 @@ static int key_close_handle( struct object *obj, struct process *process, obj_ha
     struct key * key = (struct key *) obj;
     struct notify *notify = find_notify( key, process, handle );
     if (notify) do_notification( key, notify, 1 );
+    /* clients cache data by handle, the value may be reused for another key */
+    if (registry_shared) registry_shared->generation[key->gen_index]++;
     return 1;  /* ok to close */
 }
 
@@ -712,6 +814,9 @@ static struct key *create_key_object( struct object *parent, const struct unicod
             key->values      = NULL;
             key->modif       = modif;
             key->timestamp_counter = 0;
+            key->hive        = NULL;
+            key->hive_offset = 0;
+            key->gen_index   = next_gen_index++ % REGISTRY_GENERATION_COUNT;
             list_init( &key->notify_list );
 
             if (options & REG_OPTION_CREATE_LINK) key->flags |= KEY_SYMLINK;
@@ -732,12 +837,14 @@ static struct key *create_key_object( struct object *parent, const struct unicod
 /* mark a key and all its parents as dirty (modified) */
 static void make_dirty( struct key *key )
 {
-    ++change_timestamp_counter;
+    if (key->flags & KEY_VOLATILE) return;  /* nothing to do */
+    /* the counter of the modified key has to be updated even if it is dirty already,
+     * since make_clean() may be called with a counter from before this change */
+    key->timestamp_counter = ++change_timestamp_counter;
     while (key)
     {
         if (key->flags & (KEY_DIRTY|KEY_VOLATILE)) return;  /* nothing to do */
         key->flags |= KEY_DIRTY;
-        key->timestamp_counter = change_timestamp_counter;
         key = get_parent( key );
     }
 }
@@ -745,12 +852,17 @@ static void make_dirty( struct key *key )
 /* mark a key and all its subkeys as clean (not modified) */
 static void make_clean( struct key *key, abstime_t timestamp_counter )
 {
-    int i;
+    int i, dirty = 0;
 
     if (key->flags & KEY_VOLATILE) return;
     if (!(key->flags & KEY_DIRTY)) return;
-    if (key->timestamp_counter <= timestamp_counter) key->flags &= ~KEY_DIRTY;
-    for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i], timestamp_counter );
+    for (i = 0; i <= key->last_subkey; i++)
+    {
+        make_clean( key->subkeys[i], timestamp_counter );
+        if ((key->subkeys[i]->flags & (KEY_DIRTY|KEY_VOLATILE)) == KEY_DIRTY) dirty = 1;
+    }
+    /* a key stays dirty as long as one of its subkeys is, since make_dirty() stops there */
+    if (!dirty && key->timestamp_counter <= timestamp_counter) key->flags &= ~KEY_DIRTY;
 }
 
 /* go through all the notifications and send them if necessary */
@@ -766,11 +878,285 @@ static void check_notify( struct key *key, unsigned int change, int not_subtree
     }
 }
 
+/*
+ * Registry journal
+ *
+ * When WINESERVER_REGISTRY_JOURNAL is set, every change to a key of a saved branch is
+ * appended to <branch file>.journal, in the same format as the branch file plus "-[key]"
+ * and "-"value"" lines for deletions. Once the journal grows past the limit, it is renamed
+ * to <branch file>.journal.old and a forked child rewrites the branch file from a snapshot
+ * of the tree, while the changes made in the meantime go to a new journal. The old journal
+ * is removed once the child has succeeded. Journals left over by a crash are replayed
+ * when the branch is loaded. Clients never rewrite a journaled branch file: NtFlushKey
+ * only syncs the journal, so the file can't be replaced by an older snapshot.
+ */
+
+static int save_branch( struct key *key, const char *path );
+
+static const char journal_header[] = "WINE REGISTRY Version 2\n";
+
+/* build the name of the journal file of a branch */
+static char *get_journal_name( const char *path, int old )
+{
+    char *name = malloc( strlen( path ) + sizeof(".journal.old") );
+
+    if (name) sprintf( name, "%s.journal%s", path, old ? ".old" : "" );
+    return name;
+}
+
+/* remove a journal file; the current directory must be the config dir */
+static void remove_journal( const char *path, int old )
+{
+    char *name = get_journal_name( path, old );
+
+    if (name) unlink( name );
+    free( name );
+}
+
+/* open the journal of a branch for appending; the current directory must be the config dir */
+static void open_journal( struct save_branch_info *branch )
+{
+    char *name = get_journal_name( branch->path, 0 );
+
+    if (name && (branch->journal = fopen( name, "a" )))
+    {
+        fseek( branch->journal, 0, SEEK_END );
+        if (!ftell( branch->journal )) fputs( journal_header, branch->journal );
+        fflush( branch->journal );
+    }
+    else fprintf( stderr, "wineserver: cannot open registry journal for %s\n", branch->path );
+    free( name );
+}
+
+/* close the journal of a branch */
+static void close_journal( struct save_branch_info *branch )
+{
+    if (branch->compact_timeout) remove_timeout_user( branch->compact_timeout );
+    branch->compact_timeout = NULL;
+    if (branch->journal) fclose( branch->journal );
+    branch->journal = NULL;
+}
+
+/* rewrite the branch file from a snapshot and start a new journal */
+static void compact_journal( struct save_branch_info *branch )
+{
+    char *name = get_journal_name( branch->path, 0 ), *old_name = get_journal_name( branch->path, 1 );
+
+    if (!name || !old_name || fchdir( config_dir_fd ) == -1) goto done;
+
+#ifdef USE_PTRACE
+    /* the old journal covers the snapshot, the new one the changes made after it */
+    fclose( branch->journal );
+    branch->journal = NULL;
+    if (!rename( name, old_name ))
+    {
+        pid_t pid;
+
+        branch->journal_old = 1;
+        switch ((pid = fork()))
+        {
+        case 0:
+            _exit( !save_branch( branch->key, branch->path ));
+        case -1:
+            fprintf( stderr, "wineserver: fork: %s\n", strerror( errno ));
+            break;
+        default:
+            branch->compact_pid = pid;
+            branch->compact_counter = change_timestamp_counter;
+            break;
+        }
+    }
+    open_journal( branch );
+#else
+    /* the child could not be reaped without ptrace, save synchronously instead */
+    if (save_branch( branch->key, branch->path ))
+    {
+        fclose( branch->journal );
+        branch->journal = NULL;
+        unlink( name );
+        open_journal( branch );
+    }
+    else branch->journal_old = 1;  /* don't try again on every change */
+#endif
+
+    if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+done:
+    free( name );
+    free( old_name );
+}
+
+static void compact_journal_timeout( void *private )
+{
+    struct save_branch_info *branch = private;
+
+    branch->compact_timeout = NULL;
+    compact_journal( branch );
+}
+
+/* check if an exited child was compacting a journal and finish the compaction */
+int registry_child_exited( int pid, int status )
+{
+    int i;
+
+    for (i = 0; i < save_branch_count; i++)
+    {
+        struct save_branch_info *branch = &save_branch_info[i];
+
+        if (!branch->compact_pid || branch->compact_pid != pid) continue;
+        if (!WIFEXITED(status) && !WIFSIGNALED(status)) return 1;
+        branch->compact_pid = 0;
+        if (WIFEXITED(status) && !WEXITSTATUS(status))
+        {
+            make_clean( branch->key, branch->compact_counter );
+            if (fchdir( config_dir_fd ) == -1) return 1;
+            remove_journal( branch->path, 1 );
+            branch->journal_old = 0;
+            if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+        }
+        else fprintf( stderr, "wineserver: could not save registry branch to %s\n", branch->path );
+        return 1;
+    }
+    return 0;
+}
+
+/* wait for a running compaction to terminate */
+static void wait_compaction( struct save_branch_info *branch )
+{
+    int status;
+
+    if (!branch->compact_pid) return;
+    if (waitpid( branch->compact_pid, &status, 0 ) == branch->compact_pid)
+        registry_child_exited( branch->compact_pid, status );
+    branch->compact_pid = 0;
+}
+
+/* get the branch whose journal should record changes to the key */
+static struct save_branch_info *get_journal_branch( const struct key *key )
+{
+    int i;
+
+    if (!journal_limit || (key->flags & KEY_VOLATILE)) return NULL;
+    for ( ; key; key = get_parent( key ))
+    {
+        for (i = 0; i < save_branch_count; i++)
+        {
+            if (save_branch_info[i].key != key) continue;
+            return save_branch_info[i].journal ? &save_branch_info[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+/* flush a journal record, and schedule a compaction if the journal has grown too large */
+static void commit_journal( struct save_branch_info *branch )
+{
+    fflush( branch->journal );
+    if (branch->journal_old || branch->compact_timeout) return;
+    if (ftell( branch->journal ) < journal_limit) return;
+    /* run it from the main loop, once the current request is done with the tree */
+    branch->compact_timeout = add_timeout_user( 0, compact_journal_timeout, branch );
+}
+
+/* append a key, and optionally one of its values, to the journal */
+static void journal_key( const struct key *key, const struct key_value *value )
+{
+    struct save_branch_info *branch = get_journal_branch( key );
+
+    if (!branch) return;
+    save_key_header( key, branch->key, branch->journal );
+    if (value) dump_value( value, branch->journal );
+    commit_journal( branch );
+}
+
+/* append a key and all its subkeys to the journal */
+static void journal_subkeys( const struct key *key )
+{
+    struct save_branch_info *branch = get_journal_branch( key );
+
+    if (!branch) return;
+    save_subkeys( key, branch->key, branch->journal );
+    commit_journal( branch );
+}
+
+/* append the deletion of a key value to the journal */
+static void journal_delete_value( const struct key *key, const struct unicode_str *name )
+{
+    struct save_branch_info *branch = get_journal_branch( key );
+
+    if (!branch) return;
+    save_key_header( key, branch->key, branch->journal );
+    if (name->len)
+    {
+        fputs( "-\"", branch->journal );
+        dump_strW( name->str, name->len, branch->journal, "\"\"" );
+        fputs( "\"\n", branch->journal );
+    }
+    else fputs( "-@\n", branch->journal );
+    commit_journal( branch );
+}
+
+/* append the deletion of a key and all its subkeys to the journal */
+static void journal_delete_key( const struct key *key )
+{
+    struct save_branch_info *branch = get_journal_branch( key );
+
+    if (!branch || key == branch->key) return;
+    fputs( "\n-[", branch->journal );
+    dump_path( key, branch->key, branch->journal );
+    fputs( "]\n", branch->journal );
+    commit_journal( branch );
+}
+
+/* invalidate the data that clients have cached for a key and its parent enumeration */
+static void update_key_generation( struct key *key )
+{
+    struct key *parent;
+
+    if (!registry_shared) return;
+    registry_shared->generation[key->gen_index]++;
+    if ((parent = get_parent( key ))) registry_shared->generation[parent->gen_index]++;
+}
+
+/* invalidate all the registry data cached by clients */
+static void update_all_generations(void)
+{
+    unsigned int i;
+
+    if (!registry_shared) return;
+    for (i = 0; i < REGISTRY_GENERATION_COUNT; i++) registry_shared->generation[i]++;
+}
+
+/* return the current generation of a key, to let the client cache the returned data */
+static void get_key_generation( const struct key *key, unsigned int *index, unsigned int *generation )
+{
+    *index = key->gen_index;
+    *generation = registry_shared ? registry_shared->generation[key->gen_index] : 0;
+}
+
+/* create the generation table that clients use to validate their registry cache */
+static void init_registry_generations(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+                                  '_','_','w','i','n','e','_','r','e','g','i','s','t','r','y','_',
+                                  'g','e','n','e','r','a','t','i','o','n','s'};
+    static const struct unicode_str name = { nameW, sizeof(nameW) };
+    struct object *mapping;
+    void *ptr;
+
+    if (!(mapping = create_shared_mapping( NULL, &name, sizeof(struct registry_shared_memory),
+                                           OBJ_PERMANENT, NULL, &ptr )))
+        return;
+    registry_shared = ptr;
+    memset( (void *)registry_shared, 0, sizeof(*registry_shared) );
+    release_object( mapping );
+}
+
 /* update key modification time */
 static void touch_key( struct key *key, unsigned int change )
 {
     key->modif = current_time;
     make_dirty( key );
+    update_key_generation( key );
 
     /* do notifications */
     check_notify( key, change, 1 );
@@ -780,9 +1166,10 @@ static void touch_key( struct key *key, unsigned int change )
 /* get the wow6432node key if any, grabbing it and releasing the original key */
 static struct key *grab_wow6432node( struct key *key )
 {
-    struct key *ret = key->wow6432node;
+    struct key *ret;
 
-    if (!ret) return key;
+    load_lazy_key( key );
+    if (!(ret = key->wow6432node)) return key;
     if (ret->flags & KEY_WOWREFLECT) return key;
     grab_object( ret );
     release_object( key );
@@ -799,6 +1186,7 @@ static struct key *get_wow6432node( struct key *key )
     if (!key)
         return NULL;
 
+    load_lazy_key( key );
     if (key->wow6432node)
         return key->wow6432node;
 
@@ -872,6 +1260,7 @@ static struct key *create_key( struct key *parent, const struct unicode_str *nam
     else
     {
         if (parent) touch_key( get_parent( key ), REG_NOTIFY_CHANGE_NAME );
+        journal_key( key, NULL );
         if (debug_level > 1) dump_operation( key, NULL, "Create" );
     }
     return key;
@@ -922,6 +1311,7 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
         return;
     }
 
+    load_lazy_key( key );
     if (index != -1)  /* -1 means use the specified key directly */
     {
         if ((index < 0) || (index > key->last_subkey))
@@ -1038,8 +1428,11 @@ static void rename_key( struct key *key, const struct unicode_str *new_name )
     new_name_ptr->obj = &key->obj;
     new_name_ptr->len = new_name->len;
     new_name_ptr->parent = &parent->obj;
+    new_name_ptr->namespace = NULL;
     memcpy( new_name_ptr->name, new_name->str, new_name->len );
 
+    journal_delete_key( key );
+
     for (cur_index = 0; cur_index <= parent->last_subkey; cur_index++)
         if (parent->subkeys[cur_index] == key) break;
 
@@ -1059,6 +1452,7 @@ static void rename_key( struct key *key, const struct unicode_str *new_name )
 
     if (debug_level > 1) dump_operation( key, NULL, "Rename" );
     touch_key( key, REG_NOTIFY_CHANGE_NAME );
+    journal_subkeys( key );
 }
 
 /* delete a key and its values */
@@ -1079,6 +1473,7 @@ static int delete_key( struct key *key, int recurse )
         return 0;
     }
 
+    load_lazy_key( key );
     if (recurse)
     {
         while (key->last_subkey >= 0)
@@ -1091,7 +1486,9 @@ static int delete_key( struct key *key, int recurse )
     }
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    journal_delete_key( key );
     key->flags |= KEY_DELETED;
+    update_key_generation( key );
     unlink_named_object( &key->obj );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 1;
@@ -1128,6 +1525,7 @@ static struct key_value *find_value( const struct key *key, const struct unicode
     int i, min, max, res;
     data_size_t len;
 
+    load_lazy_key( key );
     min = 0;
     max = key->last_value;
     while (min <= max)
@@ -1174,6 +1572,138 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
     return value;
 }
 
+/* get the nanoseconds part of the modification time of a branch file */
+static unsigned __int64 get_mtime_nsec( const struct stat *st )
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    return st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    return st->st_mtimespec.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+/* get a pointer to an array of elements inside a hive image, or NULL if out of bounds */
+static const void *get_hive_data( const struct hive *hive, unsigned int offset,
+                                  unsigned int count, size_t size )
+{
+    if (!count) return hive->base;  /* any valid pointer */
+    if (HIVE_ALIGN( offset ) != offset || offset > hive->size) return NULL;
+    if (count > (hive->size - offset) / size) return NULL;
+    return hive->base + offset;
+}
+
+/* create the subkeys and values of a key from its hive image */
+static void load_key_from_hive( struct key *key )
+{
+    struct hive *hive = key->hive;
+    const struct hive_key *image, *subimage;
+    const struct hive_value *values;
+    const unsigned int *subkeys;
+    struct key_value *value;
+    struct key *subkey;
+    struct unicode_str name;
+    unsigned int i, error = get_error();
+    int index;
+
+    key->hive = NULL;
+    if (!(image = get_hive_data( hive, key->hive_offset, 1, sizeof(*image) ))) goto corrupted;
+    if (!(values = get_hive_data( hive, image->values, image->value_count, sizeof(*values) ))) goto corrupted;
+    if (!(subkeys = get_hive_data( hive, image->subkeys, image->subkey_count, sizeof(*subkeys) ))) goto corrupted;
+
+    for (i = 0; i < image->value_count; i++)
+    {
+        const void *data;
+
+        name.len = values[i].namelen;
+        if (!(name.str = get_hive_data( hive, values[i].name, name.len, 1 ))) goto corrupted;
+        if (!(data = get_hive_data( hive, values[i].data, values[i].len, 1 ))) goto corrupted;
+        if (find_value( key, &name, &index )) continue;
+        if (!(value = insert_value( key, &name, index ))) goto failed;
+        if (values[i].len && !(value->data = memdup( data, values[i].len ))) goto failed;
+        value->type = values[i].type;
+        value->len  = values[i].len;
+    }
+
+    for (i = 0; i < image->subkey_count; i++)
+    {
+        if (!(subimage = get_hive_data( hive, subkeys[i], 1, sizeof(*subimage) ))) goto corrupted;
+        name.len = subimage->namelen;
+        if (!(name.str = get_hive_data( hive, subimage->name, name.len, 1 ))) goto corrupted;
+        if (!name.len || name.len > MAX_NAME_LEN * sizeof(WCHAR) ||
+            get_path_element( name.str, name.len ) != name.len) goto corrupted;
+        if (!(subkey = create_key_object( &key->obj, &name, OBJ_OPENIF, 0, subimage->modif, NULL ))) goto failed;
+        if (get_error() != STATUS_OBJECT_NAME_EXISTS)
+        {
+            const WCHAR *class = get_hive_data( hive, subimage->class, subimage->classlen, 1 );
+
+            subkey->flags = subimage->flags & KEY_SYMLINK;
+            if (class && subimage->classlen && (subkey->class = memdup( class, subimage->classlen )))
+                subkey->classlen = subimage->classlen;
+            subkey->hive = hive;
+            subkey->hive_offset = subkeys[i];
+        }
+        release_object( subkey );
+        clear_error();
+    }
+    set_error( error );
+    return;
+
+corrupted:
+    fprintf( stderr, "wineserver: corrupted registry image for %s\n", hive->path );
+failed:
+    /* the tree is incomplete now, saving it would lose the missing keys for good */
+    if (!hive->failed) fprintf( stderr, "wineserver: %s will not be saved\n", hive->path );
+    hive->failed = 1;
+    set_error( error );
+}
+
+/* check that a key and its subkeys are fully inside the hive image before anything is loaded from it */
+static int validate_hive_key( const struct hive *hive, unsigned int offset, unsigned int depth,
+                              unsigned int *budget )
+{
+    const struct hive_key *image, *subimage;
+    const struct hive_value *values;
+    const unsigned int *subkeys;
+    struct unicode_str name;
+    unsigned int i;
+
+    /* the budget stops images where keys share subkeys from taking forever */
+    if (depth > HIVE_MAX_DEPTH || !*budget) return 0;
+    --*budget;
+    if (!(image = get_hive_data( hive, offset, 1, sizeof(*image) ))) return 0;
+    if (!(values = get_hive_data( hive, image->values, image->value_count, sizeof(*values) ))) return 0;
+    if (!(subkeys = get_hive_data( hive, image->subkeys, image->subkey_count, sizeof(*subkeys) ))) return 0;
+
+    for (i = 0; i < image->value_count; i++)
+    {
+        if (!get_hive_data( hive, values[i].name, values[i].namelen, 1 )) return 0;
+        if (!get_hive_data( hive, values[i].data, values[i].len, 1 )) return 0;
+    }
+    for (i = 0; i < image->subkey_count; i++)
+    {
+        if (!(subimage = get_hive_data( hive, subkeys[i], 1, sizeof(*subimage) ))) return 0;
+        name.len = subimage->namelen;
+        if (!(name.str = get_hive_data( hive, subimage->name, name.len, 1 ))) return 0;
+        if (!name.len || name.len > MAX_NAME_LEN * sizeof(WCHAR) ||
+            get_path_element( name.str, name.len ) != name.len) return 0;
+        if (!get_hive_data( hive, subimage->class, subimage->classlen, 1 )) return 0;
+        if (!validate_hive_key( hive, subkeys[i], depth + 1, budget )) return 0;
+    }
+    return 1;
+}
+
+/* check whether any hive image of a branch failed to load completely */
+static int is_hive_failed( const struct key *key )
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(hives); i++)
+        if (hives[i] && hives[i]->root == key && hives[i]->failed) return 1;
+    return 0;
+}
+
 /* set a key value */
 static void set_value( struct key *key, const struct unicode_str *name,
                        int type, const void *data, data_size_t len )
@@ -1225,6 +1755,7 @@ static void set_value( struct key *key, const struct unicode_str *name,
     value->len   = len;
     value->data  = ptr;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_key( key, value );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
 
@@ -1265,6 +1796,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         return;
     }
 
+    load_lazy_key( key );
     if (i < 0 || i > key->last_value) set_error( STATUS_NO_MORE_ENTRIES );
     else
     {
@@ -1334,6 +1866,7 @@ static void delete_value( struct key *key, const struct unicode_str *name )
     for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
     key->last_value--;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_delete_value( key, name );
 
     /* try to shrink the array */
     nb_values = key->nb_values;
@@ -1691,6 +2224,61 @@ static int load_value( struct key *key, const char *buffer, struct file_load_inf
     return 0;
 }
 
+/* delete a value listed in a journal */
+static void load_deleted_value( struct key *key, const char *buffer, struct file_load_info *info )
+{
+    struct unicode_str name;
+    data_size_t len;
+
+    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return;
+    name.str = info->tmp;
+    name.len = 0;
+    if (buffer[0] != '@')
+    {
+        len = info->tmplen;
+        if (buffer[0] != '\"' || parse_strW( info->tmp, &len, buffer + 1, '\"' ) == -1)
+        {
+            file_read_error( "Malformed value name", info );
+            return;
+        }
+        name.len = len - sizeof(WCHAR);  /* terminating null */
+    }
+    delete_value( key, &name );
+    clear_error();
+}
+
+/* delete a key listed in a journal, along with its subkeys */
+static void load_deleted_key( struct key *base, const char *buffer, struct file_load_info *info )
+{
+    struct key *key = base;
+    struct unicode_str name, tmp;
+    data_size_t len;
+    int index;
+
+    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return;
+    len = info->tmplen;
+    if (parse_strW( info->tmp, &len, buffer, ']' ) == -1)
+    {
+        file_read_error( "Malformed key", info );
+        return;
+    }
+    name.str = info->tmp;
+    name.len = len - sizeof(WCHAR);  /* terminating null */
+    while (key && name.len)
+    {
+        tmp.str = name.str;
+        tmp.len = get_path_element( name.str, name.len );
+        key = find_subkey( key, &tmp, &index );
+
+        /* skip trailing \ and move to the next element */
+        if (tmp.len < name.len) tmp.len += sizeof(WCHAR);
+        name.str += tmp.len / sizeof(WCHAR);
+        name.len -= tmp.len;
+    }
+    if (key && key != base) delete_key( key, 1 );
+    clear_error();
+}
+
 /* return the length (in path elements) of name that is part of the key name */
 /* for instance if key is USER\foo\bar and name is foo\bar\baz, return 2 */
 static int get_prefix_len( struct key *key, const char *name, struct file_load_info *info )
@@ -1720,7 +2308,8 @@ static int get_prefix_len( struct key *key, const char *name, struct file_load_i
 
 /* load all the keys from the input file */
 /* prefix_len is the number of key name prefixes to skip, or -1 for autodetection */
-static void load_keys( struct key *key, const char *filename, FILE *f, int prefix_len )
+/* journal files are replayed on top of the existing keys, and can contain deletions */
+static void load_keys( struct key *key, const char *filename, FILE *f, int prefix_len, int journal )
 {
     struct key *subkey = NULL;
     struct file_load_info info;
@@ -1761,6 +2350,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             if (prefix_len == -1) prefix_len = get_prefix_len( key, p + 1, &info );
             if (!(subkey = load_key( key, p + 1, prefix_len, &info, &modif )))
                 file_read_error( "Error creating key", &info );
+            else if (journal) subkey->modif = 0;  /* the journal time replaces it */
             break;
         case '@':   /* default value */
         case '\"':  /* value */
@@ -1771,6 +2361,21 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             if (subkey) load_key_option( subkey, p, &info );
             else if (!load_global_option( p, &info )) goto done;
             break;
+        case '-':   /* deleted key or value in a journal */
+            if (!journal) file_read_error( "Unrecognized input", &info );
+            else if (p[1] == '[')
+            {
+                if (subkey)
+                {
+                    update_key_time( subkey, modif );
+                    release_object( subkey );
+                    subkey = NULL;
+                }
+                load_deleted_key( key, p + 2, &info );
+            }
+            else if (subkey) load_deleted_value( subkey, p + 1, &info );
+            else file_read_error( "Value without key", &info );
+            break;
         case ';':   /* comment */
         case 0:     /* empty line */
             break;
@@ -1804,21 +2409,106 @@ static void load_registry( struct key *key, obj_handle_t handle )
         FILE *f = fdopen( fd, "r" );
         if (f)
         {
-            load_keys( key, NULL, f, -1 );
+            load_keys( key, NULL, f, -1, 0 );
             fclose( f );
         }
         else file_set_error();
     }
 }
 
+/* map the hive image of a branch file if it is up to date, and attach it to the branch key */
+static int load_hive_image( struct key *key, const char *filename, int fd )
+{
+    const struct hive_header *header;
+    struct hive *hive;
+    struct stat st, image_st;
+    char *image_path;
+    unsigned int i, budget;
+    void *base;
+    int image_fd;
+
+    if (fstat( fd, &st ) == -1) return 0;
+    if (!(image_path = malloc( strlen( filename ) + sizeof(".bin") ))) return 0;
+    sprintf( image_path, "%s.bin", filename );
+    image_fd = open( image_path, O_RDONLY );
+    free( image_path );
+    if (image_fd == -1) return 0;
+
+    if (fstat( image_fd, &image_st ) == -1 || image_st.st_size < (off_t)sizeof(*header) ||
+        (base = mmap( NULL, image_st.st_size, PROT_READ, MAP_PRIVATE, image_fd, 0 )) == MAP_FAILED)
+    {
+        close( image_fd );
+        return 0;
+    }
+    close( image_fd );
+
+    header = base;
+    if (memcmp( header->magic, HIVE_MAGIC, sizeof(header->magic) ) || header->version != HIVE_VERSION ||
+        header->size != image_st.st_size || !header->root || header->file_size != st.st_size ||
+        header->file_mtime != st.st_mtime || header->file_mtime_nsec != get_mtime_nsec( &st ) ||
+        header->file_ino != st.st_ino ||
+        (prefix_type != PREFIX_UNKNOWN && header->prefix_type != PREFIX_UNKNOWN &&
+         header->prefix_type != prefix_type) ||
+        !(hive = mem_alloc( sizeof(*hive) )))
+    {
+        munmap( base, image_st.st_size );
+        return 0;
+    }
+
+    hive->base   = base;
+    hive->size   = image_st.st_size;
+    hive->path   = filename;
+    hive->root   = key;
+    hive->failed = 0;
+
+    /* a corrupted image is rejected as a whole, so that the text file is parsed instead */
+    budget = hive->size / sizeof(struct hive_key);
+    for (i = 0; i < ARRAY_SIZE(hives); i++) if (!hives[i]) break;
+    if (i == ARRAY_SIZE(hives) || !validate_hive_key( hive, header->root, 0, &budget ))
+    {
+        fprintf( stderr, "wineserver: ignoring corrupted registry image for %s\n", filename );
+        munmap( base, image_st.st_size );
+        free( hive );
+        return 0;
+    }
+    hives[i] = hive;
+
+    if (prefix_type == PREFIX_UNKNOWN) prefix_type = header->prefix_type;
+    key->hive = hive;
+    key->hive_offset = header->root;
+    /* the tree matches the branch file */
+    make_clean( key, change_timestamp_counter );
+    return 1;
+}
+
+/* replay a journal file on top of a branch; return 1 if it existed */
+static int load_journal( struct key *key, const char *filename, int old )
+{
+    char *name = get_journal_name( filename, old );
+    FILE *f;
+
+    if (!name) return 0;
+    if ((f = fopen( name, "r" )))
+    {
+        load_keys( key, name, f, 0, 1 );
+        fclose( f );
+        clear_error();
+    }
+    free( name );
+    return (f != NULL);
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
+    struct save_branch_info *branch;
+    int journal;
     FILE *f;
 
     if ((f = fopen( filename, "r" )))
     {
-        load_keys( key, filename, f, 0 );
+        if (!use_hive_images || !load_hive_image( key, filename, fileno( f )))
+            load_keys( key, filename, f, 0, 0 );
         fclose( f );
         if (get_error() == STATUS_NOT_REGISTRY_FILE)
         {
@@ -1829,9 +2519,25 @@ static int load_init_registry_from_file( const char *filename, struct key *key )
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    branch = &save_branch_info[save_branch_count++];
+    branch->path = filename;
+    branch->key = (struct key *)grab_object( key );
     make_object_permanent( &key->obj );
+
+    /* apply the changes journaled before an unclean shutdown, and save them right away */
+    journal = load_journal( key, filename, 1 );
+    journal |= load_journal( key, filename, 0 );
+    if (journal)
+    {
+        make_dirty( key );
+        if (save_branch( key, filename ))
+        {
+            remove_journal( filename, 1 );
+            remove_journal( filename, 0 );
+        }
+        else branch->journal_old = 1;
+    }
+    if (journal_limit) open_journal( branch );
     return (f != NULL);
 }
 
@@ -1910,10 +2616,19 @@ void init_registry(void)
     unsigned int i;
     char *p;
 
+    if ((p = getenv( "WINESERVER_REGISTRY_IMAGE" ))) use_hive_images = atoi( p );
+    if ((p = getenv( "WINESERVER_REGISTRY_JOURNAL" )))
+    {
+        journal_limit = atol( p ) * 1024;
+        if (journal_limit <= 0) journal_limit = 4 * 1024 * 1024;
+    }
+
     /* switch to the config dir */
 
     if (fchdir( config_dir_fd ) == -1) fatal_error( "chdir to config dir: %s\n", strerror( errno ));
 
+    init_registry_generations();
+
     /* create the root key */
     root_key = create_key_object( NULL, &root_name, OBJ_PERMANENT, 0, current_time, NULL );
     assert( root_key );
@@ -2052,48 +2767,113 @@ static data_size_t serialize_value( const struct key_value *value, char *buf )
     return size;
 }
 
-/* save a registry key with subkeys to a buffer */
-static data_size_t serialize_key( const struct key *key, char *buf )
+/* save the header of a serialized key, it precedes the values and subkeys */
+static data_size_t serialize_key_header( const WCHAR *name, data_size_t namelen, const WCHAR *class,
+                                         data_size_t classlen, int value_count, int subkey_count,
+                                         unsigned int flags, timeout_t modif, char *buf )
 {
     data_size_t size;
-    int subkey_count, i;
 
-    if (key->flags & KEY_VOLATILE) return 0;
-
-    size = sizeof(data_size_t) + key->obj.name->len + sizeof(data_size_t) + key->classlen + sizeof(int) + sizeof(int)
+    size = sizeof(data_size_t) + namelen + sizeof(data_size_t) + classlen + sizeof(int) + sizeof(int)
            + sizeof(unsigned int) + sizeof(timeout_t);
-    for (i = 0; i <= key->last_value; i++)
-        size += serialize_value( &key->values[i], buf ? buf + size : NULL );
-    subkey_count = 0;
-    for (i = 0; i <= key->last_subkey; i++)
-    {
-        if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
-        size += serialize_key( key->subkeys[i], buf ? buf + size : NULL );
-        ++subkey_count;
-    }
     if (!buf) return size;
 
-    *(data_size_t *)buf = key->obj.name->len;
+    *(data_size_t *)buf = namelen;
     buf += sizeof(data_size_t);
-    memcpy( buf, key->obj.name->name, key->obj.name->len );
-    buf += key->obj.name->len;
+    memcpy( buf, name, namelen );
+    buf += namelen;
 
-    *(data_size_t *)buf = key->classlen;
+    *(data_size_t *)buf = classlen;
     buf += sizeof(data_size_t);
-    memcpy( buf, key->class, key->classlen );
-    buf += key->classlen;
+    memcpy( buf, class, classlen );
+    buf += classlen;
 
-    *(int *)buf = key->last_value + 1;
+    *(int *)buf = value_count;
     buf += sizeof(int);
 
     *(int *)buf = subkey_count;
     buf += sizeof(int);
 
-    *(unsigned int *)buf = key->flags & KEY_SYMLINK;
+    *(unsigned int *)buf = flags;
     buf += sizeof(unsigned int);
 
-    *(timeout_t *)buf = key->modif;
+    *(timeout_t *)buf = modif;
+
+    return size;
+}
+
+/* save the values and subkeys of a key that were not loaded from its hive image yet */
+static data_size_t serialize_hive_key( const struct hive *hive, const struct hive_key *image, char *buf )
+{
+    const struct hive_value *values = get_hive_data( hive, image->values, image->value_count, sizeof(*values) );
+    const unsigned int *subkeys = get_hive_data( hive, image->subkeys, image->subkey_count, sizeof(*subkeys) );
+    const struct hive_key *subimage;
+    struct key_value value;
+    data_size_t size = 0, header;
+    unsigned int i;
 
+    /* the offsets were checked by validate_hive_key() when the image was mapped */
+    for (i = 0; i < image->value_count; i++)
+    {
+        value.name    = (WCHAR *)get_hive_data( hive, values[i].name, values[i].namelen, 1 );
+        value.namelen = values[i].namelen;
+        value.type    = values[i].type;
+        value.len     = values[i].len;
+        value.data    = (void *)get_hive_data( hive, values[i].data, values[i].len, 1 );
+        size += serialize_value( &value, buf ? buf + size : NULL );
+    }
+    for (i = 0; i < image->subkey_count; i++)
+    {
+        subimage = get_hive_data( hive, subkeys[i], 1, sizeof(*subimage) );
+        header = serialize_key_header( NULL, subimage->namelen, NULL, subimage->classlen, 0, 0, 0, 0, NULL );
+        if (buf)
+            serialize_key_header( get_hive_data( hive, subimage->name, subimage->namelen, 1 ), subimage->namelen,
+                                  get_hive_data( hive, subimage->class, subimage->classlen, 1 ), subimage->classlen,
+                                  subimage->value_count, subimage->subkey_count,
+                                  subimage->flags & KEY_SYMLINK, subimage->modif, buf + size );
+        size += header;
+        size += serialize_hive_key( hive, subimage, buf ? buf + size : NULL );
+    }
+    return size;
+}
+
+/* save a registry key with subkeys to a buffer */
+static data_size_t serialize_key( const struct key *key, char *buf )
+{
+    const struct hive_key *image = NULL;
+    data_size_t size;
+    int value_count, subkey_count, i;
+
+    if (key->flags & KEY_VOLATILE) return 0;
+    /* don't load a whole subtree that is still in the hive image just to save it */
+    if (key->hive && !(image = get_hive_data( key->hive, key->hive_offset, 1, sizeof(*image) )))
+        load_lazy_key( key );
+
+    size = serialize_key_header( key->obj.name->name, key->obj.name->len, key->class, key->classlen,
+                                 0, 0, 0, 0, NULL );
+    if (image)
+    {
+        size += serialize_hive_key( key->hive, image, buf ? buf + size : NULL );
+        value_count = image->value_count;
+        subkey_count = image->subkey_count;
+    }
+    else
+    {
+        for (i = 0; i <= key->last_value; i++)
+            size += serialize_value( &key->values[i], buf ? buf + size : NULL );
+        value_count = key->last_value + 1;
+        subkey_count = 0;
+        for (i = 0; i <= key->last_subkey; i++)
+        {
+            if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+            size += serialize_key( key->subkeys[i], buf ? buf + size : NULL );
+            ++subkey_count;
+        }
+    }
+    if (!buf) return size;
+
+    serialize_key_header( key->obj.name->name, key->obj.name->len, key->class, key->classlen,
+                          value_count, subkey_count, key->flags & KEY_SYMLINK, key->modif, buf );
     return size;
 }
 
@@ -2130,6 +2910,195 @@ static data_size_t save_registry( const struct key *key, char *buf )
     return size;
 }
 
+/* state of a hive image being written */
+struct hive_writer
+{
+    FILE        *file;
+    unsigned int pos;     /* current offset in the image */
+    int          failed;  /* set on write errors or overflows */
+};
+
+/* append a block of data to a hive image and return its offset */
+static unsigned int write_hive_data( struct hive_writer *writer, const void *data, data_size_t len )
+{
+    static const char padding[8];
+    unsigned int pos = writer->pos;
+
+    if (!len) return 0;
+    if (HIVE_ALIGN( len ) < len || writer->pos + HIVE_ALIGN( len ) < writer->pos)
+    {
+        writer->failed = 1;
+        return 0;
+    }
+    if (fwrite( data, len, 1, writer->file ) != 1 ||
+        (len != HIVE_ALIGN( len ) && fwrite( padding, HIVE_ALIGN( len ) - len, 1, writer->file ) != 1))
+        writer->failed = 1;
+    writer->pos += HIVE_ALIGN( len );
+    return pos;
+}
+
+static unsigned int copy_hive_key( struct hive_writer *writer, const struct hive *hive,
+                                   const struct hive_key *image );
+
+/* append the values and subkeys of a key that were not loaded from its hive image yet */
+static void copy_hive_contents( struct hive_writer *writer, const struct hive *hive,
+                                const struct hive_key *image, struct hive_key *copy )
+{
+    const struct hive_value *old_values = get_hive_data( hive, image->values, image->value_count, sizeof(*old_values) );
+    const unsigned int *old_subkeys = get_hive_data( hive, image->subkeys, image->subkey_count, sizeof(*old_subkeys) );
+    struct hive_value *values;
+    unsigned int *subkeys, i;
+
+    subkeys = mem_alloc( image->subkey_count * sizeof(*subkeys) + 1 );
+    values = mem_alloc( image->value_count * sizeof(*values) + 1 );
+    if (!subkeys || !values)
+    {
+        writer->failed = 1;
+        goto done;
+    }
+
+    /* the offsets were checked by validate_hive_key() when the image was mapped */
+    for (i = 0; i < image->subkey_count; i++)
+        subkeys[i] = copy_hive_key( writer, hive, get_hive_data( hive, old_subkeys[i], 1, sizeof(*image) ));
+    for (i = 0; i < image->value_count; i++)
+    {
+        values[i] = old_values[i];
+        values[i].name = write_hive_data( writer, get_hive_data( hive, old_values[i].name, old_values[i].namelen, 1 ),
+                                          old_values[i].namelen );
+        values[i].data = write_hive_data( writer, get_hive_data( hive, old_values[i].data, old_values[i].len, 1 ),
+                                          old_values[i].len );
+    }
+    copy->subkey_count = image->subkey_count;
+    copy->subkeys      = write_hive_data( writer, subkeys, copy->subkey_count * sizeof(*subkeys) );
+    copy->value_count  = image->value_count;
+    copy->values       = write_hive_data( writer, values, copy->value_count * sizeof(*values) );
+
+done:
+    free( subkeys );
+    free( values );
+}
+
+/* append a key from an older hive image to a hive image and return its offset */
+static unsigned int copy_hive_key( struct hive_writer *writer, const struct hive *hive,
+                                   const struct hive_key *image )
+{
+    struct hive_key copy = *image;
+
+    copy_hive_contents( writer, hive, image, &copy );
+    copy.name  = write_hive_data( writer, get_hive_data( hive, image->name, image->namelen, 1 ), image->namelen );
+    copy.class = write_hive_data( writer, get_hive_data( hive, image->class, image->classlen, 1 ), image->classlen );
+    return writer->failed ? 0 : write_hive_data( writer, &copy, sizeof(copy) );
+}
+
+/* append a key and its subkeys to a hive image and return its offset */
+static unsigned int write_hive_key( struct hive_writer *writer, const struct key *key )
+{
+    const struct hive_key *old_image = NULL;
+    struct hive_key image;
+    struct hive_value *values = NULL;
+    unsigned int *subkeys = NULL;
+    int i, count = 0;
+
+    memset( &image, 0, sizeof(image) );
+
+    /* a subtree that is still in the old image is copied from it without being loaded */
+    if (key->hive && (old_image = get_hive_data( key->hive, key->hive_offset, 1, sizeof(*old_image) )))
+    {
+        copy_hive_contents( writer, key->hive, old_image, &image );
+        goto header;
+    }
+
+    load_lazy_key( key );
+    subkeys = mem_alloc( (key->last_subkey + 1) * sizeof(*subkeys) + 1 );
+    values = mem_alloc( (key->last_value + 1) * sizeof(*values) + 1 );
+    if (!subkeys || !values)
+    {
+        writer->failed = 1;
+        goto done;
+    }
+
+    for (i = 0; i <= key->last_subkey; i++)
+    {
+        if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+        subkeys[count++] = write_hive_key( writer, key->subkeys[i] );
+    }
+    for (i = 0; i <= key->last_value; i++)
+    {
+        values[i].type    = key->values[i].type;
+        values[i].namelen = key->values[i].namelen;
+        values[i].name    = write_hive_data( writer, key->values[i].name, key->values[i].namelen );
+        values[i].len     = key->values[i].len;
+        values[i].data    = write_hive_data( writer, key->values[i].data, key->values[i].len );
+    }
+    image.subkey_count = count;
+    image.subkeys      = write_hive_data( writer, subkeys, count * sizeof(*subkeys) );
+    image.value_count  = key->last_value + 1;
+    image.values       = write_hive_data( writer, values, image.value_count * sizeof(*values) );
+
+header:
+    image.modif        = key->modif;
+    image.flags        = key->flags & KEY_SYMLINK;
+    image.namelen      = key->obj.name->len;
+    image.name         = write_hive_data( writer, key->obj.name->name, key->obj.name->len );
+    image.classlen     = key->classlen;
+    image.class        = write_hive_data( writer, key->class, key->classlen );
+
+done:
+    free( subkeys );
+    free( values );
+    return writer->failed ? 0 : write_hive_data( writer, &image, sizeof(image) );
+}
+
+/* write the hive image matching a freshly saved branch file */
+static void save_hive_image( const struct key *key, const char *path )
+{
+    struct hive_writer writer;
+    struct hive_header header;
+    struct stat st;
+    char *image_path, *tmp = NULL;
+    int fd;
+
+    if (stat( path, &st ) == -1) return;
+    if (!(image_path = malloc( strlen( path ) + sizeof(".bin") ))) return;
+    if (!(tmp = malloc( strlen( path ) + 32 ))) goto done;
+    sprintf( image_path, "%s.bin", path );
+    sprintf( tmp, "%s.bin%lx.tmp", path, (long)getpid() );
+
+    if ((fd = open( tmp, O_CREAT | O_TRUNC | O_WRONLY, 0666 )) == -1) goto done;
+    if (!(writer.file = fdopen( fd, "w" )))
+    {
+        close( fd );
+        unlink( tmp );
+        goto done;
+    }
+    writer.pos = HIVE_ALIGN( sizeof(header) );
+    writer.failed = 0;
+    memset( &header, 0, sizeof(header) );
+    fwrite( &header, writer.pos, 1, writer.file );  /* filled once the keys are written */
+
+    memcpy( header.magic, HIVE_MAGIC, sizeof(header.magic) );
+    header.version     = HIVE_VERSION;
+    header.prefix_type = prefix_type;
+    header.file_size   = st.st_size;
+    header.file_mtime  = st.st_mtime;
+    header.file_mtime_nsec = get_mtime_nsec( &st );
+    header.file_ino    = st.st_ino;
+    header.root        = write_hive_key( &writer, key );
+    header.size        = writer.pos;
+    if (fseek( writer.file, 0, SEEK_SET ) || fwrite( &header, sizeof(header), 1, writer.file ) != 1)
+        writer.failed = 1;
+    if (fclose( writer.file )) writer.failed = 1;
+
+    if (writer.failed || rename( tmp, image_path ))
+    {
+        unlink( tmp );
+        unlink( image_path );  /* don't leave a stale image around */
+    }
+done:
+    free( tmp );
+    free( image_path );
+}
+
 /* save a registry branch to a file */
 static int save_branch( struct key *key, const char *path )
 {
@@ -2143,6 +3112,11 @@ static int save_branch( struct key *key, const char *path )
         if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
         return 1;
     }
+    if (is_hive_failed( key ))
+    {
+        errno = EIO;
+        return 0;
+    }
 
     /* test the file type */
 
@@ -2200,6 +3174,7 @@ static int save_branch( struct key *key, const char *path )
 
 done:
     free( tmp );
+    if (ret && use_hive_images) save_hive_image( key, path );
     if (ret) make_clean( key, key->timestamp_counter );
     return ret;
 }
@@ -2212,12 +3187,25 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        struct save_branch_info *branch = &save_branch_info[i];
+
+        wait_compaction( branch );
+        /* the journals are removed below, make sure the branch file covers them */
+        if (branch->journal_old || (branch->journal && ftell( branch->journal ) > (long)sizeof(journal_header) - 1))
+            make_dirty( branch->key );
+        if (!save_branch( branch->key, branch->path ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
-                     save_branch_info[i].path );
+                     branch->path );
             perror( " " );
         }
+        else if (branch->journal || branch->journal_old)
+        {
+            close_journal( branch );
+            remove_journal( branch->path, 1 );
+            remove_journal( branch->path, 0 );
+            branch->journal_old = 0;
+        }
     }
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
 }
@@ -2284,6 +3272,8 @@ DECL_HANDLER(create_key)
         {
             key->classlen = (key->classlen / sizeof(WCHAR)) * sizeof(WCHAR);
             if (!(key->class = memdup( class, key->classlen ))) key->classlen = 0;
+            journal_key( key, NULL );
+            update_key_generation( key );
         }
         reply->hkey = alloc_handle( current->process, key, access, objattr->attributes );
         release_object( key );
@@ -2326,7 +3316,7 @@ DECL_HANDLER(delete_key)
 DECL_HANDLER(flush_key)
 {
     struct key *key = get_hkey_obj( req->hkey, 0 );
-    int branches[3], branch_count = 0, i, path_len;
+    int branches[3], branch_count = 0, count, i, path_len;
     char *data;
 
     if (!key) return;
@@ -2337,10 +3327,32 @@ DECL_HANDLER(flush_key)
         find_branches_for_key( key, branches, &branch_count );
     release_object( key );
 
+    for (i = count = 0; i < branch_count; ++i)
+    {
+        struct save_branch_info *branch = &save_branch_info[branches[i]];
+
+        /* the journal already holds the changes; a journaled branch file is only written
+         * by the server, so that an older snapshot can't replace a compacted one */
+        if (branch->journal)
+        {
+            fsync( fileno( branch->journal ));
+            continue;
+        }
+        wait_compaction( branch );  /* the journal could not be reopened after the last one */
+        if (!(branch->key->flags & KEY_DIRTY)) continue;
+        if (is_hive_failed( branch->key ))
+        {
+            /* the snapshot would miss the keys that could not be loaded */
+            set_error( STATUS_REGISTRY_IO_FAILED );
+            return;
+        }
+        branches[count++] = branches[i];
+    }
+    branch_count = count;
+
     reply->timestamp_counter = change_timestamp_counter;
     for (i = 0; i < branch_count; ++i)
     {
-        if (!(save_branch_info[branches[i]].key->flags & KEY_DIRTY)) continue;
         ++reply->branch_count;
         path_len = strlen( save_branch_info[branches[i]].path ) + 1;
         reply->total += sizeof(int) + sizeof(int) + path_len + save_registry( save_branch_info[branches[i]].key, NULL );
@@ -2355,7 +3367,6 @@ DECL_HANDLER(flush_key)
 
     for (i = 0; i < branch_count; ++i)
     {
-        if (!(save_branch_info[branches[i]].key->flags & KEY_DIRTY)) continue;
         *(int *)data = branches[i];
         data += sizeof(int);
         path_len = strlen( save_branch_info[branches[i]].path ) + 1;
@@ -2370,8 +3381,28 @@ DECL_HANDLER(flush_key)
 /* clear dirty state after successful registry branch flush */
 DECL_HANDLER(flush_key_done)
 {
-    if (req->branch < save_branch_count) make_clean( save_branch_info[req->branch].key, req->timestamp_counter );
-    else set_error( STATUS_INVALID_PARAMETER );
+    struct save_branch_info *branch;
+    char *image_path;
+
+    if (req->branch >= save_branch_count)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    branch = &save_branch_info[req->branch];
+    make_clean( branch->key, req->timestamp_counter );
+    if (!use_hive_images || fchdir( config_dir_fd ) == -1) return;
+
+    /* the client replaced the branch file, the image has to follow it */
+    if (!(branch->key->flags & KEY_DIRTY)) save_hive_image( branch->key, branch->path );
+    else if ((image_path = malloc( strlen( branch->path ) + sizeof(".bin") )))
+    {
+        /* the file misses later changes, the next save_branch() will write both */
+        sprintf( image_path, "%s.bin", branch->path );
+        unlink( image_path );
+        free( image_path );
+    }
+    if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
 }
 
 /* enumerate registry subkeys */
@@ -2381,6 +3412,7 @@ DECL_HANDLER(enum_key)
 
     if ((key = get_hkey_obj( req->hkey, req->index == -1 ? 0 : KEY_ENUMERATE_SUB_KEYS )))
     {
+        get_key_generation( key, &reply->gen_index, &reply->generation );
         enum_key( key, req->index, req->info_class, reply );
         release_object( key );
     }
@@ -2419,6 +3451,7 @@ DECL_HANDLER(get_key_value)
     reply->total = 0;
     if ((key = get_hkey_obj( req->hkey, KEY_QUERY_VALUE )))
     {
+        get_key_generation( key, &reply->gen_index, &reply->generation );
         get_value( key, &name, &reply->type, &reply->total );
         release_object( key );
     }
@@ -2472,6 +3505,7 @@ DECL_HANDLER(load_registry)
     if ((key = create_key( parent, &name, 0, KEY_WOW64_64KEY, 0, sd )))
     {
         load_registry( key, req->file );
+        update_all_generations();
         release_object( key );
     }
     if (parent) release_object( parent );
@@ -2583,6 +3617,7 @@ DECL_HANDLER(rename_key)
     if (key)
     {
         rename_key( key, &name );
+        update_all_generations();
         release_object( key );
     }
 }
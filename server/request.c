@@ -290,11 +290,125 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* Request statistics
+ *
+ * The number of calls of each request type is always counted, together with
+ * log2 histograms of the time spent in the handler and of the time spent
+ * queued, that is from the main loop waking up until the handler starts,
+ * while the requests and events that became ready first are processed. The
+ * requests of a batch are counted one by one, and their time is also part of
+ * the handler time of the batch itself. Only the main thread updates them, so
+ * they don't need any locking. They are written to the request-stats file of
+ * the server directory on SIGUSR1.
+ */
+
+#define REQUEST_STATS_BUCKETS 32  /* bucket i counts times in [2^i,2^(i+1)) ns, and bucket 0 also 0 */
+
+struct request_stats
+{
+    unsigned int      count;                                /* number of calls */
+    unsigned __int64  handler_time;                         /* total time spent in the handler (ns) */
+    unsigned __int64  queue_time;                           /* total time spent waiting to be handled (ns) */
+    unsigned int      handler_hist[REQUEST_STATS_BUCKETS];  /* histogram of the handler times */
+    unsigned int      queue_hist[REQUEST_STATS_BUCKETS];    /* histogram of the waiting times */
+};
+
+static struct request_stats request_stats[REQ_NB_REQUESTS];
+
+/* return a monotonic time in nanoseconds; monotonic_counter() and the statistics both use it */
+static unsigned __int64 monotonic_counter_ns(void)
+{
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+
+    if (!timebase.denom) mach_timebase_info( &timebase );
+#ifdef HAVE_MACH_CONTINUOUS_TIME
+    if (&mach_continuous_time != NULL)
+        return mach_continuous_time() * timebase.numer / timebase.denom;
+#endif
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#elif defined(HAVE_CLOCK_GETTIME)
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    if (!clock_gettime( CLOCK_MONOTONIC_RAW, &ts ))
+        return (unsigned __int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    if (!clock_gettime( CLOCK_MONOTONIC, &ts ))
+        return (unsigned __int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    return (current_time - server_start_time) * 100;
+}
+
+/* get the histogram bucket of a time */
+static inline unsigned int get_stats_bucket( unsigned __int64 time )
+{
+    unsigned int bucket = 0;
+
+    while (time > 1 && bucket < REQUEST_STATS_BUCKETS - 1)
+    {
+        time >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* account for a handled request */
+static void add_request_stats( enum request req, unsigned __int64 ready, unsigned __int64 start,
+                               unsigned __int64 end )
+{
+    struct request_stats *stats = &request_stats[req];
+
+    if (ready > start) ready = start;
+    stats->count++;
+    stats->handler_time += end - start;
+    stats->queue_time += start - ready;
+    stats->handler_hist[get_stats_bucket( end - start )]++;
+    stats->queue_hist[get_stats_bucket( start - ready )]++;
+}
+
+/* print a histogram on a single line, skipping the empty buckets */
+static void dump_stats_histogram( FILE *file, const char *name, const unsigned int *hist )
+{
+    unsigned int i;
+
+    fprintf( file, "  %s:", name );
+    for (i = 0; i < REQUEST_STATS_BUCKETS; i++)
+        if (hist[i]) fprintf( file, " %u:%u", i, hist[i] );
+    fputc( '\n', file );
+}
+
+/* write the request statistics to the request-stats file */
+void dump_request_stats(void)
+{
+    FILE *file;
+    unsigned int i;
+
+    if (!(file = fopen( "request-stats", "w" )))
+    {
+        fprintf( stderr, "wineserver: cannot write request-stats: %s\n", strerror( errno ));
+        return;
+    }
+    fprintf( file, "# request count handler_ns queue_ns, then log2(ns) histograms as bucket:count\n" );
+    for (i = 0; i < REQ_NB_REQUESTS; i++)
+    {
+        const struct request_stats *stats = &request_stats[i];
+
+        if (!stats->count) continue;
+        fprintf( file, "%s %u %llu %llu\n", get_request_name( i ), stats->count,
+                 (unsigned long long)stats->handler_time, (unsigned long long)stats->queue_time );
+        dump_stats_histogram( file, "handler", stats->handler_hist );
+        dump_stats_histogram( file, "queue", stats->queue_hist );
+    }
+    dump_namespace_stats( file );
+    fclose( file );
+}
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
+    unsigned __int64 start;
 
     current = thread;
     current->reply_size = 0;
@@ -304,7 +418,12 @@ static void call_req_handler( struct thread *thread )
     if (debug_level) trace_request();
 
     if (req < REQ_NB_REQUESTS)
+    {
+        start = monotonic_counter_ns();
         req_handlers[req]( &current->req, &reply );
+        /* monotonic_time is updated when the main loop wakes up */
+        add_request_stats( req, monotonic_time * 100, start, monotonic_counter_ns() );
+    }
     else
         set_error( STATUS_NOT_IMPLEMENTED );
 
@@ -326,6 +445,123 @@ static void call_req_handler( struct thread *thread )
     current = NULL;
 }
 
+/* size of a batch entry with its padded variable size data */
+static inline data_size_t batch_entry_size( data_size_t size )
+{
+    return sizeof(union generic_request) + ((size + BATCH_ALIGNMENT - 1) & ~(BATCH_ALIGNMENT - 1));
+}
+
+/* check whether a request can be part of a batch */
+static int is_batchable_request( enum request req )
+{
+    switch (req)
+    {
+    case REQ_batch:
+    case REQ_select:
+    case REQ_init_first_thread:
+    case REQ_init_thread:
+    case REQ_terminate_process:
+    case REQ_terminate_thread:
+        return 0;
+    default:
+        return req < REQ_NB_REQUESTS;
+    }
+}
+
+/* perform a batch of requests, the replies are concatenated in the batch reply */
+DECL_HANDLER(batch)
+{
+    union generic_request saved_req = current->req;
+    const char *data = current->req_data;
+    data_size_t size = get_req_data_size(), max_size = get_reply_max_size();
+    data_size_t pos = 0, reply_pos = 0;
+    unsigned int count = 0, error = STATUS_SUCCESS;
+    unsigned __int64 start;
+    struct thread *thread = current;
+    char *replies = NULL;
+
+    if (max_size && !(replies = mem_alloc( max_size ))) return;
+    current->req_data = NULL;
+
+    while (pos < size)
+    {
+        union generic_request sub;
+        union generic_reply sub_reply;
+        enum request type;
+
+        if (size - pos < sizeof(sub) || count >= BATCH_MAX_COUNT)
+        {
+            error = STATUS_INVALID_PARAMETER;
+            break;
+        }
+        memcpy( &sub, data + pos, sizeof(sub) );
+        type = sub.request_header.req;
+        if (!is_batchable_request( type ) || sub.request_header.request_size > size - pos - sizeof(sub))
+        {
+            error = STATUS_INVALID_PARAMETER;
+            break;
+        }
+        if (sub.request_header.reply_size > max_size - reply_pos ||
+            batch_entry_size( sub.request_header.reply_size ) > max_size - reply_pos)
+        {
+            error = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        current->req = sub;
+        current->req_data = NULL;
+        if (sub.request_header.request_size &&
+            !(current->req_data = memdup( data + pos + sizeof(sub), sub.request_header.request_size )))
+        {
+            error = get_error();
+            break;
+        }
+        current->reply_size = 0;
+        clear_error();
+        memset( &sub_reply, 0, sizeof(sub_reply) );
+
+        if (debug_level) trace_request();
+        start = monotonic_counter_ns();
+        req_handlers[type]( &current->req, &sub_reply );
+        add_request_stats( type, monotonic_time * 100, start, monotonic_counter_ns() );
+
+        if (!current)  /* the thread got killed */
+        {
+            free( (void *)data );
+            free( replies );
+            return;
+        }
+
+        sub_reply.reply_header.error = current->error;
+        sub_reply.reply_header.reply_size = current->reply_size;
+        if (debug_level) trace_reply( type, &sub_reply );
+
+        memset( replies + reply_pos, 0, batch_entry_size( current->reply_size ));
+        memcpy( replies + reply_pos, &sub_reply, sizeof(sub_reply) );
+        if (current->reply_size)
+            memcpy( replies + reply_pos + sizeof(sub_reply), current->reply_data, current->reply_size );
+        reply_pos += batch_entry_size( current->reply_size );
+        pos += batch_entry_size( sub.request_header.request_size );
+        count++;
+
+        free( current->req_data );
+        free( current->reply_data );
+        current->req_data = NULL;
+        current->reply_data = NULL;
+        current->reply_size = 0;
+    }
+
+    assert( current == thread );
+    free( current->req_data );
+    current->req = saved_req;
+    current->req_data = (void *)data;
+    clear_error();
+    if (error) set_error( error );
+    reply->count = count;
+    if (reply_pos) set_reply_data_ptr( replies, reply_pos );
+    else free( replies );
+}
+
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
@@ -522,25 +758,7 @@ int send_client_fd( struct process *process, int fd, obj_handle_t handle )
 /* return a monotonic time counter */
 timeout_t monotonic_counter(void)
 {
-#ifdef __APPLE__
-    static mach_timebase_info_data_t timebase;
-
-    if (!timebase.denom) mach_timebase_info( &timebase );
-#ifdef HAVE_MACH_CONTINUOUS_TIME
-    if (&mach_continuous_time != NULL)
-        return mach_continuous_time() * timebase.numer / timebase.denom / 100;
-#endif
-    return mach_absolute_time() * timebase.numer / timebase.denom / 100;
-#elif defined(HAVE_CLOCK_GETTIME)
-    struct timespec ts;
-#ifdef CLOCK_MONOTONIC_RAW
-    if (!clock_gettime( CLOCK_MONOTONIC_RAW, &ts ))
-        return (timeout_t)ts.tv_sec * TICKS_PER_SEC + ts.tv_nsec / 100;
-#endif
-    if (!clock_gettime( CLOCK_MONOTONIC, &ts ))
-        return (timeout_t)ts.tv_sec * TICKS_PER_SEC + ts.tv_nsec / 100;
-#endif
-    return current_time - server_start_time;
+    return monotonic_counter_ns() / 100;
 }
 
 static void master_socket_dump( struct object *obj, int verbose )
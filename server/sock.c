@@ -152,6 +152,11 @@ union unix_sockaddr
 
 static struct list poll_list = LIST_INIT( poll_list );
 
+static socket_shm_t *socket_shared;
+static unsigned int socket_state_free[SOCKET_STATE_COUNT];
+static unsigned int socket_state_free_count;
+static unsigned int socket_state_used;
+
 struct poll_req
 {
     struct list entry;
@@ -274,6 +279,8 @@ struct sock
     icmp_fixup_data[MAX_ICMP_HISTORY_LENGTH]; /* Sent ICMP packets history used to fixup reply id. */
     struct bound_addr  *bound_addr[2]; /* Links to the entries in bound addresses tree. */
     unsigned int        icmp_fixup_data_len;  /* Sent ICMP packets history length. */
+    unsigned int        state_index; /* index in the shared state table */
+    unsigned int        state_serial; /* serial in the shared state table, 0 if none */
     unsigned int        rd_shutdown : 1; /* is the read end shut down? */
     unsigned int        wr_shutdown : 1; /* is the write end shut down? */
     unsigned int        wr_shutdown_pending : 1; /* is a write shutdown pending? */
@@ -754,6 +761,27 @@ out:
     return ret;
 }
 
+/* create the table that clients use to check whether a recv or send can skip the server;
+ * this is done with the first socket, once the object namespace exists */
+static void init_socket_states(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+                                  '_','_','w','i','n','e','_','s','o','c','k','e','t','_','s','t','a','t','e','s'};
+    static const struct unicode_str name = { nameW, sizeof(nameW) };
+    static int init_done;
+    struct object *mapping;
+    void *ptr;
+
+    if (init_done) return;
+    init_done = 1;
+    if (!(mapping = create_shared_mapping( NULL, &name, sizeof(struct socket_shared_memory),
+                                           OBJ_PERMANENT, NULL, &ptr )))
+        return;
+    socket_shared = ptr;
+    memset( (void *)socket_shared, 0, sizeof(*socket_shared) );
+    release_object( mapping );
+}
+
 void sock_init(void)
 {
     sock_shutdown_type = sock_check_pollhup();
@@ -772,6 +800,77 @@ void sock_init(void)
     }
 }
 
+/* compute the SOCKET_STATE_* flags of a socket
+ *
+ * A recv or send may only bypass the server if completing it in the client
+ * leaves nothing for the server to do: no queued asyncs that must be served
+ * first, and no reported events that the call would have to reset. */
+static unsigned int get_socket_state_flags( struct sock *sock )
+{
+    struct completion *completion;
+    unsigned int flags = 0;
+    apc_param_t ckey;
+
+    if (sock->state != SOCK_CONNECTED && sock->state != SOCK_CONNECTIONLESS) return 0;
+    if (sock->accept_recv_req || sock->aborted) return 0;
+
+    if ((completion = fd_get_completion( sock->fd, &ckey )))
+    {
+        if (!(get_fd_comp_flags( sock->fd ) & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS))
+            flags |= SOCKET_STATE_COMPLETION;
+        release_object( completion );
+    }
+
+    if (!sock->rd_shutdown && !sock->reset && !async_queued( &sock->read_q ) &&
+        !((sock->pending_events | sock->reported_events) & AFD_POLL_READ))
+        flags |= SOCKET_STATE_RECV;
+
+    if (!sock->wr_shutdown && !sock->wr_shutdown_pending && !async_queued( &sock->write_q ) &&
+        (sock->type != WS_SOCK_DGRAM || sock->bound))
+        flags |= SOCKET_STATE_SEND;
+
+    return flags;
+}
+
+/* publish the current state of a socket in the shared table */
+static void sock_update_state( struct sock *sock )
+{
+    if (!sock->state_serial) return;
+    socket_shared->state[sock->state_index] = ((unsigned __int64)sock->state_serial << 32) |
+                                              get_socket_state_flags( sock );
+}
+
+/* the completion port or completion mode of a fd changed */
+void sock_update_completion( struct fd *fd )
+{
+    struct object *obj = get_fd_user( fd );
+
+    if (obj && obj->ops == &sock_ops) sock_update_state( (struct sock *)obj );
+}
+
+/* assign an entry of the shared state table to a socket */
+static void sock_alloc_state( struct sock *sock )
+{
+    static unsigned int serial;
+
+    if (sock->state_serial || !socket_shared) return;
+
+    if (socket_state_free_count) sock->state_index = socket_state_free[--socket_state_free_count];
+    else if (socket_state_used < SOCKET_STATE_COUNT) sock->state_index = socket_state_used++;
+    else return;
+
+    if (!++serial) ++serial;
+    sock->state_serial = serial;
+}
+
+static void sock_free_state( struct sock *sock )
+{
+    if (!sock->state_serial) return;
+    socket_shared->state[sock->state_index] = 0;
+    socket_state_free[socket_state_free_count++] = sock->state_index;
+    sock->state_serial = 0;
+}
+
 static void sock_reselect( struct sock *sock )
 {
     int ev = sock_get_poll_events( sock->fd );
@@ -780,6 +879,7 @@ static void sock_reselect( struct sock *sock )
         fprintf(stderr,"sock_reselect(%p): new mask %x\n", sock, ev);
 
     set_fd_events( sock->fd, ev );
+    sock_update_state( sock );
 }
 
 static unsigned int afd_poll_flag_to_win32( unsigned int flags )
@@ -1308,6 +1408,7 @@ static void post_socket_event( struct sock *sock, enum afd_poll_bit event_bit )
     {
         sock->pending_events |= event;
         sock->reported_events |= event;
+        sock_update_state( sock );
 
         if ((sock->mask & event) && sock->event)
             set_event( sock->event );
@@ -1729,12 +1830,15 @@ static void sock_destroy( struct object *obj )
     free_async_queue( &sock->poll_q );
     if (sock->event) release_object( sock->event );
     if (sock->fd) release_object( sock->fd );
+    sock_free_state( sock );
 }
 
 static struct sock *create_socket(void)
 {
     struct sock *sock;
 
+    init_socket_states();
+
     if (!(sock = alloc_object( &sock_ops ))) return NULL;
     sock->fd      = NULL;
     sock->state   = SOCK_UNCONNECTED;
@@ -1773,6 +1877,8 @@ static struct sock *create_socket(void)
     sock->rcvtimeo = 0;
     sock->sndtimeo = 0;
     sock->icmp_fixup_data_len = 0;
+    sock->state_index = 0;
+    sock->state_serial = 0;
     sock->bound_addr[0] = sock->bound_addr[1] = NULL;
     init_async_queue( &sock->read_q );
     init_async_queue( &sock->write_q );
@@ -3935,16 +4041,32 @@ DECL_HANDLER(recv_socket)
             queue_async( &sock->read_q, async );
 
         /* always reselect; we changed reported_events above */
+        sock_alloc_state( sock );
         sock_reselect( sock );
 
         reply->wait = async_handoff( async, NULL, 0 );
         reply->options = get_fd_options( fd );
         reply->nonblocking = sock->nonblocking;
+        reply->state_index = sock->state_index;
+        reply->state_serial = sock->state_serial;
         release_object( async );
     }
     release_object( sock );
 }
 
+DECL_HANDLER(reset_socket_read_event)
+{
+    struct sock *sock = (struct sock *)get_handle_obj( current->process, req->handle, 0, &sock_ops );
+
+    if (!sock) return;
+
+    /* same as a recv_socket request, data may have been reported while the client received it */
+    sock->pending_events &= ~AFD_POLL_READ;
+    sock->reported_events &= ~AFD_POLL_READ;
+    sock_reselect( sock );
+    release_object( sock );
+}
+
 static void send_socket_completion_callback( void *private )
 {
     struct send_req *send_req = private;
@@ -4065,6 +4187,13 @@ DECL_HANDLER(send_socket)
         reply->wait = async_handoff( async, NULL, 0 );
         reply->options = get_fd_options( fd );
         reply->nonblocking = sock->nonblocking;
+        if (!(req->flags & SERVER_SOCKET_IO_SYSTEM))
+        {
+            sock_alloc_state( sock );
+            sock_update_state( sock );
+            reply->state_index = sock->state_index;
+            reply->state_serial = sock->state_serial;
+        }
         release_object( async );
     }
     release_object( sock );
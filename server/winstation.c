@@ -226,7 +226,7 @@ static void winstation_destroy( struct object *obj )
     list_remove( &winstation->entry );
     if (winstation->clipboard) release_object( winstation->clipboard );
     if (winstation->atom_table) release_object( winstation->atom_table );
-    free( winstation->desktop_names );
+    free_namespace( winstation->desktop_names );
 }
 
 /* retrieve the process window station, checking the handle access rights */
@@ -329,7 +329,7 @@ static int desktop_link_name( struct object *obj, struct object_name *name, stru
         set_error( STATUS_OBJECT_PATH_SYNTAX_BAD );
         return 0;
     }
-    namespace_add( winstation->desktop_names, name );
+    if (!namespace_add( winstation->desktop_names, name )) return 0;
     return 1;
 }
 